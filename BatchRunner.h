@@ -0,0 +1,388 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stdint.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Streaming batch mode for the command line calculators (FullPrecisionMod,
+// ModTest), for turning millions of (a, b, m) records into test vectors.
+//
+// Input is text, one record per line as three numbers, or binary, 12 byte
+// records of little endian a, b, m. A regular file is memory mapped, stdin
+// is read in blocks, and either way the input is cut into ~1 MB chunks on
+// record boundaries.
+//
+// The chunks go round a ring of 4 slots per thread. The main thread fills
+// free slots and writes finished ones out in order, and the workers take
+// whichever filled slot is next. So reading, the arithmetic and writing all
+// overlap, memory stays bounded however big the input is, and the output
+// comes out in input order.
+//
+// Each output line is the record followed by the result, in the radix the
+// tool reads. Lines that don't parse, or have m == 0, are counted and
+// skipped. The record count and records/s go to stderr at the end.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct BatchOptions {
+	BatchOptions(): Input(0), Output(0), Binary(false), Hex(false), Threads(0) {}
+
+	const char* Input;   // 0 or "-" for stdin
+	const char* Output;  // 0 or "-" for stdout
+	bool Binary;         // 12 byte records instead of text
+	bool Hex;            // radix of the text records, set by the tool
+	unsigned Threads;    // 0 for all cores
+};
+
+inline void batch_usage(const char* tool, const char* fields) {
+	std::fprintf(stderr,
+		"usage: %s                 interactive\n"
+		"       %s --batch [options]\n"
+		"  --input FILE    records to read (default stdin)\n"
+		"  --output FILE   where to write results (default stdout)\n"
+		"  --binary        input is 12 byte records: %s, little endian\n"
+		"  --threads N     worker threads (default: all cores)\n",
+		tool, tool, fields);
+}
+
+// the options after --batch. false if they don't make sense
+inline bool parse_batch_options(int argc, char** argv, BatchOptions& opts) {
+	for (int i = 2; i < argc; ++i) {
+		if (!std::strcmp(argv[i], "--input") && i + 1 < argc) {
+			opts.Input = argv[++i];
+		} else if (!std::strcmp(argv[i], "--output") && i + 1 < argc) {
+			opts.Output = argv[++i];
+		} else if (!std::strcmp(argv[i], "--binary")) {
+			opts.Binary = true;
+		} else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+			opts.Threads = std::atoi(argv[++i]);
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct BatchChunk {
+	BatchChunk(): Data(0), Len(0), Records(0), Bad(0), Done(false) {}
+
+	std::string Owned;    // the input, when it didn't come from a mapping
+	const char* Data;
+	size_t Len;
+	std::string Out;
+	uint64_t Records;
+	uint64_t Bad;
+	bool Done;
+};
+
+//
+// BatchSource
+// Hands out the input a chunk at a time, always ending on a record boundary.
+//
+class BatchSource {
+public:
+	static const size_t ChunkBytes = 1 << 20;
+	static const size_t RecordBytes = 12;
+
+	BatchSource(): Fd(-1), Map(0), MapLen(0), Pos(0), Binary(false), Eof(false) {}
+	~BatchSource() {
+		if (Map)
+			munmap((void*)Map, MapLen);
+		if (Fd > 0)
+			close(Fd);
+	}
+
+	bool open(const BatchOptions& opts) {
+		Binary = opts.Binary;
+		if (!opts.Input || !std::strcmp(opts.Input, "-")) {
+			Fd = 0;
+			return true;
+		}
+		Fd = ::open(opts.Input, O_RDONLY);
+		if (Fd < 0) {
+			std::perror(opts.Input);
+			return false;
+		}
+		struct stat st;
+		if (fstat(Fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+			if (map != MAP_FAILED) {
+				Map = (const char*)map;
+				MapLen = st.st_size;
+				madvise(map, MapLen, MADV_SEQUENTIAL);
+			}
+		}
+		return true;
+	}
+
+	bool next(BatchChunk& chunk) {
+		return Map ? next_mapped(chunk) : next_read(chunk);
+	}
+
+private:
+	// where a chunk starting at data should end, given len bytes are there
+	size_t cut(const char* data, size_t len, bool last) const {
+		if (Binary)
+			return last ? len : len - len % RecordBytes;
+		if (last)
+			return len;
+		const char* nl = (const char*)memrchr(data, '\n', len);
+		return nl ? nl - data + 1 : 0;
+	}
+
+	bool next_mapped(BatchChunk& chunk) {
+		if (Pos >= MapLen)
+			return false;
+		size_t len = MapLen - Pos;
+		if (len > ChunkBytes) {
+			// run on to the end of the record the chunk stops in
+			len = ChunkBytes;
+			if (Binary) {
+				len -= len % RecordBytes;
+			} else {
+				const char* nl = (const char*)memchr(Map + Pos + len, '\n', MapLen - Pos - len);
+				len = nl ? nl - (Map + Pos) + 1 : MapLen - Pos;
+			}
+		}
+		chunk.Data = Map + Pos;
+		chunk.Len = len;
+		Pos += len;
+		return true;
+	}
+
+	bool next_read(BatchChunk& chunk) {
+		chunk.Owned.swap(Carry);
+		Carry.clear();
+		while (!Eof && chunk.Owned.size() < ChunkBytes) {
+			size_t have = chunk.Owned.size();
+			chunk.Owned.resize(have + ChunkBytes);
+			ssize_t got = read(Fd, &chunk.Owned[have], ChunkBytes);
+			chunk.Owned.resize(have + (got > 0 ? got : 0));
+			if (got <= 0)
+				Eof = true;
+		}
+		if (chunk.Owned.empty())
+			return false;
+
+		// whatever is past the last whole record goes into the next chunk
+		size_t len = cut(chunk.Owned.data(), chunk.Owned.size(), Eof);
+		Carry.assign(chunk.Owned, len, std::string::npos);
+		chunk.Owned.resize(len);
+		chunk.Data = chunk.Owned.data();
+		chunk.Len = len;
+		return true;
+	}
+
+	int Fd;
+	const char* Map;
+	size_t MapLen;
+	size_t Pos;
+	bool Binary;
+	bool Eof;
+	std::string Carry;
+};
+
+// reads a 32 bit number, false if there isn't one or it doesn't fit
+inline bool batch_parse(const char*& p, const char* end, bool hex, uint32_t& v) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+		++p;
+	if (hex && end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		p += 2;
+	uint64_t n = 0;
+	const char* start = p;
+	for (; p < end; ++p) {
+		uint8_t d;
+		if (*p >= '0' && *p <= '9')
+			d = *p - '0';
+		else if (hex && *p >= 'a' && *p <= 'f')
+			d = *p - 'a' + 10;
+		else if (hex && *p >= 'A' && *p <= 'F')
+			d = *p - 'A' + 10;
+		else
+			break;
+		n = n * (hex ? 16 : 10) + d;
+		if (n > 0xFFFFFFFFull)
+			return false;
+	}
+	v = n;
+	return p != start;
+}
+
+inline void batch_format(std::string& out, uint32_t v, bool hex, char sep) {
+	char buf[12];
+	char* p = buf + sizeof(buf);
+	*--p = sep;
+	do {
+		*--p = "0123456789abcdef"[hex ? v % 16 : v % 10];
+		v = hex ? v / 16 : v / 10;
+	} while (v);
+	out.append(p, buf + sizeof(buf) - p);
+}
+
+template <class Fn>
+void batch_record(BatchChunk& chunk, Fn& fn, bool hex, uint32_t a, uint32_t b, uint32_t m) {
+	if (m == 0) {
+		++chunk.Bad;
+		return;
+	}
+	batch_format(chunk.Out, a, hex, ' ');
+	batch_format(chunk.Out, b, hex, ' ');
+	batch_format(chunk.Out, m, hex, ' ');
+	batch_format(chunk.Out, fn(a, b, m), hex, '\n');
+	++chunk.Records;
+}
+
+template <class Fn>
+void batch_process(BatchChunk& chunk, Fn& fn, const BatchOptions& opts) {
+	chunk.Out.clear();
+	chunk.Out.reserve(chunk.Len * 2);
+	chunk.Records = 0;
+	chunk.Bad = 0;
+	const char* p = chunk.Data;
+	const char* end = chunk.Data + chunk.Len;
+
+	if (opts.Binary) {
+		// a short record at the very end is bad
+		for (; end - p >= (ptrdiff_t)BatchSource::RecordBytes; p += BatchSource::RecordBytes) {
+			const uint8_t* r = (const uint8_t*)p;
+			uint32_t v[3];
+			for (uint8_t i = 0; i < 3; ++i)
+				v[i] = r[4*i] | (r[4*i+1] << 8) | (r[4*i+2] << 16) | ((uint32_t)r[4*i+3] << 24);
+			batch_record(chunk, fn, opts.Hex, v[0], v[1], v[2]);
+		}
+		if (p != end)
+			++chunk.Bad;
+		return;
+	}
+
+	while (p < end) {
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		const char* lineEnd = nl ? nl : end;
+		const char* q = p;
+		while (q < lineEnd && (*q == ' ' || *q == '\t' || *q == '\r'))
+			++q;
+		if (q != lineEnd) {
+			uint32_t a, b, m;
+			bool ok = batch_parse(q, lineEnd, opts.Hex, a) && batch_parse(q, lineEnd, opts.Hex, b) &&
+			          batch_parse(q, lineEnd, opts.Hex, m);
+			while (ok && q < lineEnd && (*q == ' ' || *q == '\t' || *q == '\r'))
+				++q;
+			if (ok && q == lineEnd)
+				batch_record(chunk, fn, opts.Hex, a, b, m);
+			else
+				++chunk.Bad;
+		}
+		p = lineEnd + 1;
+	}
+}
+
+//
+// run_batch
+// Runs fn(a, b, m) over every record. Returns the exit code for main: 0 when
+// every record was good, 1 if some were skipped, 2 if the files wouldn't open.
+//
+template <class Fn>
+int run_batch(const BatchOptions& opts, Fn fn) {
+	BatchSource source;
+	if (!source.open(opts))
+		return 2;
+	FILE* out = stdout;
+	if (opts.Output && std::strcmp(opts.Output, "-")) {
+		out = std::fopen(opts.Output, "w");
+		if (!out) {
+			std::perror(opts.Output);
+			return 2;
+		}
+	}
+
+	unsigned threads = opts.Threads ? opts.Threads : std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	const uint64_t SlotCount = 4 * threads;
+	std::vector<BatchChunk> slots(SlotCount);
+
+	// chunk n lives in slot n % SlotCount. Chunks below NextRead have been
+	// filled, below NextWork claimed by a worker, below NextWrite written.
+	std::mutex lock;
+	std::condition_variable filled, finished;
+	uint64_t nextRead = 0, nextWork = 0, nextWrite = 0;
+	bool eof = false;
+
+	std::vector<std::thread> pool;
+	for (unsigned t = 0; t < threads; ++t) {
+		pool.push_back(std::thread([&]() {
+			std::unique_lock<std::mutex> guard(lock);
+			while (true) {
+				filled.wait(guard, [&]() { return nextWork < nextRead || eof; });
+				if (nextWork == nextRead)
+					return;
+				BatchChunk& chunk = slots[nextWork++ % SlotCount];
+				guard.unlock();
+				batch_process(chunk, fn, opts);
+				guard.lock();
+				chunk.Done = true;
+				finished.notify_all();
+			}
+		}));
+	}
+
+	uint64_t records = 0, bad = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (true) {
+		// top up the free slots. A free slot isn't touched by the workers
+		// until nextRead moves past it, so it's filled outside the lock.
+		while (!eof && nextRead - nextWrite < SlotCount) {
+			BatchChunk& chunk = slots[nextRead % SlotCount];
+			bool more = source.next(chunk);
+			std::lock_guard<std::mutex> guard(lock);
+			if (more) {
+				chunk.Done = false;
+				++nextRead;
+			} else {
+				eof = true;
+			}
+			filled.notify_all();
+		}
+
+		// then write the oldest one out once it's done
+		std::unique_lock<std::mutex> guard(lock);
+		if (eof && nextWrite == nextRead)
+			break;
+		BatchChunk& chunk = slots[nextWrite % SlotCount];
+		finished.wait(guard, [&]() { return chunk.Done; });
+		guard.unlock();
+		std::fwrite(chunk.Out.data(), 1, chunk.Out.size(), out);
+		records += chunk.Records;
+		bad += chunk.Bad;
+		chunk.Owned.clear();
+		guard.lock();
+		++nextWrite;
+	}
+	for (unsigned t = 0; t < threads; ++t)
+		pool[t].join();
+	std::fflush(out);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (out != stdout)
+		std::fclose(out);
+
+	std::fprintf(stderr, "%llu records, %llu skipped, %.3f s, %.0f records/s, %u threads\n",
+	             (unsigned long long)records, (unsigned long long)bad, seconds,
+	             seconds > 0 ? records / seconds : 0.0, threads);
+	return bad ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,477 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include "stdint.h"
+#include "string.h"
+#include "ModArith.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Fixed width multi-precision integers for the big Diffie-Hellman groups.
+// Numbers are little endian arrays of limbs. The limb size follows the target:
+// 8 bits on the AVR (it has an 8x8 hardware multiply), 16 bits on other 16 bit
+// machines, 32 bits everywhere else. Define BIGNUM_LIMB_BITS to override.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef BIGNUM_LIMB_BITS
+#if defined(__AVR__)
+#define BIGNUM_LIMB_BITS 8
+#elif defined(UINTPTR_MAX) && UINTPTR_MAX == 0xFFFF
+#define BIGNUM_LIMB_BITS 16
+#else
+#define BIGNUM_LIMB_BITS 32
+#endif
+#endif
+
+#if BIGNUM_LIMB_BITS == 8
+typedef uint8_t BigLimb;
+typedef uint16_t BigDLimb;
+#elif BIGNUM_LIMB_BITS == 16
+typedef uint16_t BigLimb;
+typedef uint32_t BigDLimb;
+#else
+typedef uint32_t BigLimb;
+typedef uint64_t BigDLimb;
+#endif
+
+const uint8_t BigLimbBits = sizeof(BigLimb) * 8;
+
+// Operands of at least this many limbs are multiplied with Karatsuba. The
+// scratch space is ~4n limbs on the stack, which the AVR can't spare, so it
+// only does schoolbook by default.
+#ifndef BIGNUM_KARATSUBA_LIMBS
+#if defined(__AVR__)
+#define BIGNUM_KARATSUBA_LIMBS 0xFFFF
+#else
+#define BIGNUM_KARATSUBA_LIMBS 32
+#endif
+#endif
+
+// Window size for big exponentiations. Each table entry is a whole number,
+// so this is 2^(k-1) * Bits/8 bytes of stack.
+#ifndef BIGNUM_WINDOW
+#if defined(__AVR__)
+#define BIGNUM_WINDOW 2
+#else
+#define BIGNUM_WINDOW 5
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Limb array primitives. n is always the number of limbs.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// r = a + b, returns the carry out
+inline BigLimb big_add(BigLimb* r, const BigLimb* a, const BigLimb* b, uint16_t n) {
+	BigLimb carry = 0;
+	for (uint16_t i = 0; i < n; ++i) {
+		BigDLimb sum = (BigDLimb)a[i] + b[i] + carry;
+		r[i] = (BigLimb)sum;
+		carry = sum >> BigLimbBits;
+	}
+	return carry;
+}
+
+// r = a - b, returns the borrow out
+inline BigLimb big_sub(BigLimb* r, const BigLimb* a, const BigLimb* b, uint16_t n) {
+	BigLimb borrow = 0;
+	for (uint16_t i = 0; i < n; ++i) {
+		BigDLimb diff = (BigDLimb)a[i] - b[i] - borrow;
+		r[i] = (BigLimb)diff;
+		borrow = (diff >> BigLimbBits) & 1;
+	}
+	return borrow;
+}
+
+// adds carry into r, returns the carry out of the top
+inline BigLimb big_add_limb(BigLimb* r, BigLimb carry, uint16_t n) {
+	for (uint16_t i = 0; carry && i < n; ++i) {
+		r[i] += carry;
+		carry = r[i] < carry;
+	}
+	return carry;
+}
+
+// -1, 0 or 1 as a is less than, equal to, or greater than b
+inline int8_t big_cmp(const BigLimb* a, const BigLimb* b, uint16_t n) {
+	for (uint16_t i = n; i-- > 0; ) {
+		if (a[i] != b[i])
+			return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+// r[2n] = a[n] * b[n], r must not overlap a or b
+inline void big_mul_schoolbook(BigLimb* r, const BigLimb* a, const BigLimb* b, uint16_t n) {
+	memset(r, 0, 2 * n * sizeof(BigLimb));
+	for (uint16_t i = 0; i < n; ++i) {
+		BigLimb carry = 0;
+		BigDLimb ai = a[i];
+		for (uint16_t j = 0; j < n; ++j) {
+			BigDLimb t = ai * b[j] + r[i+j] + carry;
+			r[i+j] = (BigLimb)t;
+			carry = t >> BigLimbBits;
+		}
+		r[i+n] = carry;
+	}
+}
+
+// number of scratch limbs big_mul needs for n limb operands
+constexpr uint16_t big_mul_scratch(uint16_t n) {
+	return (n < BIGNUM_KARATSUBA_LIMBS || (n & 1)) ? 0 : 2*n + 1 + big_mul_scratch(n / 2);
+}
+
+//
+// big_mul
+// r[2n] = a[n] * b[n] with Karatsuba: (a1 B + a0)(b1 B + b0) needs only the
+// three half size products a0 b0, a1 b1 and (a0 + a1)(b0 + b1).
+//
+inline void big_mul(BigLimb* r, const BigLimb* a, const BigLimb* b, uint16_t n, BigLimb* scratch) {
+	if (n < BIGNUM_KARATSUBA_LIMBS || (n & 1)) {
+		big_mul_schoolbook(r, a, b, n);
+		return;
+	}
+
+	uint16_t h = n / 2;
+	BigLimb* sa = scratch;
+	BigLimb* sb = sa + h;
+	BigLimb* mid = sb + h;       // 2h + 1 limbs
+	BigLimb* next = mid + 2*h + 1;
+
+	// z0 and z2 go straight into the low and high halves of r
+	big_mul(r, a, b, h, next);
+	big_mul(r + n, a + h, b + h, h, next);
+
+	// z1 = (a0 + a1)(b0 + b1), with the carries out of the sums fixed up
+	BigLimb ca = big_add(sa, a, a + h, h);
+	BigLimb cb = big_add(sb, b, b + h, h);
+	big_mul(mid, sa, sb, h, next);
+	mid[2*h] = ca & cb;
+	if (ca)
+		mid[2*h] += big_add(mid + h, mid + h, sb, h);
+	if (cb)
+		mid[2*h] += big_add(mid + h, mid + h, sa, h);
+
+	// middle term is z1 - z0 - z2, added in at B^h
+	BigLimb borrow = big_sub(mid, mid, r, 2*h);
+	borrow += big_sub(mid, mid, r + n, 2*h);
+	mid[2*h] -= borrow;
+
+	BigLimb carry = big_add(r + h, r + h, mid, 2*h + 1);
+	big_add_limb(r + 3*h + 1, carry, h - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// BigNum<Bits>: a fixed width unsigned integer. Bits must be a multiple of
+// the limb size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template <uint16_t Bits>
+class BigNum {
+public:
+	static const uint16_t Limbs = Bits / BigLimbBits;
+	static const uint16_t Bytes = Bits / 8;
+
+	BigNum() { clear(); }
+	explicit BigNum(uint32_t v) { clear(); set_low_uint32(v); }
+
+	void clear() { memset(Limb, 0, sizeof(Limb)); }
+
+	// big endian bytes, the way they go over the wire
+	void from_bytes(const uint8_t* bytes) {
+		clear();
+		for (uint16_t i = 0; i < Bytes; ++i) {
+			uint16_t bit = (Bytes - 1 - i) * 8;
+			Limb[bit / BigLimbBits] |= (BigLimb)bytes[i] << (bit % BigLimbBits);
+		}
+	}
+	void to_bytes(uint8_t* bytes) const {
+		for (uint16_t i = 0; i < Bytes; ++i)
+			bytes[i] = byte(i);
+	}
+
+	// i'th byte of the big endian encoding
+	uint8_t byte(uint16_t i) const {
+		uint16_t bit = (Bytes - 1 - i) * 8;
+		return Limb[bit / BigLimbBits] >> (bit % BigLimbBits);
+	}
+
+	// same as from_bytes, for constants kept in flash
+	void from_progmem(const uint8_t* bytes) {
+		clear();
+		for (uint16_t i = 0; i < Bytes; ++i) {
+			uint16_t bit = (Bytes - 1 - i) * 8;
+			Limb[bit / BigLimbBits] |= (BigLimb)pgm_read_byte(&bytes[i]) << (bit % BigLimbBits);
+		}
+	}
+
+	void set_low_uint32(uint32_t v) {
+		for (uint8_t b = 0; b < 32 && b < Bits; b += BigLimbBits)
+			Limb[b / BigLimbBits] = (BigLimb)(v >> b);
+	}
+	uint32_t low_uint32() const {
+		uint32_t v = 0;
+		for (uint8_t b = 0; b < 32 && b < Bits; b += BigLimbBits)
+			v |= (uint32_t)Limb[b / BigLimbBits] << b;
+		return v;
+	}
+
+	// xor of all of the 32 bit words, for squeezing a big secret into a seed
+	uint32_t fold_uint32() const {
+		uint32_t v = 0;
+		for (uint16_t i = 0; i < Limbs; ++i)
+			v ^= (uint32_t)Limb[i] << ((i * BigLimbBits) % 32);
+		return v;
+	}
+
+	bool bit(uint16_t i) const { return (Limb[i / BigLimbBits] >> (i % BigLimbBits)) & 1; }
+
+	// index of the highest set bit + 1, 0 for zero
+	uint16_t bit_length() const {
+		for (uint16_t i = Limbs; i-- > 0; ) {
+			if (Limb[i]) {
+				uint16_t len = i * BigLimbBits;
+				for (BigLimb v = Limb[i]; v; v >>= 1)
+					++len;
+				return len;
+			}
+		}
+		return 0;
+	}
+
+	bool is_zero() const { return bit_length() == 0; }
+
+	bool operator==(const BigNum& o) const { return big_cmp(Limb, o.Limb, Limbs) == 0; }
+	bool operator!=(const BigNum& o) const { return !(*this == o); }
+	bool operator<(const BigNum& o) const { return big_cmp(Limb, o.Limb, Limbs) < 0; }
+
+	BigLimb Limb[Limbs];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Montgomery arithmetic over a BigNum modulus, the big brother of
+// MontgomeryMod in ModArith.h with R = 2^Bits. Products are formed with
+// big_mul (so Karatsuba where it pays) and then reduced a limb at a time.
+// The modulus must be odd and have its top bit set.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template <uint16_t Bits>
+class BigMontgomery {
+public:
+	typedef BigNum<Bits> Num;
+	static const uint16_t Limbs = Num::Limbs;
+
+	BigMontgomery(): NPrime(0) {}
+	explicit BigMontgomery(const Num& mod) { set_modulus(mod); }
+
+	void set_modulus(const Num& mod) {
+		Modulus = mod;
+
+		// -n^-1 mod 2^limb bits, from Newton iteration on the low limb
+		uint32_t n0 = mod.Limb[0];
+		uint32_t inv = n0;
+		for (uint8_t i = 0; i < 5; ++i)
+			inv *= 2 - n0*inv;
+		NPrime = (BigLimb)(0 - inv);
+
+		// R^2 mod n by doubling 1 up 2*Bits times, only done once per group
+		Num r(1);
+		for (uint16_t i = 0; i < 2*Bits; ++i) {
+			BigLimb carry = big_add(r.Limb, r.Limb, r.Limb, Limbs);
+			if (carry || big_cmp(r.Limb, Modulus.Limb, Limbs) >= 0)
+				big_sub(r.Limb, r.Limb, Modulus.Limb, Limbs);
+		}
+		R2 = r;
+
+		BigLimb t[2*Limbs];
+		memset(t, 0, sizeof(t));
+		memcpy(t, R2.Limb, sizeof(R2.Limb));
+		redc(One, t);
+	}
+
+	const Num& modulus() const { return Modulus; }
+
+	// 1 in the Montgomery domain
+	const Num& one() const { return One; }
+
+	void to_domain(Num& r, const Num& a) const { mul(r, a, R2); }
+
+	void from_domain(Num& r, const Num& a) const {
+		BigLimb t[2*Limbs];
+		memset(t, 0, sizeof(t));
+		memcpy(t, a.Limb, sizeof(a.Limb));
+		redc(r, t);
+	}
+
+	// r = a*b*R^-1, r may alias a or b
+	void mul(Num& r, const Num& a, const Num& b) const {
+		BigLimb t[2*Limbs];
+		BigLimb scratch[big_mul_scratch(Limbs) + 1];
+		big_mul(t, a.Limb, b.Limb, Limbs, scratch);
+		redc(r, t);
+	}
+
+private:
+	// r = t*R^-1 mod n, destroys t
+	void redc(Num& r, BigLimb* t) const {
+		BigLimb top = 0;
+		for (uint16_t i = 0; i < Limbs; ++i) {
+			BigLimb m = t[i] * NPrime;
+			BigLimb carry = 0;
+			for (uint16_t j = 0; j < Limbs; ++j) {
+				BigDLimb s = (BigDLimb)m * Modulus.Limb[j] + t[i+j] + carry;
+				t[i+j] = (BigLimb)s;
+				carry = s >> BigLimbBits;
+			}
+			top += big_add_limb(t + i + Limbs, carry, Limbs - i);
+		}
+		memcpy(r.Limb, t + Limbs, sizeof(r.Limb));
+		if (top || big_cmp(r.Limb, Modulus.Limb, Limbs) >= 0)
+			big_sub(r.Limb, r.Limb, Modulus.Limb, Limbs);
+	}
+
+	Num Modulus;
+	Num R2;
+	Num One;
+	BigLimb NPrime;
+};
+
+//
+// pow_mod
+// Sliding window exponentiation for BigNums, the same scan as pow_mod_window
+// in ModArith.h. The exponent can be narrower than the modulus, short
+// exponents are the usual way to keep big group handshakes affordable.
+//
+template <uint16_t Bits, uint16_t ExpBits>
+BigNum<Bits> pow_mod(const BigNum<Bits>& base, const BigNum<ExpBits>& exponent,
+                     const BigMontgomery<Bits>& mont) {
+	typedef BigNum<Bits> Num;
+	const uint8_t Window = BIGNUM_WINDOW;
+
+	int16_t place = (int16_t)exponent.bit_length() - 1;
+	Num result = mont.one();
+	if (place < 0) {
+		mont.from_domain(result, result);
+		return result;
+	}
+
+	// odd powers of the base: table[i] = base^(2i+1)
+	Num table[1 << (Window - 1)];
+	mont.to_domain(table[0], base);
+	if (Window > 1) {
+		Num square;
+		mont.mul(square, table[0], table[0]);
+		for (uint8_t i = 1; i < (1 << (Window - 1)); ++i)
+			mont.mul(table[i], table[i-1], square);
+	}
+
+	bool started = false;
+	while (place >= 0) {
+		if (!exponent.bit(place)) {
+			mont.mul(result, result, result);
+			--place;
+			continue;
+		}
+
+		int16_t low = place - Window + 1;
+		if (low < 0)
+			low = 0;
+		while (!exponent.bit(low))
+			++low;
+		uint8_t value = 0;
+		for (int16_t i = place; i >= low; --i)
+			value = (value << 1) | exponent.bit(i);
+
+		if (started) {
+			for (int16_t i = low; i <= place; ++i)
+				mont.mul(result, result, result);
+			mont.mul(result, result, table[value >> 1]);
+		} else {
+			result = table[value >> 1];
+			started = true;
+		}
+		place = low - 1;
+	}
+	mont.from_domain(result, result);
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Well known groups, the MODP primes from RFC 2409 (1024 bit) and RFC 3526
+// (1536 and 2048 bit). All are safe primes with generator 2. Over the wire a
+// group is named by its bit size / 256, so the prime itself never has to be
+// sent.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const uint8_t ModpGenerator = 2;
+
+const uint8_t Modp1024Prime[128] PROGMEM = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2, 0x21, 0x68, 0xC2, 0x34,
+	0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1, 0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74,
+	0x02, 0x0B, 0xBE, 0xA6, 0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
+	0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D, 0xF2, 0x5F, 0x14, 0x37,
+	0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45, 0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6,
+	0xF4, 0x4C, 0x42, 0xE9, 0xA6, 0x37, 0xED, 0x6B, 0x0B, 0xFF, 0x5C, 0xB6, 0xF4, 0x06, 0xB7, 0xED,
+	0xEE, 0x38, 0x6B, 0xFB, 0x5A, 0x89, 0x9F, 0xA5, 0xAE, 0x9F, 0x24, 0x11, 0x7C, 0x4B, 0x1F, 0xE6,
+	0x49, 0x28, 0x66, 0x51, 0xEC, 0xE6, 0x53, 0x81, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+const uint8_t Modp1536Prime[192] PROGMEM = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2, 0x21, 0x68, 0xC2, 0x34,
+	0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1, 0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74,
+	0x02, 0x0B, 0xBE, 0xA6, 0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
+	0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D, 0xF2, 0x5F, 0x14, 0x37,
+	0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45, 0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6,
+	0xF4, 0x4C, 0x42, 0xE9, 0xA6, 0x37, 0xED, 0x6B, 0x0B, 0xFF, 0x5C, 0xB6, 0xF4, 0x06, 0xB7, 0xED,
+	0xEE, 0x38, 0x6B, 0xFB, 0x5A, 0x89, 0x9F, 0xA5, 0xAE, 0x9F, 0x24, 0x11, 0x7C, 0x4B, 0x1F, 0xE6,
+	0x49, 0x28, 0x66, 0x51, 0xEC, 0xE4, 0x5B, 0x3D, 0xC2, 0x00, 0x7C, 0xB8, 0xA1, 0x63, 0xBF, 0x05,
+	0x98, 0xDA, 0x48, 0x36, 0x1C, 0x55, 0xD3, 0x9A, 0x69, 0x16, 0x3F, 0xA8, 0xFD, 0x24, 0xCF, 0x5F,
+	0x83, 0x65, 0x5D, 0x23, 0xDC, 0xA3, 0xAD, 0x96, 0x1C, 0x62, 0xF3, 0x56, 0x20, 0x85, 0x52, 0xBB,
+	0x9E, 0xD5, 0x29, 0x07, 0x70, 0x96, 0x96, 0x6D, 0x67, 0x0C, 0x35, 0x4E, 0x4A, 0xBC, 0x98, 0x04,
+	0xF1, 0x74, 0x6C, 0x08, 0xCA, 0x23, 0x73, 0x27, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+const uint8_t Modp2048Prime[256] PROGMEM = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2, 0x21, 0x68, 0xC2, 0x34,
+	0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1, 0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74,
+	0x02, 0x0B, 0xBE, 0xA6, 0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
+	0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D, 0xF2, 0x5F, 0x14, 0x37,
+	0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45, 0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6,
+	0xF4, 0x4C, 0x42, 0xE9, 0xA6, 0x37, 0xED, 0x6B, 0x0B, 0xFF, 0x5C, 0xB6, 0xF4, 0x06, 0xB7, 0xED,
+	0xEE, 0x38, 0x6B, 0xFB, 0x5A, 0x89, 0x9F, 0xA5, 0xAE, 0x9F, 0x24, 0x11, 0x7C, 0x4B, 0x1F, 0xE6,
+	0x49, 0x28, 0x66, 0x51, 0xEC, 0xE4, 0x5B, 0x3D, 0xC2, 0x00, 0x7C, 0xB8, 0xA1, 0x63, 0xBF, 0x05,
+	0x98, 0xDA, 0x48, 0x36, 0x1C, 0x55, 0xD3, 0x9A, 0x69, 0x16, 0x3F, 0xA8, 0xFD, 0x24, 0xCF, 0x5F,
+	0x83, 0x65, 0x5D, 0x23, 0xDC, 0xA3, 0xAD, 0x96, 0x1C, 0x62, 0xF3, 0x56, 0x20, 0x85, 0x52, 0xBB,
+	0x9E, 0xD5, 0x29, 0x07, 0x70, 0x96, 0x96, 0x6D, 0x67, 0x0C, 0x35, 0x4E, 0x4A, 0xBC, 0x98, 0x04,
+	0xF1, 0x74, 0x6C, 0x08, 0xCA, 0x18, 0x21, 0x7C, 0x32, 0x90, 0x5E, 0x46, 0x2E, 0x36, 0xCE, 0x3B,
+	0xE3, 0x9E, 0x77, 0x2C, 0x18, 0x0E, 0x86, 0x03, 0x9B, 0x27, 0x83, 0xA2, 0xEC, 0x07, 0xA2, 0x8F,
+	0xB5, 0xC5, 0x5D, 0xF0, 0x6F, 0x4C, 0x52, 0xC9, 0xDE, 0x2B, 0xCB, 0xF6, 0x95, 0x58, 0x17, 0x18,
+	0x39, 0x95, 0x49, 0x7C, 0xEA, 0x95, 0x6A, 0xE5, 0x15, 0xD2, 0x26, 0x18, 0x98, 0xFA, 0x05, 0x10,
+	0x15, 0x72, 0x8E, 0x5A, 0x8A, 0xAC, 0xAA, 0x68, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// the wire id of the group with the given prime size
+inline uint8_t modp_group_id(uint16_t bits) {
+	return bits / 256;
+}
+
+// the prime of the group with the given size, 0 if there isn't one
+inline const uint8_t* modp_prime(uint16_t bits) {
+	switch (bits) {
+	case 1024: return Modp1024Prime;
+	case 1536: return Modp1536Prime;
+	case 2048: return Modp2048Prime;
+	default: return 0;
+	}
+}
+
+#endif
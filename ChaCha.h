@@ -0,0 +1,328 @@
+#ifndef CHACHA_H
+#define CHACHA_H
+
+#include "stdint.h"
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// ChaCha stream cipher (RFC 8439 block function), as a keystream generator
+// with the same seed / next_uint32 / discard as the others in KeystreamGen.h.
+// Rounds is 20 for ChaCha20, or 8 / 12 for the reduced round versions.
+//
+// The 256 bit key is set with set_key(), and seed() sets the nonce and goes
+// back to the start of the keystream, so reseeding with the same value to
+// seek backwards keeps the key. The words come out in the order of the
+// RFC's serialised keystream, so taken low byte first they are the
+// standard ChaCha keystream bytes. The block counter is word 12 and the
+// seed is word 13, with the rest of the nonce 0.
+//
+// discard() is just moving the position along; the block it lands in is
+// worked out when it's needed.
+//
+// On the AVR the rotates by 16 and 8 are whole byte moves, and 12 and 7 are
+// done as a byte move and a shift by 4 or 1, rather than the 12 or 7 single
+// bit shifts of all four bytes that the compiler would otherwise do.
+//
+// fill(out, n) gives the same words as n calls to next_uint32(). On x86 the
+// whole blocks are made 4 at a time with SSE2 or 8 at a time with AVX2, a
+// block per lane, picked at runtime from what the CPU supports.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+enum ChaChaKernel {
+	ChaChaScalar,
+	ChaChaSse2,
+	ChaChaAvx2,
+};
+
+inline const char* chacha_kernel_name(ChaChaKernel kernel) {
+	switch (kernel) {
+	case ChaChaAvx2: return "avx2";
+	case ChaChaSse2: return "sse2";
+	default: return "scalar";
+	}
+}
+
+#if defined(__AVR__)
+// byte moves are free, bit shifts are 4 instructions a bit
+inline uint32_t chacha_rotl8(uint32_t x) {
+	return (x << 8) | (x >> 24);
+}
+
+inline uint32_t chacha_rotl16(uint32_t x) {
+	return (x << 16) | (x >> 16);
+}
+
+inline uint32_t chacha_rotl12(uint32_t x) {
+	x = chacha_rotl8(x);
+	return (x << 4) | (x >> 28);
+}
+
+inline uint32_t chacha_rotl7(uint32_t x) {
+	x = chacha_rotl8(x);
+	return (x >> 1) | (x << 31);
+}
+#else
+inline uint32_t chacha_rotl8(uint32_t x) { return (x << 8) | (x >> 24); }
+inline uint32_t chacha_rotl16(uint32_t x) { return (x << 16) | (x >> 16); }
+inline uint32_t chacha_rotl12(uint32_t x) { return (x << 12) | (x >> 20); }
+inline uint32_t chacha_rotl7(uint32_t x) { return (x << 7) | (x >> 25); }
+#endif
+
+inline void chacha_quarter_round(uint32_t* x, uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+	x[a] += x[b]; x[d] = chacha_rotl16(x[d] ^ x[a]);
+	x[c] += x[d]; x[b] = chacha_rotl12(x[b] ^ x[c]);
+	x[a] += x[b]; x[d] = chacha_rotl8(x[d] ^ x[a]);
+	x[c] += x[d]; x[b] = chacha_rotl7(x[b] ^ x[c]);
+}
+
+// one block of keystream from the input state in, with counter as word 12
+template <uint8_t Rounds>
+inline void chacha_block(const uint32_t* in, uint32_t counter, uint32_t* out) {
+	for (uint8_t i = 0; i < 16; ++i)
+		out[i] = in[i];
+	out[12] = counter;
+	for (uint8_t r = 0; r < Rounds; r += 2) {
+		chacha_quarter_round(out, 0, 4, 8, 12);
+		chacha_quarter_round(out, 1, 5, 9, 13);
+		chacha_quarter_round(out, 2, 6, 10, 14);
+		chacha_quarter_round(out, 3, 7, 11, 15);
+		chacha_quarter_round(out, 0, 5, 10, 15);
+		chacha_quarter_round(out, 1, 6, 11, 12);
+		chacha_quarter_round(out, 2, 7, 8, 13);
+		chacha_quarter_round(out, 3, 4, 9, 14);
+	}
+	for (uint8_t i = 0; i < 16; ++i)
+		out[i] += in[i];
+	out[12] += counter;
+}
+
+template <uint8_t Rounds>
+inline void chacha_blocks_scalar(const uint32_t* in, uint32_t counter, uint32_t* out, size_t blocks) {
+	for (; blocks > 0; --blocks, ++counter, out += 16)
+		chacha_block<Rounds>(in, counter, out);
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHACHA_SIMD 1
+#include <immintrin.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The vector kernels run a block per lane: vector i holds word i of 4 (or 8)
+// consecutive blocks, which differ only in the counter, so the rounds are the
+// scalar ones with each word op done on every lane at once. At the end each
+// group of 4 words is transposed back to a block per row with unpacks. AVX2's
+// unpacks work within each 128 bit half, so its low half comes out as blocks
+// 0-3 and its high half as blocks 4-7.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define CHACHA_QR_SSE2(a, b, c, d) \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); \
+	d = _mm_shufflehi_epi16(_mm_shufflelo_epi16(d, 0xB1), 0xB1); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); \
+	b = _mm_or_si128(_mm_slli_epi32(b, 12), _mm_srli_epi32(b, 20)); \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); \
+	d = _mm_or_si128(_mm_slli_epi32(d, 8), _mm_srli_epi32(d, 24)); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); \
+	b = _mm_or_si128(_mm_slli_epi32(b, 7), _mm_srli_epi32(b, 25));
+
+template <uint8_t Rounds>
+__attribute__((target("sse2")))
+inline void chacha_blocks_sse2(const uint32_t* in, uint32_t counter, uint32_t* out, size_t blocks) {
+	for (; blocks >= 4; blocks -= 4, counter += 4, out += 64) {
+		__m128i s[16], x[16];
+		for (uint8_t i = 0; i < 16; ++i)
+			s[i] = _mm_set1_epi32(in[i]);
+		s[12] = _mm_add_epi32(_mm_set1_epi32(counter), _mm_set_epi32(3, 2, 1, 0));
+		for (uint8_t i = 0; i < 16; ++i)
+			x[i] = s[i];
+		for (uint8_t r = 0; r < Rounds; r += 2) {
+			CHACHA_QR_SSE2(x[0], x[4], x[8], x[12])
+			CHACHA_QR_SSE2(x[1], x[5], x[9], x[13])
+			CHACHA_QR_SSE2(x[2], x[6], x[10], x[14])
+			CHACHA_QR_SSE2(x[3], x[7], x[11], x[15])
+			CHACHA_QR_SSE2(x[0], x[5], x[10], x[15])
+			CHACHA_QR_SSE2(x[1], x[6], x[11], x[12])
+			CHACHA_QR_SSE2(x[2], x[7], x[8], x[13])
+			CHACHA_QR_SSE2(x[3], x[4], x[9], x[14])
+		}
+		for (uint8_t g = 0; g < 16; g += 4) {
+			__m128i a = _mm_add_epi32(x[g], s[g]);
+			__m128i b = _mm_add_epi32(x[g+1], s[g+1]);
+			__m128i c = _mm_add_epi32(x[g+2], s[g+2]);
+			__m128i d = _mm_add_epi32(x[g+3], s[g+3]);
+			__m128i ab0 = _mm_unpacklo_epi32(a, b), cd0 = _mm_unpacklo_epi32(c, d);
+			__m128i ab1 = _mm_unpackhi_epi32(a, b), cd1 = _mm_unpackhi_epi32(c, d);
+			_mm_storeu_si128((__m128i*)(out + g), _mm_unpacklo_epi64(ab0, cd0));
+			_mm_storeu_si128((__m128i*)(out + 16 + g), _mm_unpackhi_epi64(ab0, cd0));
+			_mm_storeu_si128((__m128i*)(out + 32 + g), _mm_unpacklo_epi64(ab1, cd1));
+			_mm_storeu_si128((__m128i*)(out + 48 + g), _mm_unpackhi_epi64(ab1, cd1));
+		}
+	}
+	chacha_blocks_scalar<Rounds>(in, counter, out, blocks);
+}
+
+#define CHACHA_QR_AVX2(a, b, c, d) \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); \
+	b = _mm256_or_si256(_mm256_slli_epi32(b, 12), _mm256_srli_epi32(b, 20)); \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); \
+	b = _mm256_or_si256(_mm256_slli_epi32(b, 7), _mm256_srli_epi32(b, 25));
+
+template <uint8_t Rounds>
+__attribute__((target("avx2")))
+inline void chacha_blocks_avx2(const uint32_t* in, uint32_t counter, uint32_t* out, size_t blocks) {
+	// byte shuffles for the rotates by 16 and 8
+	const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+		2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+	const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+		3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+	for (; blocks >= 8; blocks -= 8, counter += 8, out += 128) {
+		__m256i s[16], x[16];
+		for (uint8_t i = 0; i < 16; ++i)
+			s[i] = _mm256_set1_epi32(in[i]);
+		s[12] = _mm256_add_epi32(_mm256_set1_epi32(counter), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		for (uint8_t i = 0; i < 16; ++i)
+			x[i] = s[i];
+		for (uint8_t r = 0; r < Rounds; r += 2) {
+			CHACHA_QR_AVX2(x[0], x[4], x[8], x[12])
+			CHACHA_QR_AVX2(x[1], x[5], x[9], x[13])
+			CHACHA_QR_AVX2(x[2], x[6], x[10], x[14])
+			CHACHA_QR_AVX2(x[3], x[7], x[11], x[15])
+			CHACHA_QR_AVX2(x[0], x[5], x[10], x[15])
+			CHACHA_QR_AVX2(x[1], x[6], x[11], x[12])
+			CHACHA_QR_AVX2(x[2], x[7], x[8], x[13])
+			CHACHA_QR_AVX2(x[3], x[4], x[9], x[14])
+		}
+		for (uint8_t g = 0; g < 16; g += 4) {
+			__m256i a = _mm256_add_epi32(x[g], s[g]);
+			__m256i b = _mm256_add_epi32(x[g+1], s[g+1]);
+			__m256i c = _mm256_add_epi32(x[g+2], s[g+2]);
+			__m256i d = _mm256_add_epi32(x[g+3], s[g+3]);
+			__m256i ab0 = _mm256_unpacklo_epi32(a, b), cd0 = _mm256_unpacklo_epi32(c, d);
+			__m256i ab1 = _mm256_unpackhi_epi32(a, b), cd1 = _mm256_unpackhi_epi32(c, d);
+			__m256i r0 = _mm256_unpacklo_epi64(ab0, cd0), r1 = _mm256_unpackhi_epi64(ab0, cd0);
+			__m256i r2 = _mm256_unpacklo_epi64(ab1, cd1), r3 = _mm256_unpackhi_epi64(ab1, cd1);
+			_mm_storeu_si128((__m128i*)(out + g), _mm256_castsi256_si128(r0));
+			_mm_storeu_si128((__m128i*)(out + 16 + g), _mm256_castsi256_si128(r1));
+			_mm_storeu_si128((__m128i*)(out + 32 + g), _mm256_castsi256_si128(r2));
+			_mm_storeu_si128((__m128i*)(out + 48 + g), _mm256_castsi256_si128(r3));
+			_mm_storeu_si128((__m128i*)(out + 64 + g), _mm256_extracti128_si256(r0, 1));
+			_mm_storeu_si128((__m128i*)(out + 80 + g), _mm256_extracti128_si256(r1, 1));
+			_mm_storeu_si128((__m128i*)(out + 96 + g), _mm256_extracti128_si256(r2, 1));
+			_mm_storeu_si128((__m128i*)(out + 112 + g), _mm256_extracti128_si256(r3, 1));
+		}
+	}
+	chacha_blocks_sse2<Rounds>(in, counter, out, blocks);
+}
+
+#undef CHACHA_QR_SSE2
+#undef CHACHA_QR_AVX2
+
+#else
+#define CHACHA_SIMD 0
+#endif
+
+// best kernel this CPU can run
+inline ChaChaKernel chacha_kernel() {
+#if CHACHA_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return ChaChaAvx2;
+	if (__builtin_cpu_supports("sse2"))
+		return ChaChaSse2;
+#endif
+	return ChaChaScalar;
+}
+
+template <uint8_t Rounds>
+inline void chacha_blocks(ChaChaKernel kernel, const uint32_t* in, uint32_t counter, uint32_t* out, size_t blocks) {
+#if CHACHA_SIMD
+	if (kernel == ChaChaAvx2)
+		return chacha_blocks_avx2<Rounds>(in, counter, out, blocks);
+	if (kernel == ChaChaSse2)
+		return chacha_blocks_sse2<Rounds>(in, counter, out, blocks);
+#endif
+	chacha_blocks_scalar<Rounds>(in, counter, out, blocks);
+}
+
+template <uint8_t Rounds>
+class ChaCha {
+public:
+	ChaCha() {
+		In[0] = 0x61707865; // "expand 32-byte k"
+		In[1] = 0x3320646E;
+		In[2] = 0x79622D32;
+		In[3] = 0x6B206574;
+		uint8_t key[32] = {0};
+		set_key(key);
+		seed(0xDEADB08F);
+	}
+	//
+	void set_key(const uint8_t* key) {
+		for (uint8_t i = 0; i < 8; ++i)
+			In[4+i] = (uint32_t)key[4*i] | ((uint32_t)key[4*i+1] << 8) |
+			          ((uint32_t)key[4*i+2] << 16) | ((uint32_t)key[4*i+3] << 24);
+		Block = NoBlock;
+	}
+	//
+	void seed(uint32_t seed) {
+		In[12] = 0;
+		In[13] = seed;
+		In[14] = 0;
+		In[15] = 0;
+		Word = 0;
+		Block = NoBlock;
+	}
+	//
+	uint32_t next_uint32() {
+		uint32_t block = Word >> 4;
+		if (block != Block) {
+			chacha_block<Rounds>(In, block, Out);
+			Block = block;
+		}
+		return Out[Word++ & 15];
+	}
+	//
+	void discard(uint32_t n) {
+		Word += n;
+	}
+
+	// the next n words, same as calling next_uint32() n times
+	void fill(uint32_t* out, size_t n) {
+		static const ChaChaKernel kernel = chacha_kernel();
+		fill_with(kernel, out, n);
+	}
+
+	// fill with the kernel given explicitly (for the benchmark and tests).
+	// Asking for a kernel the CPU can't run is the caller's problem.
+	void fill_with(ChaChaKernel kernel, uint32_t* out, size_t n) {
+		// the rest of the block we're part way through
+		for (; n > 0 && (Word & 15) != 0; --n)
+			*out++ = next_uint32();
+		size_t blocks = n / 16;
+		chacha_blocks<Rounds>(kernel, In, Word >> 4, out, blocks);
+		Word += blocks * 16;
+		out += blocks * 16;
+		n -= blocks * 16;
+		for (; n > 0; --n)
+			*out++ = next_uint32();
+	}
+
+private:
+	static const uint32_t NoBlock = 0xFFFFFFFF;
+
+	uint32_t In[16];  // constants, key, counter (0 here), nonce
+	uint32_t Out[16]; // keystream block number Block
+	uint32_t Word;    // position in the keystream, in words
+	uint32_t Block;
+};
+
+typedef ChaCha<20> ChaCha20;
+typedef ChaCha<12> ChaCha12;
+typedef ChaCha<8> ChaCha8;
+
+#endif
@@ -0,0 +1,427 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include "stdint.h"
+#include "ModArith.h"
+#include "BigNum.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Generates Diffie-Hellman parameters: safe primes p = 2q + 1 (q prime) of
+// a given bit size, each with the smallest generator of the whole group.
+// Build and run with:
+//   g++ -O2 -pthread DHParamGen.cpp -o DHParamGen
+//   ./DHParamGen [--count N] [--threads T] [--seed S] 32 64 1024 > DHParams.h
+// Supported sizes are 32, 64, 128, 256, 512, 1024, 1536 and 2048 bits.
+//
+// The search starts from a random odd q0 and walks q = q0 + 2k in segments.
+// Worker threads claim segments from a shared counter and sieve each one
+// with the primes below SieveBound, knocking out every k where either q or
+// 2q + 1 has a small factor. That leaves about 1 in 150 candidates for a
+// 1024 bit search, and only those get Miller-Rabin (built on the BigNum
+// pow_mod): one round on q, one on p, and then the full count on both.
+// Composites nearly always fail that first round, so a 1024 bit safe prime
+// takes seconds rather than minutes.
+//
+// For a safe prime the group order is 2q, so g generates the whole group
+// exactly when g^2 != 1 and g^q != 1, and g^2 = 1 only for g = +-1.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const uint32_t SieveBound = 1 << 18;
+const uint32_t SegmentLen = 1 << 16;
+
+std::vector<uint32_t> SmallPrimes;
+
+// odd primes below SieveBound, with a plain sieve of Eratosthenes
+void make_small_primes() {
+	std::vector<bool> composite(SieveBound, false);
+	for (uint32_t i = 3; i < SieveBound; i += 2) {
+		if (composite[i])
+			continue;
+		SmallPrimes.push_back(i);
+		for (uint64_t j = (uint64_t)i * i; j < SieveBound; j += 2 * i)
+			composite[j] = true;
+	}
+}
+
+double now_s() {
+	return std::chrono::duration_cast<std::chrono::duration<double> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// BigNum helpers the generator needs beyond BigNum.h
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// n mod r for a small r, Horner's rule a limb at a time from the top
+template <uint16_t Bits>
+uint32_t big_mod_small(const BigNum<Bits>& n, uint32_t r) {
+	uint64_t rem = 0;
+	for (uint16_t i = BigNum<Bits>::Limbs; i-- > 0; )
+		rem = ((rem << BigLimbBits) | n.Limb[i]) % r;
+	return rem;
+}
+
+// n += v
+template <uint16_t Bits>
+void big_add_uint32(BigNum<Bits>& n, uint32_t v) {
+	BigNum<Bits> add(v);
+	big_add(n.Limb, n.Limb, add.Limb, BigNum<Bits>::Limbs);
+}
+
+// n >>= shift, for shift < the limb size
+template <uint16_t Bits>
+void big_shift_right(BigNum<Bits>& n, uint8_t shift) {
+	if (!shift)
+		return;
+	for (uint16_t i = 0; i < BigNum<Bits>::Limbs; ++i) {
+		BigLimb hi = (i + 1 < BigNum<Bits>::Limbs) ? n.Limb[i+1] : 0;
+		n.Limb[i] = (n.Limb[i] >> shift) | (BigLimb)(hi << (BigLimbBits - shift));
+	}
+}
+
+// uniform-ish random number below 2^bits
+template <uint16_t Bits>
+void big_random(BigNum<Bits>& n, std::mt19937_64& rng, uint16_t bits) {
+	for (uint16_t i = 0; i < BigNum<Bits>::Limbs; ++i) {
+		uint16_t low = i * BigLimbBits;
+		n.Limb[i] = (low >= bits) ? 0 : (BigLimb)rng();
+		if (low < bits && bits - low < BigLimbBits)
+			n.Limb[i] &= ((BigLimb)1 << (bits - low)) - 1;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Miller-Rabin
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// one round with the given base, n odd and > 3
+template <uint16_t Bits>
+bool miller_rabin_round(const BigMontgomery<Bits>& mont, const BigNum<Bits>& nMinus1,
+                        const BigNum<Bits>& d, uint16_t s, const BigNum<Bits>& base) {
+	typedef BigNum<Bits> Num;
+	Num one(1);
+	Num x = pow_mod(base, d, mont);
+	if (x == one || x == nMinus1)
+		return true;
+
+	// square in the Montgomery domain, comparing against -1 there
+	Num minusOne, xm;
+	mont.to_domain(minusOne, nMinus1);
+	mont.to_domain(xm, x);
+	for (uint16_t i = 1; i < s; ++i) {
+		mont.mul(xm, xm, xm);
+		if (xm == minusOne)
+			return true;
+		if (xm == mont.one())
+			return false;
+	}
+	return false;
+}
+
+//
+// is_probable_prime:
+// rounds of Miller-Rabin on an odd n > 3, with base 2 first. Below 2^64 the
+// first 12 prime bases make the test exact, above that the rest of the bases
+// are random.
+//
+template <uint16_t Bits>
+bool is_probable_prime(const BigNum<Bits>& n, uint8_t rounds, std::mt19937_64& rng) {
+	typedef BigNum<Bits> Num;
+	static const uint8_t ExactBases[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+
+	Num nMinus1 = n;
+	Num one(1);
+	big_sub(nMinus1.Limb, nMinus1.Limb, one.Limb, Num::Limbs);
+	Num d = nMinus1;
+	uint16_t s = 0;
+	while (!d.bit(0)) {
+		big_shift_right(d, 1);
+		++s;
+	}
+
+	BigMontgomery<Bits> mont(n);
+	bool exact = n.bit_length() <= 64;
+	if (exact)
+		rounds = sizeof(ExactBases);
+	for (uint8_t i = 0; i < rounds; ++i) {
+		Num base;
+		if (exact || i == 0) {
+			base = Num(ExactBases[i]);
+			if (!(base < nMinus1))
+				break;
+		} else {
+			// random base in [2, n - 2]
+			do {
+				big_random(base, rng, n.bit_length() - 1);
+			} while (base.bit_length() < 2);
+		}
+		if (!miller_rabin_round(mont, nMinus1, d, s, base))
+			return false;
+	}
+	return true;
+}
+
+// rounds for a random candidate, enough for a 2^-80 chance of a composite
+uint8_t mr_rounds(uint16_t bits) {
+	return bits >= 1024 ? 5 : bits >= 512 ? 8 : bits >= 256 ? 16 : 28;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The search
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template <uint16_t Bits>
+struct Search {
+	typedef BigNum<Bits> Num;
+
+	Num Start;                       // q0, odd
+	std::vector<uint32_t> StartMod;  // q0 mod each small prime
+	uint64_t SegmentCount;           // how far we can walk before p overflows
+
+	std::atomic<uint64_t> NextSegment;
+	std::atomic<bool> Found;
+	std::atomic<uint64_t> Tested;
+	std::mutex Lock;
+	Num Q;
+};
+
+// sieve one segment of k, and test what's left
+template <uint16_t Bits>
+void search_segment(Search<Bits>& search, uint64_t segment, std::mt19937_64& rng,
+                    std::vector<uint8_t>& sieve) {
+	typedef BigNum<Bits> Num;
+	uint64_t firstK = segment * SegmentLen;
+	std::fill(sieve.begin(), sieve.end(), 0);
+
+	for (size_t i = 0; i < SmallPrimes.size(); ++i) {
+		uint32_t r = SmallPrimes[i];
+		// q at k = 0 in this segment, mod r
+		uint32_t q = (search.StartMod[i] + (2 * firstK) % r) % r;
+		uint32_t half = (r + 1) / 2;  // 2^-1 mod r
+		// q + 2k = 0 (q composite), and q + 2k = (r - 1)/2 (p composite)
+		uint32_t k0 = (uint64_t)((r - q) % r) * half % r;
+		uint32_t k1 = (uint64_t)(((r - 1) / 2 + r - q) % r) * half % r;
+		for (uint32_t k = k0; k < SegmentLen; k += r)
+			sieve[k] = 1;
+		for (uint32_t k = k1; k < SegmentLen; k += r)
+			sieve[k] = 1;
+	}
+
+	const uint8_t rounds = mr_rounds(Bits);
+	for (uint32_t k = 0; k < SegmentLen && !search.Found; ++k) {
+		if (sieve[k])
+			continue;
+		Num q = search.Start;
+		big_add_uint32(q, 2 * (firstK + k));
+		Num p;
+		big_add(p.Limb, q.Limb, q.Limb, Num::Limbs);
+		big_add_uint32(p, 1);
+		if (p.bit_length() != Bits)
+			return;
+
+		// cheap single rounds on both first, since nearly every candidate
+		// fails one of those
+		++search.Tested;
+		if (!is_probable_prime(q, 1, rng) || !is_probable_prime(p, 1, rng))
+			continue;
+		if (!is_probable_prime(q, rounds, rng) || !is_probable_prime(p, rounds, rng))
+			continue;
+
+		std::lock_guard<std::mutex> guard(search.Lock);
+		if (!search.Found) {
+			search.Q = q;
+			search.Found = true;
+		}
+		return;
+	}
+}
+
+template <uint16_t Bits>
+void search_worker(Search<Bits>* search, uint64_t seed) {
+	std::mt19937_64 rng(seed);
+	std::vector<uint8_t> sieve(SegmentLen);
+	while (!search->Found) {
+		uint64_t segment = search->NextSegment++;
+		if (segment >= search->SegmentCount)
+			return;
+		search_segment(*search, segment, rng, sieve);
+	}
+}
+
+//
+// find_safe_prime:
+// A safe prime of exactly Bits bits, and its smallest generator.
+//
+template <uint16_t Bits>
+void find_safe_prime(std::mt19937_64& rng, unsigned threads, BigNum<Bits>& p,
+                     uint32_t& generator, uint64_t& tested) {
+	typedef BigNum<Bits> Num;
+	tested = 0;
+	while (true) {
+		Search<Bits> search;
+		// q0 has Bits - 1 bits, so p = 2q + 1 has Bits
+		big_random(search.Start, rng, Bits - 1);
+		search.Start.Limb[(Bits - 2) / BigLimbBits] |= (BigLimb)1 << ((Bits - 2) % BigLimbBits);
+		search.Start.Limb[0] |= 1;
+		for (size_t i = 0; i < SmallPrimes.size(); ++i)
+			search.StartMod.push_back(big_mod_small(search.Start, SmallPrimes[i]));
+
+		// offsets are kept under 2^32, and 32 bit searches run out of room
+		// before then
+		search.SegmentCount = 0x7FFFFFFF / SegmentLen;
+		if (Bits <= 32) {
+			uint64_t room = ((1ull << (Bits - 1)) - search.Start.low_uint32()) / 2;
+			uint64_t segments = room / SegmentLen + 1;
+			if (segments < search.SegmentCount)
+				search.SegmentCount = segments;
+		}
+		search.NextSegment = 0;
+		search.Found = false;
+		search.Tested = 0;
+
+		std::vector<std::thread> pool;
+		for (unsigned i = 0; i < threads; ++i)
+			pool.push_back(std::thread(search_worker<Bits>, &search, rng()));
+		for (unsigned i = 0; i < threads; ++i)
+			pool[i].join();
+		tested += search.Tested;
+		if (!search.Found)
+			continue;
+
+		big_add(p.Limb, search.Q.Limb, search.Q.Limb, Num::Limbs);
+		big_add_uint32(p, 1);
+		BigMontgomery<Bits> mont(p);
+		Num pMinus1 = p;
+		pMinus1.Limb[0] ^= 1;
+		for (generator = 2; ; ++generator) {
+			if (pow_mod(Num(generator), search.Q, mont) == pMinus1)
+				return;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Output
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template <uint16_t Bits>
+void generate(std::mt19937_64& rng, unsigned threads, unsigned count) {
+	typedef BigNum<Bits> Num;
+	std::vector<Num> primes(count);
+	std::vector<uint32_t> generators(count);
+	for (unsigned i = 0; i < count; ++i) {
+		uint64_t tested;
+		double start = now_s();
+		find_safe_prime<Bits>(rng, threads, primes[i], generators[i], tested);
+		std::fprintf(stderr, "%u bit safe prime %u: %.2f s, %llu candidates past the sieve\n",
+		             Bits, i, now_s() - start, (unsigned long long)tested);
+	}
+
+	std::cout << std::hex << std::uppercase << std::setfill('0');
+	if (Bits <= 32) {
+		std::cout << "\nconst DHGroup32 DHGroups" << std::dec << Bits << "[" << count
+		          << "] PROGMEM = {\n";
+		for (unsigned i = 0; i < count; ++i)
+			std::cout << "\t{ 0x" << std::hex << std::setw(8) << primes[i].low_uint32()
+			          << ", " << std::dec << generators[i] << " },\n";
+		std::cout << "};\n";
+		return;
+	}
+
+	for (unsigned i = 0; i < count; ++i) {
+		std::cout << "\n// generator " << std::dec << generators[i] << "\n"
+		          << "const uint8_t DHGroup" << Bits << "Prime" << i << "[" << Num::Bytes
+		          << "] PROGMEM = {";
+		for (uint16_t b = 0; b < Num::Bytes; ++b) {
+			std::cout << ((b % 16 == 0) ? "\n\t" : " ") << "0x" << std::hex << std::setw(2)
+			          << (int)primes[i].byte(b) << ",";
+		}
+		std::cout << "\n};\n";
+	}
+	std::cout << "\nconst DHGroupBig DHGroups" << std::dec << Bits << "[" << count << "] = {\n";
+	for (unsigned i = 0; i < count; ++i)
+		std::cout << "\t{ DHGroup" << Bits << "Prime" << i << ", " << generators[i] << " },\n";
+	std::cout << "};\n";
+}
+
+int usage() {
+	std::cerr << "usage: DHParamGen [--count N] [--threads T] [--seed S] bits...\n"
+	          << "bits: 32 64 128 256 512 1024 1536 2048\n";
+	return 2;
+}
+
+int main(int argc, char** argv) {
+	unsigned count = 4;
+	unsigned threads = std::thread::hardware_concurrency();
+	uint64_t seed = std::random_device()();
+	std::vector<unsigned> sizes;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--count") && i + 1 < argc)
+			count = strtoul(argv[++i], 0, 0);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			threads = strtoul(argv[++i], 0, 0);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+			seed = strtoull(argv[++i], 0, 0);
+		else
+			sizes.push_back(strtoul(argv[i], 0, 0));
+	}
+	if (sizes.empty() || count == 0)
+		return usage();
+	if (threads == 0)
+		threads = 1;
+
+	make_small_primes();
+	std::mt19937_64 rng(seed);
+
+	std::cout << "// Generated by DHParamGen.cpp, do not edit.\n"
+	          << "// Safe primes p = 2q + 1 with q prime, each with the smallest generator\n"
+	          << "// of the whole group (order p - 1). Big primes are big endian bytes, the\n"
+	          << "// same as the MODP primes in BigNum.h.\n\n"
+	          << "#ifndef DHPARAMS_H\n"
+	          << "#define DHPARAMS_H\n\n"
+	          << "#include \"ModArith.h\"\n\n"
+	          << "struct DHGroup32 {\n"
+	          << "\tuint32_t PrimeMod;\n"
+	          << "\tuint32_t Generator;\n"
+	          << "};\n\n"
+	          << "struct DHGroupBig {\n"
+	          << "\tconst uint8_t* Prime;\n"
+	          << "\tuint32_t Generator;\n"
+	          << "};\n";
+
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		switch (sizes[i]) {
+		case 32: generate<32>(rng, threads, count); break;
+		case 64: generate<64>(rng, threads, count); break;
+		case 128: generate<128>(rng, threads, count); break;
+		case 256: generate<256>(rng, threads, count); break;
+		case 512: generate<512>(rng, threads, count); break;
+		case 1024: generate<1024>(rng, threads, count); break;
+		case 1536: generate<1536>(rng, threads, count); break;
+		case 2048: generate<2048>(rng, threads, count); break;
+		default:
+			std::cerr << "unsupported size " << sizes[i] << "\n";
+			return usage();
+		}
+	}
+
+	std::cout << "\n#endif\n";
+}
@@ -0,0 +1,110 @@
+// Generated by DHParamGen.cpp, do not edit.
+// Safe primes p = 2q + 1 with q prime, each with the smallest generator
+// of the whole group (order p - 1). Big primes are big endian bytes, the
+// same as the MODP primes in BigNum.h.
+
+#ifndef DHPARAMS_H
+#define DHPARAMS_H
+
+#include "ModArith.h"
+
+struct DHGroup32 {
+	uint32_t PrimeMod;
+	uint32_t Generator;
+};
+
+struct DHGroupBig {
+	const uint8_t* Prime;
+	uint32_t Generator;
+};
+
+const DHGroup32 DHGroups32[4] PROGMEM = {
+	{ 0xD7CB26CB, 2 },
+	{ 0xE378CB8B, 2 },
+	{ 0xD6FF7F6F, 5 },
+	{ 0x8A3564FB, 2 },
+};
+
+// generator 2
+const uint8_t DHGroup64Prime0[8] PROGMEM = {
+	0xAF, 0xED, 0x61, 0xF1, 0x1E, 0xE7, 0xD9, 0x8B,
+};
+
+// generator 5
+const uint8_t DHGroup64Prime1[8] PROGMEM = {
+	0xB0, 0xA2, 0x08, 0x23, 0x88, 0x12, 0x97, 0xCF,
+};
+
+// generator 5
+const uint8_t DHGroup64Prime2[8] PROGMEM = {
+	0x8D, 0xE0, 0xA8, 0x83, 0x9E, 0x13, 0xFF, 0x7F,
+};
+
+// generator 2
+const uint8_t DHGroup64Prime3[8] PROGMEM = {
+	0xA1, 0xCA, 0x2B, 0x95, 0xF5, 0x86, 0x91, 0x03,
+};
+
+const DHGroupBig DHGroups64[4] = {
+	{ DHGroup64Prime0, 2 },
+	{ DHGroup64Prime1, 5 },
+	{ DHGroup64Prime2, 5 },
+	{ DHGroup64Prime3, 2 },
+};
+
+// generator 2
+const uint8_t DHGroup1024Prime0[128] PROGMEM = {
+	0xBC, 0xAB, 0xA1, 0xE0, 0x8E, 0xC7, 0xE9, 0xAB, 0xFF, 0xB5, 0x69, 0x4E, 0xE7, 0x64, 0xD0, 0x24,
+	0x02, 0xAE, 0x07, 0x1D, 0xB3, 0x4F, 0x2B, 0xFC, 0xB1, 0x57, 0x76, 0xA9, 0x38, 0x2E, 0x2F, 0xBF,
+	0x2E, 0x94, 0x8E, 0x2C, 0xFE, 0x63, 0xFD, 0xF8, 0x5C, 0x1D, 0x7E, 0xD5, 0x7C, 0xEF, 0x2B, 0xF9,
+	0x48, 0x5C, 0xD8, 0x80, 0xBB, 0xC1, 0x42, 0xA5, 0x2F, 0x2B, 0x81, 0x3B, 0x71, 0x1F, 0x79, 0x45,
+	0xEB, 0x2F, 0xC6, 0x96, 0x5D, 0x0B, 0x2A, 0x22, 0x38, 0x94, 0x6E, 0x60, 0xDF, 0x97, 0x50, 0xA3,
+	0x41, 0x33, 0x0F, 0x26, 0x56, 0xFE, 0x1A, 0xDF, 0x64, 0x02, 0x5B, 0x00, 0xEF, 0x88, 0x3F, 0xF9,
+	0x7D, 0x13, 0xFE, 0x93, 0xB4, 0xCE, 0xC7, 0x16, 0x8F, 0x91, 0x1F, 0x7F, 0x58, 0xC9, 0x2D, 0xE8,
+	0x2F, 0x74, 0x30, 0x5A, 0x60, 0xCA, 0x91, 0xA5, 0x0E, 0xA9, 0xB7, 0xB5, 0xFD, 0xCF, 0x2A, 0x93,
+};
+
+// generator 5
+const uint8_t DHGroup1024Prime1[128] PROGMEM = {
+	0x86, 0x61, 0xA5, 0x59, 0xD0, 0x0D, 0xBB, 0x77, 0xD1, 0xA7, 0x95, 0xAC, 0xDA, 0x08, 0xB6, 0x1B,
+	0x36, 0xE0, 0xD8, 0x71, 0xF4, 0x23, 0x02, 0x06, 0x36, 0xCE, 0x9D, 0xE4, 0xA9, 0x3D, 0x60, 0xFC,
+	0xF7, 0xFF, 0x82, 0x36, 0x8A, 0xB6, 0x4B, 0xAA, 0x86, 0xDB, 0x15, 0x87, 0x25, 0x2B, 0x28, 0x7F,
+	0xEA, 0x84, 0xE2, 0x59, 0xA2, 0xD5, 0x36, 0x2F, 0xC1, 0x1F, 0x05, 0x7E, 0x12, 0x66, 0x94, 0x46,
+	0xC5, 0xDC, 0x8B, 0x5C, 0x2C, 0x06, 0xC8, 0x68, 0x44, 0x1B, 0x48, 0xC9, 0x7E, 0x95, 0x92, 0xE1,
+	0x3A, 0x19, 0x37, 0x82, 0x75, 0x14, 0x05, 0x7C, 0x97, 0x17, 0x69, 0xA4, 0xD9, 0xA1, 0x96, 0x9F,
+	0x54, 0x02, 0xBC, 0xB6, 0xE3, 0xB0, 0x52, 0x2A, 0xDA, 0x16, 0x5B, 0x05, 0x1B, 0x22, 0x67, 0x97,
+	0xFE, 0xEB, 0x88, 0x79, 0x35, 0x96, 0x7C, 0x90, 0x27, 0x66, 0xAE, 0x71, 0x61, 0xC9, 0x42, 0xBF,
+};
+
+// generator 2
+const uint8_t DHGroup1024Prime2[128] PROGMEM = {
+	0xBC, 0xF4, 0x1E, 0x07, 0x8C, 0x0B, 0x5A, 0x2A, 0x81, 0x2D, 0x62, 0x03, 0xCC, 0x81, 0xE2, 0xF3,
+	0x6C, 0x79, 0x86, 0x18, 0x7E, 0x65, 0x42, 0x33, 0x15, 0xE0, 0x48, 0x26, 0x10, 0x22, 0xCA, 0x0F,
+	0x89, 0x99, 0x72, 0x0A, 0xDC, 0x25, 0x0F, 0xED, 0x35, 0xCC, 0xA0, 0x0D, 0xEF, 0x28, 0x8C, 0xC7,
+	0xC1, 0x39, 0xA3, 0x49, 0x8D, 0xA6, 0xBD, 0xC1, 0x15, 0x9D, 0xB2, 0x24, 0xF6, 0x03, 0xA1, 0xD9,
+	0x81, 0x24, 0xDC, 0x3B, 0x33, 0x65, 0x94, 0xA9, 0xAA, 0x26, 0xD2, 0x51, 0xBA, 0xB2, 0xAF, 0xD9,
+	0xC0, 0x9D, 0x4A, 0x5C, 0x9E, 0x83, 0xD9, 0x53, 0x39, 0x32, 0x05, 0x4D, 0x40, 0xBE, 0x50, 0xF3,
+	0x7D, 0x75, 0x67, 0x5B, 0xEC, 0x4A, 0xEC, 0xFE, 0xDC, 0x77, 0xDB, 0xC6, 0x57, 0x79, 0xEB, 0xB6,
+	0x0D, 0xBB, 0x56, 0xC4, 0x10, 0xAC, 0x34, 0xE6, 0x27, 0x07, 0x34, 0xDC, 0x4A, 0x92, 0xC4, 0x5B,
+};
+
+// generator 5
+const uint8_t DHGroup1024Prime3[128] PROGMEM = {
+	0xA2, 0xBA, 0x36, 0x0D, 0x0D, 0x29, 0xFA, 0x0B, 0x7A, 0xD5, 0xCE, 0xBA, 0xE4, 0xB8, 0x33, 0x6A,
+	0xBC, 0xA7, 0x80, 0x34, 0x05, 0xD1, 0xCE, 0xCB, 0x30, 0x5D, 0x04, 0x6D, 0x5D, 0xF6, 0xED, 0x8B,
+	0xC6, 0x86, 0x1E, 0x4E, 0xE9, 0xA6, 0x65, 0x75, 0x58, 0x17, 0xE9, 0xEC, 0x6E, 0x99, 0x18, 0xCA,
+	0x1E, 0x25, 0xA9, 0x7B, 0x19, 0x81, 0xCC, 0x1A, 0x8F, 0x97, 0x27, 0x1E, 0xD3, 0x8E, 0x2C, 0xA9,
+	0xA4, 0x7A, 0xFA, 0x0C, 0xAE, 0x00, 0x2C, 0x6C, 0xA2, 0x7C, 0xED, 0xCF, 0x50, 0x83, 0x05, 0x06,
+	0x22, 0x27, 0xC2, 0x5D, 0xC3, 0xA6, 0xFF, 0xCF, 0x82, 0xB9, 0xBD, 0x4A, 0x54, 0x06, 0xAD, 0x6F,
+	0x65, 0xD4, 0x2B, 0xCC, 0x2D, 0x05, 0x63, 0x6B, 0xC6, 0xE5, 0x4D, 0x2D, 0x9D, 0xF6, 0x09, 0xED,
+	0xDC, 0xC5, 0x5B, 0x59, 0x36, 0x9F, 0x25, 0xCD, 0x38, 0x7D, 0x51, 0x79, 0x63, 0x51, 0x56, 0xBF,
+};
+
+const DHGroupBig DHGroups1024[4] = {
+	{ DHGroup1024Prime0, 2 },
+	{ DHGroup1024Prime1, 5 },
+	{ DHGroup1024Prime2, 2 },
+	{ DHGroup1024Prime3, 5 },
+};
+
+#endif
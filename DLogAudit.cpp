@@ -0,0 +1,539 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <unordered_map>
+#include "stdint.h"
+#include "ModArith.h"
+#include "GroupCheck.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Discrete log auditor for the 32 bit groups the sketches use.
+// Given a captured public key y = g^x mod p it recovers the private x, and
+// the audit mode times that across group sizes so we know what our keys are
+// actually worth.
+// Build with: g++ -O2 -pthread DLogAudit.cpp -o DLogAudit
+//
+//  DLogAudit solve <p> <g> <y> [--method ph|bsgs|rho] [--threads N]
+//  DLogAudit audit [--threads N] [--seed S]
+//
+// Methods:
+//  bsgs: baby step giant step over the whole group order. The baby steps go
+//        in an open addressing table of (value, index) pairs, 8 bytes each
+//        with linear probing, so a lookup is usually one cache line. Giant
+//        steps are split between the threads.
+//  rho:  parallel Pollard rho with distinguished points (van Oorschot and
+//        Wiener). Every thread runs its own r-adding walk and only reports
+//        points whose hash has its low bits clear, so threads share a small
+//        table instead of synchronising every step.
+//  ph:   Pohlig-Hellman. Splits the problem over the prime power factors of
+//        p - 1 and runs bsgs in each subgroup, so it costs about the square
+//        root of the *largest prime factor*. This is the real attack on
+//        2^31 - 1, whose p - 1 = 2 * 3^2 * 7 * 11 * 31 * 151 * 331.
+//
+// All of the group arithmetic stays in the Montgomery domain of ModArith<>.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double now_s() {
+	return std::chrono::duration_cast<std::chrono::duration<double> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// group element hash, for the tables and the walk partition
+inline uint32_t mix32(uint32_t v) {
+	v ^= v >> 16;
+	v *= 0x7FEB352D;
+	v ^= v >> 15;
+	v *= 0x846CA68B;
+	return v ^ (v >> 16);
+}
+
+struct Group {
+	uint32_t PrimeMod;
+	ModArith<> Arith;
+
+	explicit Group(uint32_t p): PrimeMod(p), Arith(p) {}
+
+	// base^e with base and result in the Montgomery domain
+	uint32_t pow(uint32_t base, uint64_t e) const {
+		uint32_t result = Arith.one();
+		for (; e; e >>= 1) {
+			if (e & 0x1)
+				result = Arith.mul(result, base);
+			base = Arith.mul(base, base);
+		}
+		return result;
+	}
+	uint32_t mul(uint32_t a, uint32_t b) const { return Arith.mul(a, b); }
+};
+
+// a^-1 mod n, for a coprime to n
+uint64_t inverse_mod(uint64_t a, uint64_t n) {
+	int64_t t = 0, newT = 1;
+	int64_t r = n, newR = a % n;
+	while (newR) {
+		int64_t q = r / newR;
+		int64_t tmp = t - q * newT; t = newT; newT = tmp;
+		tmp = r - q * newR; r = newR; newR = tmp;
+	}
+	return t < 0 ? t + n : t;
+}
+
+uint64_t gcd64(uint64_t a, uint64_t b) {
+	while (b) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Baby step giant step
+//
+///////////////////////////////////////////////////////////////////////////////
+
+class BabyTable {
+public:
+	explicit BabyTable(uint32_t count) {
+		uint32_t cap = 16;
+		while (cap < 2 * count)
+			cap <<= 1;
+		Mask = cap - 1;
+		// values are group elements, which are never 0
+		Slots.assign(cap, Slot());
+	}
+
+	void insert(uint32_t value, uint32_t index) {
+		uint32_t i = mix32(value) & Mask;
+		while (Slots[i].Value && Slots[i].Value != value)
+			i = (i + 1) & Mask;
+		// keep the first (smallest) index for repeated values
+		if (!Slots[i].Value) {
+			Slots[i].Value = value;
+			Slots[i].Index = index;
+		}
+	}
+
+	bool find(uint32_t value, uint32_t& index) const {
+		uint32_t i = mix32(value) & Mask;
+		while (Slots[i].Value) {
+			if (Slots[i].Value == value) {
+				index = Slots[i].Index;
+				return true;
+			}
+			i = (i + 1) & Mask;
+		}
+		return false;
+	}
+
+private:
+	struct Slot {
+		Slot(): Value(0), Index(0) {}
+		uint32_t Value;
+		uint32_t Index;
+	};
+	std::vector<Slot> Slots;
+	uint32_t Mask;
+};
+
+//
+// bsgs:
+// x in [0, order) with g^x = y, where g has the given order. g and y are in
+// the Montgomery domain. Returns false if there isn't one.
+//
+bool bsgs(const Group& group, uint32_t g, uint32_t y, uint64_t order, unsigned threads,
+          uint64_t& x, uint64_t& steps) {
+	uint32_t m = (uint32_t)std::ceil(std::sqrt((double)order));
+	if (m == 0)
+		m = 1;
+	BabyTable table(m);
+	uint32_t cur = group.Arith.one();
+	for (uint32_t j = 0; j < m; ++j) {
+		table.insert(cur, j);
+		cur = group.mul(cur, g);
+	}
+
+	// giant step g^-m, thread t takes i = t, t + T, t + 2T, ...
+	uint32_t giant = group.pow(g, order - (m % order));
+	uint32_t stride = group.pow(giant, threads);
+	uint64_t giants = (order + m - 1) / m;
+	std::atomic<bool> found(false);
+	std::atomic<uint64_t> totalSteps(m);
+	std::mutex lock;
+	uint64_t answer = 0;
+
+	std::vector<std::thread> pool;
+	for (unsigned t = 0; t < threads; ++t) {
+		pool.push_back(std::thread([&, t]() {
+			uint32_t gamma = group.mul(y, group.pow(giant, t));
+			uint64_t local = 0;
+			for (uint64_t i = t; i < giants && !found; i += threads) {
+				uint32_t j;
+				++local;
+				if (table.find(gamma, j)) {
+					std::lock_guard<std::mutex> guard(lock);
+					uint64_t candidate = (i * m + j) % order;
+					if (!found || candidate < answer)
+						answer = candidate;
+					found = true;
+				}
+				gamma = group.mul(gamma, stride);
+			}
+			totalSteps += local;
+		}));
+	}
+	for (unsigned t = 0; t < threads; ++t)
+		pool[t].join();
+	x = answer;
+	steps = totalSteps;
+	return found;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Parallel Pollard rho with distinguished points
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const uint8_t RhoPartitions = 32;
+
+struct RhoPoint {
+	uint64_t A, B;  // value = g^A y^B
+};
+
+//
+// rho:
+// Same contract as bsgs. Expected work is sqrt(pi * order / 2) steps in
+// total, spread over the threads, plus about 1/theta steps per thread to
+// reach the next distinguished point after the collision.
+//
+bool rho(const Group& group, uint32_t g, uint32_t y, uint64_t order, unsigned threads,
+         uint64_t seed, uint64_t& x, uint64_t& steps) {
+	if (order < 1000)
+		return bsgs(group, g, y, order, threads, x, steps);
+
+	// ~1 in 2^bits points is distinguished, aiming for a few hundred of them
+	// per solve so that the tail after the collision stays small
+	uint8_t bits = 0;
+	while ((1ull << (2 * (bits + 9))) < order)
+		++bits;
+	const uint32_t distMask = (1u << bits) - 1;
+
+	// the walk multipliers g^a_k y^b_k
+	std::mt19937_64 rng(seed);
+	uint32_t mult[RhoPartitions];
+	uint64_t multA[RhoPartitions], multB[RhoPartitions];
+	for (uint8_t k = 0; k < RhoPartitions; ++k) {
+		multA[k] = rng() % order;
+		multB[k] = rng() % order;
+		mult[k] = group.mul(group.pow(g, multA[k]), group.pow(y, multB[k]));
+	}
+
+	std::mutex lock;
+	std::unordered_map<uint32_t, RhoPoint> points;
+	std::atomic<bool> found(false);
+	std::atomic<uint64_t> totalSteps(0);
+	uint64_t answer = 0;
+	// a walk that runs this long has fallen into a cycle with no
+	// distinguished point on it
+	const uint64_t maxWalk = 20ull << bits;
+
+	std::vector<std::thread> pool;
+	for (unsigned t = 0; t < threads; ++t) {
+		uint64_t threadSeed = rng();
+		pool.push_back(std::thread([&, threadSeed]() {
+			std::mt19937_64 local(threadSeed);
+			uint64_t count = 0;
+			while (!found) {
+				uint64_t a = local() % order, b = local() % order;
+				uint32_t v = group.mul(group.pow(g, a), group.pow(y, b));
+				++count;
+				for (uint64_t walk = 0; walk < maxWalk && !found; ++walk) {
+					uint32_t h = mix32(v);
+					if (!(h & distMask)) {
+						RhoPoint mine = { a, b };
+						std::lock_guard<std::mutex> guard(lock);
+						std::unordered_map<uint32_t, RhoPoint>::iterator it = points.find(v);
+						if (it == points.end()) {
+							points[v] = mine;
+							break;
+						}
+						// g^a1 y^b1 = g^a2 y^b2  =>  x (b1 - b2) = a2 - a1 (mod order)
+						RhoPoint other = it->second;
+						uint64_t db = (mine.B + order - other.B) % order;
+						uint64_t da = (other.A + order - mine.A) % order;
+						uint64_t d = gcd64(db, order);
+						if (db && da % d == 0 && d < (1u << 20)) {
+							uint64_t sub = order / d;
+							uint64_t x0 = (unsigned __int128)(da / d) * inverse_mod(db / d % sub, sub) % sub;
+							for (uint64_t k = 0; k < d; ++k) {
+								uint64_t candidate = x0 + k * sub;
+								if (group.pow(g, candidate) == y) {
+									answer = candidate;
+									found = true;
+									break;
+								}
+							}
+						}
+						break;
+					}
+					uint8_t k = h >> (32 - 5);
+					v = group.mul(v, mult[k]);
+					a += multA[k];
+					if (a >= order) a -= order;
+					b += multB[k];
+					if (b >= order) b -= order;
+					++count;
+				}
+			}
+			totalSteps += count;
+		}));
+	}
+	for (unsigned t = 0; t < threads; ++t)
+		pool[t].join();
+	x = answer;
+	steps = totalSteps;
+	return found;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Pohlig-Hellman
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct Factor {
+	uint32_t Prime;
+	uint8_t Power;
+};
+
+std::vector<Factor> factor(uint32_t n) {
+	std::vector<Factor> factors;
+	for (uint32_t f = 2; f <= n / f; f += (f == 2) ? 1 : 2) {
+		if (n % f)
+			continue;
+		Factor fac = { f, 0 };
+		while (n % f == 0) {
+			n /= f;
+			++fac.Power;
+		}
+		factors.push_back(fac);
+	}
+	if (n > 1) {
+		Factor fac = { n, 1 };
+		factors.push_back(fac);
+	}
+	return factors;
+}
+
+//
+// pohlig_hellman:
+// x mod p - 1 for a generator g. Each prime power q^e is solved a base q
+// digit at a time with bsgs in the order q subgroup, and the pieces are put
+// back together with the CRT.
+//
+bool pohlig_hellman(const Group& group, uint32_t g, uint32_t y, unsigned threads,
+                    uint64_t& x, uint64_t& steps) {
+	uint64_t order = group.PrimeMod - 1;
+	std::vector<Factor> factors = factor(order);
+	uint64_t result = 0, modulus = 1;
+	steps = 0;
+	for (size_t f = 0; f < factors.size(); ++f) {
+		uint64_t q = factors[f].Prime;
+		uint64_t qe = 1;
+		for (uint8_t i = 0; i < factors[f].Power; ++i)
+			qe *= q;
+
+		// gamma has order q, and the digits come from (y g^-xk)^(n/q^(i+1))
+		uint32_t gamma = group.pow(g, order / q);
+		uint32_t gInv = group.pow(g, order - 1);
+		uint64_t xk = 0, qi = 1;
+		for (uint8_t i = 0; i < factors[f].Power; ++i) {
+			uint32_t h = group.pow(group.mul(y, group.pow(gInv, xk)), order / (qi * q));
+			uint64_t digit, digitSteps;
+			if (!bsgs(group, gamma, h, q, threads, digit, digitSteps))
+				return false;
+			steps += digitSteps;
+			xk += digit * qi;
+			qi *= q;
+		}
+
+		// fold x = xk mod q^e into the running CRT solution
+		uint64_t t = (unsigned __int128)((xk + qe - result % qe) % qe) *
+		             inverse_mod(modulus % qe, qe) % qe;
+		result += modulus * t;
+		modulus *= qe;
+	}
+	x = result % order;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Front ends
+//
+///////////////////////////////////////////////////////////////////////////////
+
+enum Method {
+	MethodPH,
+	MethodBSGS,
+	MethodRho,
+};
+
+const char* method_name(Method m) {
+	return m == MethodPH ? "ph" : m == MethodBSGS ? "bsgs" : "rho";
+}
+
+// x (normal form exponent) with g^x = y mod p, plus the time and work taken
+bool solve(uint32_t p, uint32_t g, uint32_t y, Method method, unsigned threads, uint64_t seed,
+           uint64_t& x, uint64_t& steps, double& seconds) {
+	Group group(p);
+	uint32_t gd = group.Arith.to_domain(g), yd = group.Arith.to_domain(y);
+	double start = now_s();
+	bool ok;
+	switch (method) {
+	case MethodPH: ok = pohlig_hellman(group, gd, yd, threads, x, steps); break;
+	case MethodBSGS: ok = bsgs(group, gd, yd, p - 1, threads, x, steps); break;
+	default: ok = rho(group, gd, yd, p - 1, threads, seed, x, steps); break;
+	}
+	seconds = now_s() - start;
+	return ok && pow_mod(g, x, group.Arith) == y % p;
+}
+
+uint32_t largest_factor(uint32_t n) {
+	std::vector<Factor> factors = factor(n);
+	return factors.empty() ? 1 : factors.back().Prime;
+}
+
+// a random safe prime of the given size, and its smallest generator
+void safe_prime(uint8_t bits, std::mt19937_64& rng, uint32_t& p, uint32_t& g) {
+	uint32_t q;
+	do {
+		q = (uint32_t)rng() & ((1u << (bits - 2)) - 1);
+		q |= (1u << (bits - 2)) | 1;
+	} while (!is_prime_u32(q) || !is_prime_u32(2*q + 1));
+	p = 2*q + 1;
+	for (g = 2; !is_generator_u32(g, p); ++g);
+}
+
+void print_row(const char* group, uint32_t p, uint32_t g, Method method, bool ok,
+               double seconds, uint64_t steps) {
+	std::printf("%-22s %08x %6u %4.1f %7u %5s %10.6f %12llu %s\n", group, p, g,
+	            std::log2((double)p), largest_factor(p - 1), method_name(method),
+	            seconds, (unsigned long long)steps, ok ? "ok" : "FAILED");
+}
+
+void audit_group(const char* name, uint32_t p, uint32_t g, std::mt19937_64& rng, unsigned threads) {
+	uint32_t secret = rng() % (p - 1);
+	uint32_t y = pow_mod(g, secret, ModArith<>(p));
+	const Method methods[] = { MethodPH, MethodBSGS, MethodRho };
+	for (uint8_t m = 0; m < 3; ++m) {
+		uint64_t x, steps;
+		double seconds;
+		bool ok = solve(p, g, y, methods[m], threads, rng(), x, steps, seconds);
+		print_row(name, p, g, methods[m], ok && x == secret, seconds, steps);
+	}
+}
+
+int audit(unsigned threads, uint64_t seed) {
+	std::mt19937_64 rng(seed);
+	std::printf("%u threads\n", threads);
+	std::printf("%-22s %8s %6s %4s %7s %5s %10s %12s\n", "group", "p", "g", "bits",
+	            "maxfac", "algo", "seconds", "steps");
+
+	// what the sketches actually use
+	audit_group("Project1Part1 default", 19211, 6, rng, threads);
+	audit_group("Project1Part2 default", 0x7FFFFFFF, 16807, rng, threads);
+
+	// safe primes, where p - 1 = 2q and Pohlig-Hellman doesn't help
+	double rhoRate = 0;
+	for (uint8_t bits = 16; bits <= 32; bits += 4) {
+		uint32_t p, g;
+		safe_prime(bits, rng, p, g);
+		char name[32];
+		std::snprintf(name, sizeof(name), "safe prime %u bit", bits);
+		audit_group(name, p, g, rng, threads);
+
+		if (bits == 32) {
+			// measure the rho step rate on the biggest group for the estimates
+			uint32_t y = pow_mod(g, rng() % (p - 1), ModArith<>(p));
+			uint64_t x, steps;
+			double seconds;
+			solve(p, g, y, MethodRho, threads, rng(), x, steps, seconds);
+			rhoRate = steps / seconds;
+		}
+	}
+
+	// generic attacks scale with sqrt(p), so project the measured rho rate
+	// onto bigger safe prime groups. Real finite field groups of 512+ bits
+	// fall to index calculus (NFS) far faster than this.
+	std::printf("\nrho estimates at %.3g steps/s (safe primes, generic attack only)\n", rhoRate);
+	for (uint16_t bits = 40; bits <= 128; bits += 8) {
+		double steps = std::sqrt(M_PI * std::pow(2.0, bits - 1) / 2);
+		double seconds = steps / rhoRate;
+		std::printf("  %3u bit: %.3g steps, %.3g s (%.3g years)\n", bits, steps, seconds,
+		            seconds / (365.25 * 24 * 3600));
+	}
+	return 0;
+}
+
+int usage() {
+	std::cerr << "usage: DLogAudit solve <p> <g> <y> [--method ph|bsgs|rho] [--threads N]\n"
+	          << "       DLogAudit audit [--threads N] [--seed S]\n";
+	return 2;
+}
+
+int main(int argc, char** argv) {
+	unsigned threads = std::thread::hardware_concurrency();
+	uint64_t seed = 0xA0D17;
+	Method method = MethodPH;
+	std::vector<const char*> args;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			threads = strtoul(argv[++i], 0, 0);
+		} else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			seed = strtoull(argv[++i], 0, 0);
+		} else if (!strcmp(argv[i], "--method") && i + 1 < argc) {
+			++i;
+			method = !strcmp(argv[i], "bsgs") ? MethodBSGS : !strcmp(argv[i], "rho") ? MethodRho : MethodPH;
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+	if (threads == 0)
+		threads = 1;
+	if (args.empty())
+		return usage();
+
+	if (!strcmp(args[0], "audit"))
+		return audit(threads, seed);
+
+	if (!strcmp(args[0], "solve") && args.size() == 4) {
+		uint32_t p = strtoul(args[1], 0, 0), g = strtoul(args[2], 0, 0), y = strtoul(args[3], 0, 0);
+		if (!is_prime_u32(p) || !is_generator_u32(g, p)) {
+			std::cerr << "g has to generate the group mod a prime p\n";
+			return 2;
+		}
+		uint64_t x, steps;
+		double seconds;
+		if (!solve(p, g, y, method, threads, seed, x, steps, seconds)) {
+			std::printf("no solution found (%s, %.3f s)\n", method_name(method), seconds);
+			return 1;
+		}
+		std::printf("x = %llu (0x%llx), %s, %.6f s, %llu steps\n", (unsigned long long)x,
+		            (unsigned long long)x, method_name(method), seconds, (unsigned long long)steps);
+		return 0;
+	}
+	return usage();
+}
@@ -0,0 +1,62 @@
+
+#include <iostream>
+#include <iomanip>
+#include "stdint.h"
+#include "ModArith.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Generates FixedBaseTables.h, the flash tables used by fixed_base_pow_mod
+// for the (generator, prime) pairs that the sketches use by default.
+// Build and run with:
+//   g++ -O2 FixedBaseGen.cpp -o FixedBaseGen && ./FixedBaseGen > FixedBaseTables.h
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct FixedBaseGroup {
+	const char* Name;
+	uint32_t Generator;
+	uint32_t PrimeMod;
+};
+
+FixedBaseGroup Groups[] = {
+	// Project1.cpp and Project1Part2.cpp
+	{ "FixedBase16807Mod7FFFFFFF", 16807, 0x7FFFFFFF },
+	// Project1Part1.cpp
+	{ "FixedBase6Mod19211", 6, 19211 },
+};
+
+int main() {
+	std::cout << "// Generated by FixedBaseGen.cpp, do not edit.\n"
+	          << "// Entry [j*" << (int)FixedBaseRowLen << " + d-1] is g^(d * "
+	          << (1 << FixedBaseDigitBits) << "^j) mod p.\n\n"
+	          << "#ifndef FIXEDBASETABLES_H\n"
+	          << "#define FIXEDBASETABLES_H\n\n"
+	          << "#include \"ModArith.h\"\n";
+
+	for (uint8_t g = 0; g < sizeof(Groups)/sizeof(Groups[0]); ++g) {
+		const FixedBaseGroup& group = Groups[g];
+		ModArith<> arith(group.PrimeMod);
+
+		std::cout << "\n// g = " << std::dec << group.Generator
+		          << ", p = 0x" << std::hex << std::uppercase << group.PrimeMod << "\n"
+		          << "const uint32_t " << group.Name << "[" << std::dec
+		          << (int)FixedBaseTableLen << "] PROGMEM = {\n";
+
+		for (uint8_t j = 0; j < FixedBaseDigits; ++j) {
+			// g^(16^j), the step for this row
+			uint32_t step = pow_mod(group.Generator, 1u << (j*FixedBaseDigitBits), arith);
+			uint32_t entry = step;
+			std::cout << "\t";
+			for (uint8_t d = 1; d <= FixedBaseRowLen; ++d) {
+				std::cout << "0x" << std::hex << std::setw(8) << std::setfill('0')
+				          << entry << ",";
+				std::cout << ((d % 5 == 0) ? (d == FixedBaseRowLen ? "\n" : "\n\t") : " ");
+				entry = mul_mod(entry, step, arith);
+			}
+		}
+		std::cout << "};\n";
+	}
+
+	std::cout << "\n#endif\n";
+}
@@ -0,0 +1,65 @@
+// Generated by FixedBaseGen.cpp, do not edit.
+// Entry [j*15 + d-1] is g^(d * 16^j) mod p.
+
+#ifndef FIXEDBASETABLES_H
+#define FIXEDBASETABLES_H
+
+#include "ModArith.h"
+
+// g = 16807, p = 0x7FFFFFFF
+const uint32_t FixedBase16807Mod7FFFFFFF[120] PROGMEM = {
+	0x000041A7, 0x10D63AF1, 0x60B7ACD9, 0x3AB50C2A, 0x4431B782,
+	0x1C06DAC8, 0x06058ED8, 0x56E509FE, 0x56F32F43, 0x77A4044D,
+	0x31169898, 0x427C3C55, 0x6A5D128C, 0x046CDBE2, 0x06D7D4B3,
+	0x43CD3747, 0x618FB492, 0x713E154B, 0x28D61248, 0x62961005,
+	0x6C491FAE, 0x5FC80DB7, 0x1EB565B2, 0x12F6A161, 0x66CB188E,
+	0x2EC36DE6, 0x40C32980, 0x41D8FEC1, 0x085845D8, 0x41E05C71,
+	0x3577F881, 0x797DFB3D, 0x60F9BAC2, 0x6D735787, 0x34633AFE,
+	0x1F1AFA61, 0x543B7605, 0x14CDE233, 0x2C462328, 0x737D00DF,
+	0x0DBC7929, 0x5624AFB7, 0x27C2C152, 0x1C24C29F, 0x39BAB385,
+	0x08EDB801, 0x46BAE07D, 0x58BCC235, 0x7D947367, 0x47A3FC01,
+	0x7EB1005D, 0x7DE3323C, 0x34525102, 0x710C11B2, 0x1770B5A8,
+	0x082C0965, 0x09FF8F44, 0x7B9EF9C6, 0x3412CF72, 0x5958A218,
+	0x644D5AC5, 0x714A282C, 0x5E32C831, 0x7C02E174, 0x728B7813,
+	0x1103438F, 0x789B17D9, 0x2482B172, 0x0EDACBDE, 0x6F74D742,
+	0x36C77D49, 0x277107E8, 0x3672C9AC, 0x44A23E94, 0x33266B0D,
+	0x4D30E005, 0x7675A048, 0x397B1F42, 0x33CB5FDD, 0x08865DE6,
+	0x0B0D2B49, 0x567BDCBE, 0x4F59184F, 0x03AC7E73, 0x4FCA436D,
+	0x2780D52F, 0x33AFDF9C, 0x5E8366F9, 0x3F5A057F, 0x6295936B,
+	0x5C6D2066, 0x2DB2E440, 0x620E7B75, 0x44D2D281, 0x74EF33A5,
+	0x1B73D228, 0x59456290, 0x35BD3FE6, 0x15200C54, 0x6B5474F7,
+	0x30F0AF92, 0x7258EBB5, 0x6786F032, 0x25D533AD, 0x0162B534,
+	0x3C1ED35D, 0x6C8B5D5C, 0x00573616, 0x7FFFBE58, 0x7439627E,
+	0x4E61854F, 0x22602179, 0x10D63AF1, 0x1C8E8631, 0x1B88D243,
+	0x2ACA5F6F, 0x1F485326, 0x2EF3F663, 0x4C5BC52B, 0x33C079A4,
+};
+
+// g = 6, p = 0x4B0B
+const uint32_t FixedBase6Mod19211[120] PROGMEM = {
+	0x00000006, 0x00000024, 0x000000D8, 0x00000510, 0x00001E60,
+	0x0000202A, 0x00002AE6, 0x00002043, 0x00002B7C, 0x000023C7,
+	0x00004094, 0x00000C41, 0x00004986, 0x000041ED, 0x00001457,
+	0x00002EFF, 0x00002447, 0x000002D1, 0x000027CE, 0x00002903,
+	0x00000478, 0x000020C4, 0x00000285, 0x0000462A, 0x00003C86,
+	0x00000F8D, 0x00000954, 0x0000256F, 0x00001EB6, 0x00002EC1,
+	0x00003132, 0x00000B04, 0x00003360, 0x00004751, 0x00002C92,
+	0x00004827, 0x0000425A, 0x00001C1F, 0x00001D49, 0x0000381C,
+	0x000024E0, 0x000025DC, 0x000034FD, 0x00003456, 0x00001067,
+	0x000034DE, 0x00002CDA, 0x00004984, 0x000028CA, 0x00001718,
+	0x000047E4, 0x000023A1, 0x0000328B, 0x00001FE1, 0x00001B17,
+	0x0000310B, 0x00004386, 0x00003FF9, 0x00002333, 0x00000D76,
+	0x0000330B, 0x0000479C, 0x000008ED, 0x00001069, 0x000021C0,
+	0x00003AC4, 0x000032C4, 0x0000319F, 0x00001B95, 0x00003A11,
+	0x00004551, 0x00003FE4, 0x000005C5, 0x00002F53, 0x00001F81,
+	0x000032DC, 0x000009E8, 0x0000378E, 0x000039E6, 0x00001F09,
+	0x00002E64, 0x00003C20, 0x0000364B, 0x000040BB, 0x00003A2A,
+	0x0000257F, 0x00002CA1, 0x00000AA7, 0x00000E1C, 0x000049EB,
+	0x00003CEC, 0x00001289, 0x000008C8, 0x00004A00, 0x0000122F,
+	0x000003F3, 0x000038C8, 0x00003558, 0x000016C6, 0x00004734,
+	0x00004921, 0x00000F62, 0x00004904, 0x000031AE, 0x00003CCC,
+	0x00001427, 0x00001F6E, 0x000034F2, 0x00003F81, 0x00003618,
+	0x00003BE6, 0x00004023, 0x000010E2, 0x00003096, 0x00000B56,
+	0x000017A1, 0x00001FBF, 0x00002257, 0x000039D9, 0x00004137,
+};
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef GROUPCHECK_H
+#define GROUPCHECK_H
+
+#include "stdint.h"
+#include "ModArith.h"
+#include "DHParams.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Validation of the Diffie-Hellman group (prime, generator) that the other
+// side sends us in its KEY message. A group is accepted when the prime really
+// is prime, is about as wide as the keys, and the generator generates the
+// whole group, so the shared secret can be any of the p - 1 values instead of
+// a small subgroup. Without the width check p = 3, g = 2 would pass, leaving
+// two possible shared secrets.
+//
+// Checking from scratch is expensive on the AVR: Miller-Rabin is 3
+// exponentiations, and the generator check factors p - 1 by trial division
+// (up to ~23000 32 bit divisions, around a second when p - 1 = 2q). So:
+//  - the well known groups (the sketch defaults and DHParams.h) are accepted
+//    straight away, they were checked when they were generated.
+//  - GroupCache remembers the last few groups it has decided on, good or
+//    bad, so a repeated handshake costs one table lookup. Entries are the
+//    whole 8 byte (prime, generator) pair rather than a hash of it, so there
+//    are no collisions for a peer to aim for.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// is_prime_u32:
+// Deterministic Miller-Rabin. Bases 2, 7 and 61 give the right answer for
+// every n < 4,759,123,141, which covers all 32 bit numbers.
+//
+inline bool is_prime_u32(uint32_t n) {
+	const uint8_t Bases[] = { 2, 7, 61 };
+	if (n < 2)
+		return false;
+	for (uint8_t i = 0; i < sizeof(Bases); ++i) {
+		if (n == Bases[i])
+			return true;
+		if (n % Bases[i] == 0)
+			return false;
+	}
+
+	// n - 1 = d * 2^s with d odd
+	uint32_t d = n - 1;
+	uint8_t s = 0;
+	while (!(d & 0x1)) {
+		d >>= 1;
+		++s;
+	}
+
+	ModArith<> arith(n);
+	uint32_t one = arith.one();
+	uint32_t minusOne = arith.to_domain(n - 1);
+	for (uint8_t i = 0; i < sizeof(Bases); ++i) {
+		uint32_t x = arith.to_domain(pow_mod(Bases[i], d, arith));
+		if (x == one || x == minusOne)
+			continue;
+		bool composite = true;
+		for (uint8_t r = 1; r < s && composite; ++r) {
+			x = arith.mul(x, x);
+			if (x == minusOne)
+				composite = false;
+		}
+		if (composite)
+			return false;
+	}
+	return true;
+}
+
+//
+// is_generator_u32:
+// Whether g generates the whole multiplicative group mod the prime p, ie.
+// g^((p-1)/f) != 1 for every prime factor f of p - 1. The factors come from
+// trial division, dividing each one out as it's found so the search stops at
+// the square root of what's left.
+//
+inline bool is_generator_u32(uint32_t g, uint32_t p) {
+	if (p < 3 || g % p == 0)
+		return false;
+	ModArith<> arith(p);
+	uint32_t order = p - 1;
+	uint32_t rest = order;
+	for (uint32_t f = 2; f <= rest / f; f += (f == 2) ? 1 : 2) {
+		if (rest % f)
+			continue;
+		if (pow_mod(g, order / f, arith) == 1)
+			return false;
+		do {
+			rest /= f;
+		} while (rest % f == 0);
+	}
+	// whatever is left over is prime
+	if (rest > 1 && pow_mod(g, order / rest, arith) == 1)
+		return false;
+	return true;
+}
+
+// groups that were checked ahead of time
+inline bool is_well_known_group(uint32_t prime, uint32_t generator) {
+	if ((prime == 0x7FFFFFFF && generator == 16807) ||
+	    (prime == 19211 && generator == 6))
+		return true;
+	for (uint8_t i = 0; i < sizeof(DHGroups32) / sizeof(DHGroups32[0]); ++i) {
+		if (pgm_read_dword(&DHGroups32[i].PrimeMod) == prime &&
+		    pgm_read_dword(&DHGroups32[i].Generator) == generator)
+			return true;
+	}
+	return false;
+}
+
+class GroupCache {
+public:
+	static const uint8_t Size = 4;
+
+	GroupCache(): Next(0), Lookups(0), Checks(0) {
+		for (uint8_t i = 0; i < Size; ++i)
+			Entries[i].Used = false;
+	}
+
+	//
+	// check:
+	// Whether (prime, generator) is a group we're willing to use. The prime
+	// needs at least minBits bits, one short of the key width by default, as
+	// the sketches' own 0x7FFFFFFF and 19211 are. The full test only runs for
+	// a group that isn't well known and isn't cached.
+	//
+	bool check(uint32_t prime, uint32_t generator, uint8_t minBits = 31) {
+		++Lookups;
+		if (is_well_known_group(prime, generator))
+			return true;
+		if (prime >> (minBits - 1) == 0)
+			return false;
+		for (uint8_t i = 0; i < Size; ++i) {
+			const Entry& e = Entries[i];
+			if (e.Used && e.PrimeMod == prime && e.Generator == generator)
+				return e.Accepted;
+		}
+
+		++Checks;
+		bool ok = is_prime_u32(prime) && is_generator_u32(generator, prime);
+
+		// oldest entry goes first
+		Entry& e = Entries[Next];
+		e.PrimeMod = prime;
+		e.Generator = generator;
+		e.Accepted = ok;
+		e.Used = true;
+		Next = (Next + 1) % Size;
+		return ok;
+	}
+
+	// how many checks were asked for, and how many needed the full test
+	uint16_t lookups() const { return Lookups; }
+	uint16_t full_checks() const { return Checks; }
+
+private:
+	struct Entry {
+		uint32_t PrimeMod;
+		uint32_t Generator;
+		bool Accepted;
+		bool Used;
+	};
+	Entry Entries[Size];
+	uint8_t Next;
+	uint16_t Lookups;
+	uint16_t Checks;
+};
+
+#endif
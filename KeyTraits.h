@@ -0,0 +1,469 @@
+#ifndef KEYTRAITS_H
+#define KEYTRAITS_H
+
+#include "stdint.h"
+#include "string.h"
+#include "ModArith.h"
+#include "FixedBaseTables.h"
+#include "GroupCheck.h"
+#include "BigNum.h"
+#include "X25519.h"
+
+// Private exponent size for the big groups. Short exponents are the usual
+// trade off, 256 bits is well beyond what the groups themselves offer.
+#ifndef DH_EXPONENT_BITS
+#define DH_EXPONENT_BITS 256
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// KeyTraits<KeyT>: everything EncryptState needs to know about its key size,
+// worked out at compile time so a sketch only carries the code and SRAM for
+// the one size it uses. KeyT is uint8_t, uint16_t, uint32_t, uint64_t, a
+// BigNum<Bits> for one of the MODP groups, or X25519Key.
+//
+// Each of them provides:
+//  Key, Exponent, GeneratorType   the types of public keys (and primes),
+//                                 private keys and the generator
+//  Arith                          arithmetic context for the group
+//  Bytes, GroupBytes              wire size of a key, and of the group
+//                                 description at the start of a KEY message
+//  TextLen                        longest text form of a key, for keys that
+//                                 are typed in by hand
+//  default_prime(), default_generator()
+//  group_pow_mod(base, e, arith), generator_pow_mod(g, e, arith)
+//  byte(k, i), read(bytes)        big endian wire encoding
+//  group_byte(arith, g, i), read_group(bytes, prime, g)
+//  check_group(cache, prime, g)   whether a group from the wire is usable
+//  to_text(k, s), from_text(s), is_zero(k)
+//  fold(k)                        squeeze a shared secret into a 32 bit seed
+//  random_exponent(gen)           a private key from a generator with
+//                                 next_uint32()
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// number of decimal digits in v
+constexpr uint8_t decimal_digits(uint64_t v) {
+	return v < 10 ? 1 : 1 + decimal_digits(v / 10);
+}
+
+// value of a hex digit, -1 if it isn't one
+inline int8_t hex_value(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// the flash table for fixed_base_pow_mod, for the groups that have one
+template <uint32_t Prime, uint32_t Generator>
+struct FixedBaseFor {
+	static const uint32_t* table() { return 0; }
+};
+template <>
+struct FixedBaseFor<19211, 6> {
+	static const uint32_t* table() { return FixedBase6Mod19211; }
+};
+template <>
+struct FixedBaseFor<0x7FFFFFFF, 16807> {
+	static const uint32_t* table() { return FixedBase16807Mod7FFFFFFF; }
+};
+
+// Stand in for GroupCache when the groups we accept are a fixed list
+struct NoGroupCache {};
+
+template <class KeyT>
+struct KeyTraits;
+
+//
+// Keys held in a machine integer. The encoding is the same for every width,
+// the group arithmetic is left to the specialisations below.
+//
+template <class KeyT>
+struct WordKeyTraits {
+	typedef KeyT Key;
+	typedef KeyT Exponent;
+	typedef KeyT GeneratorType;
+
+	static const uint16_t Bytes = sizeof(KeyT);
+	static const uint16_t GroupBytes = 2 * sizeof(KeyT);
+	static const uint8_t TextLen = decimal_digits((KeyT)~(KeyT)0);
+
+	static uint8_t byte(Key k, uint16_t i) { return k >> (8 * (Bytes - 1 - i)); }
+
+	static Key read(const uint8_t* bytes) {
+		Key k = 0;
+		for (uint16_t i = 0; i < Bytes; ++i)
+			k = (k << 8) | bytes[i];
+		return k;
+	}
+
+	// KEY messages carry the prime and then the generator
+	static bool read_group(const uint8_t* bytes, Key& prime, GeneratorType& generator) {
+		prime = read(bytes);
+		generator = read(bytes + Bytes);
+		return true;
+	}
+
+	static bool is_zero(Key k) { return k == 0; }
+
+	// decimal, stops at the first thing that isn't a digit like atol did
+	static void to_text(Key k, char* s) {
+		char digits[TextLen];
+		uint8_t n = 0;
+		do {
+			digits[n++] = '0' + k % 10;
+			k /= 10;
+		} while (k);
+		while (n)
+			*s++ = digits[--n];
+		*s = '\0';
+	}
+	static Key from_text(const char* s) {
+		while (*s == ' ')
+			++s;
+		Key k = 0;
+		for (; *s >= '0' && *s <= '9'; ++s)
+			k = k*10 + (*s - '0');
+		return k;
+	}
+
+	static uint32_t fold(Key k) {
+		uint32_t v = 0;
+		for (uint16_t b = 0; b < Bytes; b += 4)
+			v ^= (uint32_t)(k >> (8 * b));
+		return v;
+	}
+
+	// one next_uint32() per 32 bits of key, low word first
+	template <class Gen>
+	static Exponent random_exponent(Gen& gen) {
+		Exponent e = 0;
+		for (uint16_t b = 0; b < Bytes; b += 4)
+			e |= (Exponent)gen.next_uint32() << (8 * b);
+		return e;
+	}
+};
+
+//
+// Keys of up to 32 bits, over a group with a prime of the same size. The
+// default group gets the compile time ModArith and its fixed base table if it
+// has one, anything else uses ModArith<> and is checked with GroupCache.
+//
+template <class KeyT, uint32_t Prime, uint32_t Generator>
+struct SmallKeyTraits: WordKeyTraits<KeyT> {
+	typedef WordKeyTraits<KeyT> Base;
+	typedef typename Base::Key Key;
+	typedef typename Base::Exponent Exponent;
+	typedef typename Base::GeneratorType GeneratorType;
+	typedef ModArith<> Arith;
+	typedef GroupCache Cache;
+
+	static Key default_prime() { return Prime; }
+	static GeneratorType default_generator() { return Generator; }
+
+	static Key group_pow_mod(Key base, Exponent e, const Arith& arith) {
+		if (arith.modulus() == Prime)
+			return pow_mod(base, e, ModArith<Prime>());
+		return pow_mod(base, e, arith);
+	}
+
+	static Key generator_pow_mod(GeneratorType g, Exponent e, const Arith& arith) {
+		const uint32_t* table = FixedBaseFor<Prime, Generator>::table();
+		if (table && arith.modulus() == Prime && g == Generator)
+			return fixed_base_pow_mod(table, e, ModArith<Prime>());
+		return group_pow_mod(g, e, arith);
+	}
+
+	static uint8_t group_byte(const Arith& arith, GeneratorType g, uint16_t i) {
+		return i < Base::Bytes ? Base::byte(arith.modulus(), i) : Base::byte(g, i - Base::Bytes);
+	}
+
+	// the prime can be a bit short of the key width, like the defaults, but
+	// no more
+	static bool check_group(Cache& cache, Key prime, GeneratorType g) {
+		return cache.check(prime, g, Base::Bytes * 8 - 1);
+	}
+};
+
+// 8 bit keys need a prime under 256
+template <>
+struct KeyTraits<uint8_t>: SmallKeyTraits<uint8_t, 251, 6> {};
+
+// the Project1Part1 group
+template <>
+struct KeyTraits<uint16_t>: SmallKeyTraits<uint16_t, 19211, 6> {};
+
+// the Project1 / Project1Part2 group
+template <>
+struct KeyTraits<uint32_t>: SmallKeyTraits<uint32_t, 0x7FFFFFFF, 16807> {};
+
+//
+// 64 bit keys, with MontgomeryMod64. The default is the first of the 64 bit
+// safe prime groups in DHParams.h. Checking an arbitrary group means factoring
+// p - 1, which is out of reach here, so only the DHParams.h groups are taken.
+//
+template <>
+struct KeyTraits<uint64_t>: WordKeyTraits<uint64_t> {
+	typedef MontgomeryMod64 Arith;
+	typedef NoGroupCache Cache;
+
+	static Key default_prime() { return 0xAFED61F11EE7D98Bull; }
+	static GeneratorType default_generator() { return 2; }
+
+	static Key group_pow_mod(Key base, Exponent e, const Arith& arith) {
+		return pow_mod(base, e, arith);
+	}
+	static Key generator_pow_mod(GeneratorType g, Exponent e, const Arith& arith) {
+		return pow_mod(g, e, arith);
+	}
+
+	static uint8_t group_byte(const Arith& arith, GeneratorType g, uint16_t i) {
+		return i < Bytes ? byte(arith.modulus(), i) : byte(g, i - Bytes);
+	}
+
+	static bool check_group(Cache&, Key prime, GeneratorType g) {
+		for (uint8_t i = 0; i < sizeof(DHGroups64) / sizeof(DHGroups64[0]); ++i) {
+			Key p = 0;
+			for (uint8_t j = 0; j < Bytes; ++j)
+				p = (p << 8) | pgm_read_byte(&DHGroups64[i].Prime[j]);
+			if (p == prime && g == DHGroups64[i].Generator)
+				return true;
+		}
+		return false;
+	}
+};
+
+//
+// The MODP groups from BigNum.h. The group is named by its id on the wire
+// instead of being sent, and keys are typed in and shown as hex.
+//
+template <uint16_t Bits>
+struct KeyTraits<BigNum<Bits> > {
+	typedef BigNum<Bits> Key;
+	typedef BigNum<DH_EXPONENT_BITS> Exponent;
+	typedef uint8_t GeneratorType;
+	typedef BigMontgomery<Bits> Arith;
+	typedef NoGroupCache Cache;
+
+	static const uint16_t Bytes = Key::Bytes;
+	static const uint16_t GroupBytes = 1;
+	static const uint16_t TextLen = 2 * Key::Bytes;
+
+	static Key default_prime() {
+		static_assert(Bits == 1024 || Bits == 1536 || Bits == 2048, "no MODP group of that size");
+		Key prime;
+		prime.from_progmem(modp_prime(Bits));
+		return prime;
+	}
+	static GeneratorType default_generator() { return ModpGenerator; }
+
+	static Key group_pow_mod(const Key& base, const Exponent& e, const Arith& arith) {
+		return pow_mod(base, e, arith);
+	}
+	static Key generator_pow_mod(GeneratorType g, const Exponent& e, const Arith& arith) {
+		return pow_mod(Key(g), e, arith);
+	}
+
+	static uint8_t byte(const Key& k, uint16_t i) { return k.byte(i); }
+
+	static Key read(const uint8_t* bytes) {
+		Key k;
+		k.from_bytes(bytes);
+		return k;
+	}
+
+	static uint8_t group_byte(const Arith&, GeneratorType, uint16_t) { return modp_group_id(Bits); }
+
+	// the other side has to be using the same size of group
+	static bool read_group(const uint8_t* bytes, Key& prime, GeneratorType& generator) {
+		if (bytes[0] != modp_group_id(Bits))
+			return false;
+		prime = default_prime();
+		generator = default_generator();
+		return true;
+	}
+
+	static bool check_group(Cache&, const Key& prime, GeneratorType g) {
+		return g == ModpGenerator && prime == default_prime();
+	}
+
+	static bool is_zero(const Key& k) { return k.is_zero(); }
+
+	static void to_text(const Key& k, char* s) {
+		const char Digits[] = "0123456789ABCDEF";
+		for (uint16_t i = 0; i < Bytes; ++i) {
+			*s++ = Digits[k.byte(i) >> 4];
+			*s++ = Digits[k.byte(i) & 0xF];
+		}
+		*s = '\0';
+	}
+
+	// hex, the last digit read is the lowest
+	static Key from_text(const char* s) {
+		uint16_t len = 0;
+		while (len < TextLen && hex_value(s[len]) >= 0)
+			++len;
+		uint8_t bytes[Bytes];
+		memset(bytes, 0, sizeof(bytes));
+		for (uint16_t i = 0; i < len; ++i) {
+			uint16_t nibble = len - 1 - i;
+			bytes[Bytes - 1 - nibble/2] |= hex_value(s[i]) << (4 * (nibble % 2));
+		}
+		return read(bytes);
+	}
+
+	static uint32_t fold(const Key& k) { return k.fold_uint32(); }
+
+	// all 4 bytes of each next_uint32(), low byte first
+	template <class Gen>
+	static Exponent random_exponent(Gen& gen) {
+		uint8_t bytes[Exponent::Bytes];
+		for (uint16_t i = 0; i < Exponent::Bytes; i += 4) {
+			uint32_t w = gen.next_uint32();
+			for (uint8_t j = 0; j < 4 && i + j < Exponent::Bytes; ++j)
+				bytes[i + j] = w >> (8 * j);
+		}
+		Exponent e;
+		e.from_bytes(bytes);
+		return e;
+	}
+};
+
+//
+// X25519 keys. The curve is fixed, so there is no group to build or check:
+// Arith is a stand in whose modulus is p = 2^255 - 19, and the KEY message
+// only names the curve. Keys are shown as hex in wire (little endian) order.
+// An all zero shared secret, from a low order point, isn't rejected; the
+// handshake has no authentication to protect anyway.
+//
+const uint8_t X25519GroupId = 0xFF;
+
+struct X25519Curve {
+	void set_modulus(const X25519Key&) {}
+
+	X25519Key modulus() const {
+		X25519Key p;
+		memset(p.Data, 0xFF, sizeof(p.Data));
+		p.Data[0] = 0xED;
+		p.Data[31] = 0x7F;
+		return p;
+	}
+};
+
+template <>
+struct KeyTraits<X25519Key> {
+	typedef X25519Key Key;
+	typedef X25519Key Exponent;
+	typedef uint8_t GeneratorType;
+	typedef X25519Curve Arith;
+	typedef NoGroupCache Cache;
+
+	static const uint16_t Bytes = sizeof(X25519Key);
+	static const uint16_t GroupBytes = 1;
+	static const uint16_t TextLen = 2 * sizeof(X25519Key);
+
+	static Key default_prime() { return X25519Curve().modulus(); }
+
+	// the u coordinate of the base point
+	static GeneratorType default_generator() { return 9; }
+
+	static Key group_pow_mod(const Key& base, const Exponent& e, const Arith&) {
+		Key r;
+		x25519(r.Data, e.Data, base.Data);
+		return r;
+	}
+	static Key generator_pow_mod(GeneratorType g, const Exponent& e, const Arith& arith) {
+		Key base;
+		memset(base.Data, 0, sizeof(base.Data));
+		base.Data[0] = g;
+		return group_pow_mod(base, e, arith);
+	}
+
+	static uint8_t byte(const Key& k, uint16_t i) { return k.Data[i]; }
+
+	static Key read(const uint8_t* bytes) {
+		Key k;
+		memcpy(k.Data, bytes, sizeof(k.Data));
+		return k;
+	}
+
+	static uint8_t group_byte(const Arith&, GeneratorType, uint16_t) { return X25519GroupId; }
+
+	static bool read_group(const uint8_t* bytes, Key& prime, GeneratorType& generator) {
+		if (bytes[0] != X25519GroupId)
+			return false;
+		prime = default_prime();
+		generator = default_generator();
+		return true;
+	}
+
+	static bool check_group(Cache&, const Key&, GeneratorType g) { return g == 9; }
+
+	static bool is_zero(const Key& k) {
+		uint8_t any = 0;
+		for (uint8_t i = 0; i < Bytes; ++i)
+			any |= k.Data[i];
+		return !any;
+	}
+
+	static void to_text(const Key& k, char* s) {
+		const char Digits[] = "0123456789abcdef";
+		for (uint8_t i = 0; i < Bytes; ++i) {
+			*s++ = Digits[k.Data[i] >> 4];
+			*s++ = Digits[k.Data[i] & 0xF];
+		}
+		*s = '\0';
+	}
+
+	// hex in wire order, anything missing off the end is 0
+	static Key from_text(const char* s) {
+		Key k;
+		memset(k.Data, 0, sizeof(k.Data));
+		for (uint8_t i = 0; i < TextLen && hex_value(s[i]) >= 0; ++i)
+			k.Data[i/2] |= hex_value(s[i]) << (i % 2 ? 0 : 4);
+		return k;
+	}
+
+	static uint32_t fold(const Key& k) {
+		uint32_t v = 0;
+		for (uint8_t i = 0; i < Bytes; ++i)
+			v ^= (uint32_t)k.Data[i] << (8 * (i % 4));
+		return v;
+	}
+
+	// x25519 clamps the scalar itself, so any 32 bytes will do
+	template <class Gen>
+	static Exponent random_exponent(Gen& gen) {
+		Exponent e;
+		for (uint8_t i = 0; i < Bytes; i += 4) {
+			uint32_t w = gen.next_uint32();
+			for (uint8_t j = 0; j < 4; ++j)
+				e.Data[i + j] = w >> (8 * j);
+		}
+		return e;
+	}
+};
+
+//
+// KeyTypeFor<Bits>: the key type for a size in bits, for the sketches'
+// DH_GROUP_BITS switch. 8 to 64 are machine integers, 25519 is X25519, and
+// anything else is one of the MODP groups.
+//
+template <uint16_t Bits>
+struct KeyTypeFor { typedef BigNum<Bits> Type; };
+template <>
+struct KeyTypeFor<8> { typedef uint8_t Type; };
+template <>
+struct KeyTypeFor<16> { typedef uint16_t Type; };
+template <>
+struct KeyTypeFor<32> { typedef uint32_t Type; };
+template <>
+struct KeyTypeFor<64> { typedef uint64_t Type; };
+template <>
+struct KeyTypeFor<25519> { typedef X25519Key Type; };
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef KEYSTREAMGEN_H
+#define KEYSTREAMGEN_H
+
+#include "stdint.h"
+#include "MersenneTwister.h"
+#include "ChaCha.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Keystream generators for EncryptState. Anything with
+//   void seed(uint32_t seed)
+//   uint32_t next_uint32()
+//   void discard(uint32_t n)     same as n calls to next_uint32()
+// will do, so these drop in wherever the MersenneTwister was. The two sides
+// have to use the same one (KEYSTREAM_GEN in the sketches) or the keystreams
+// won't match.
+//
+// MersenneTwister is 2.5 KB of state, and EncryptState has two of them, which
+// is most of an Arduino Mega's 8 KB of SRAM (unless FallbackGen below leaves
+// them out for a ChaCha only sketch). The others are a few bytes each:
+//  - CounterGen (12 bytes): the n'th word is a hash of the key and n, so any
+//    word can be got at without generating the ones before it, and discard
+//    is just an add.
+//  - Xoshiro128 (16 bytes): xoshiro128**, shifts, rotates and one multiply
+//    by 5 and 9 per word.
+// None of them are cryptographically secure; neither is the Mersenne Twister.
+// ChaCha20 (ChaCha.h) is, given a proper key, and ChaChaOr<Gen> below picks
+// between it and one of these per session.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// the murmur3 finaliser, a cheap 32 bit bijection that mixes every bit
+inline uint32_t mix32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x85EBCA6B;
+	x ^= x >> 13;
+	x *= 0xC2B2AE35;
+	x ^= x >> 16;
+	return x;
+}
+
+class CounterGen {
+public:
+	CounterGen() {
+		seed(0xDEADB08F);
+	}
+	//
+	void seed(uint32_t seed) {
+		Key = seed;
+		Key2 = mix32(seed ^ 0x6A09E667);
+		Counter = 0;
+	}
+	//
+	uint32_t next_uint32() {
+		// a Weyl sequence through the key, then hashed twice so that two keys
+		// don't just give the same stream shifted along
+		uint32_t x = mix32(Key + Counter * 0x9E3779B9);
+		++Counter;
+		return mix32(x ^ Key2);
+	}
+	//
+	void discard(uint32_t n) {
+		Counter += n;
+	}
+
+private:
+	uint32_t Key;
+	uint32_t Key2;
+	uint32_t Counter;
+};
+
+class Xoshiro128 {
+public:
+	Xoshiro128() {
+		seed(0xDEADB08F);
+	}
+	//
+	void seed(uint32_t seed) {
+		// spread the seed over the state with splitmix, which never gives an
+		// all zero state
+		for (uint8_t i = 0; i < 4; ++i)
+			S[i] = mix32(seed + (i + 1) * 0x9E3779B9);
+	}
+	//
+	uint32_t next_uint32() {
+		uint32_t result = rotl(S[1] * 5, 7) * 9;
+		step();
+		return result;
+	}
+	//
+	// xoshiro is linear, but a jump of an arbitrary n needs x^n mod its
+	// characteristic polynomial, which is more code and time than stepping
+	// over the few blocks a receiver ever needs to skip.
+	void discard(uint32_t n) {
+		while (n-- > 0)
+			step();
+	}
+
+private:
+	void step() {
+		uint32_t t = S[1] << 9;
+		S[2] ^= S[0];
+		S[3] ^= S[1];
+		S[1] ^= S[2];
+		S[0] ^= S[3];
+		S[2] ^= t;
+		S[3] = rotl(S[3], 11);
+	}
+
+	static uint32_t rotl(uint32_t x, uint8_t k) {
+		return (x << k) | (x >> (32 - k));
+	}
+
+	uint32_t S[4];
+};
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// n words of keystream in one go. MersenneTwister has a bulk fill (SIMD on the
+// host); the others are quick enough one at a time. Not on the Arduino, where
+// fill() doing a whole twist at once would undo next_uint32()'s spreading it
+// out.
+template <class Gen>
+inline void keystream_words(Gen& gen, uint32_t* out, uint16_t n) {
+	for (uint16_t i = 0; i < n; ++i)
+		out[i] = gen.next_uint32();
+}
+
+#if !defined(__AVR__)
+inline void keystream_words(MersenneTwister& gen, uint32_t* out, uint16_t n) {
+	gen.fill(out, n);
+}
+#endif
+
+template <uint8_t Rounds>
+inline void keystream_words(ChaCha<Rounds>& gen, uint32_t* out, uint16_t n) {
+	gen.fill(out, n);
+}
+
+//
+// ChaChaOr<Gen, Rounds>
+// Either Gen or ChaCha with Rounds rounds, switched with use_chacha() before
+// seeding, so the sketch can settle which in the handshake. base() and
+// cipher() get at each of them on its own. ChaCha takes its 256 bit key
+// from set_key(), and seed() only sets its nonce.
+//
+template <class Gen, uint8_t Rounds = 20>
+class ChaChaOr {
+public:
+	ChaChaOr(): UseChaCha(false) {}
+
+	void use_chacha(bool chacha) { UseChaCha = chacha; }
+	bool chacha() const { return UseChaCha; }
+	void set_key(const uint8_t* key) { Cipher.set_key(key); }
+
+	Gen& base() { return Base; }
+	ChaCha<Rounds>& cipher() { return Cipher; }
+
+	void seed(uint32_t seed) {
+		if (UseChaCha)
+			Cipher.seed(seed);
+		else
+			Base.seed(seed);
+	}
+
+	uint32_t next_uint32() {
+		return UseChaCha ? Cipher.next_uint32() : Base.next_uint32();
+	}
+
+	void discard(uint32_t n) {
+		if (UseChaCha)
+			Cipher.discard(n);
+		else
+			Base.discard(n);
+	}
+
+private:
+	bool UseChaCha;
+	Gen Base;
+	ChaCha<Rounds> Cipher;
+};
+
+template <class Gen, uint8_t Rounds>
+inline void keystream_words(ChaChaOr<Gen, Rounds>& gen, uint32_t* out, uint16_t n) {
+	if (gen.chacha())
+		keystream_words(gen.cipher(), out, n);
+	else
+		keystream_words(gen.base(), out, n);
+}
+
+//
+// ChaChaOr<NoGen, Rounds>
+// ChaCha on its own, for a sketch that never falls back to anything else, so
+// there's no Gen taking up SRAM for nothing (2.5 KB a direction for the
+// MersenneTwister). use_chacha(false) doesn't turn it off.
+//
+struct NoGen {};
+
+template <uint8_t Rounds>
+class ChaChaOr<NoGen, Rounds> {
+public:
+	void use_chacha(bool) {}
+	bool chacha() const { return true; }
+	void set_key(const uint8_t* key) { Cipher.set_key(key); }
+
+	ChaCha<Rounds>& cipher() { return Cipher; }
+
+	void seed(uint32_t seed) { Cipher.seed(seed); }
+	uint32_t next_uint32() { return Cipher.next_uint32(); }
+	void discard(uint32_t n) { Cipher.discard(n); }
+
+private:
+	ChaCha<Rounds> Cipher;
+};
+
+template <uint8_t Rounds>
+inline void keystream_words(ChaChaOr<NoGen, Rounds>& gen, uint32_t* out, uint16_t n) {
+	keystream_words(gen.cipher(), out, n);
+}
+
+// Gen, or NoGen when the sketch can't ever need anything but ChaCha
+template <bool Needed, class Gen>
+struct FallbackGen { typedef Gen Type; };
+template <class Gen>
+struct FallbackGen<false, Gen> { typedef NoGen Type; };
+
+// buf ^= keystream, 16 bytes at a time where there's SSE2
+inline void xor_bytes(uint8_t* buf, const uint8_t* keystream, uint16_t n) {
+	uint16_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+		__m128i b = _mm_loadu_si128((const __m128i*)(buf + i));
+		__m128i k = _mm_loadu_si128((const __m128i*)(keystream + i));
+		_mm_storeu_si128((__m128i*)(buf + i), _mm_xor_si128(b, k));
+	}
+#endif
+	for (; i < n; ++i)
+		buf[i] ^= keystream[i];
+}
+
+//
+// Keystream<Gen, Size>
+// One direction's keystream: a generator, how far along it we are, and up to
+// Size bytes of it worked out ahead of time by prefetch(), which the sketch
+// calls when loop() has nothing else to do. next_byte() then only has to read
+// the buffer, and falls back to the generator when the buffer has run dry.
+//
+// How many keystream bytes each generator word makes is set by seed(): 1, the
+// low 8 bits, is the original layout, and 4 uses the whole word, low byte
+// first, for a quarter of the generator work. The buffer also holds what's
+// left of a word that's been started. Size needs to be at least 4 for that.
+//
+// xor_into(buf, len) encrypts or decrypts a whole buffer. With 4 bytes a
+// word it takes whole words straight from the generator for the middle of
+// the buffer; on the host it takes up to BulkWords at a time (the SIMD fills
+// of MersenneTwister and ChaCha, 8 AVX2 blocks for ChaCha) and xors them in
+// with SSE2.
+//
+// seek() moves to any byte of the keystream: forward within the buffer just
+// drops bytes, further forward discards from the generator, and back means
+// reseeding with the key and discarding from the start.
+//
+// hits() and misses() count the bytes that were already in the buffer when
+// they were needed and the ones that had to be generated there and then.
+//
+template <class Gen, uint8_t Size>
+class Keystream {
+public:
+#if defined(__AVR__)
+	static const uint16_t BulkWords = 1;
+#else
+	static const uint16_t BulkWords = 128;
+#endif
+
+	Keystream(): Key(0), Pos(0), WordBytes(1), Head(0), Count(0), Hits(0), Misses(0) {}
+
+	// the generator on its own, for using it before there's a session
+	Gen& generator() { return RandomGen; }
+
+	void seed(uint32_t key, uint8_t wordBytes = 1) {
+		RandomGen.seed(key);
+		Key = key;
+		Pos = 0;
+		WordBytes = wordBytes;
+		Head = 0;
+		Count = 0;
+	}
+
+	// the next keystream byte
+	uint8_t next_byte() {
+		++Pos;
+		if (Count > 0) {
+			++Hits;
+			return pop();
+		}
+		++Misses;
+		uint32_t word = RandomGen.next_uint32();
+		push_word(word >> 8, WordBytes - 1);
+		return word;
+	}
+
+	// buf ^= the next len bytes of keystream
+	void xor_into(uint8_t* buf, size_t len) {
+		// what's already been worked out first
+		for (; len > 0 && Count > 0; --len, ++buf, ++Pos, ++Hits)
+			*buf ^= pop();
+
+		// then whole words, when the buffer's empty the generator is at a
+		// word boundary
+		if (WordBytes == 4) {
+			while (len >= 4) {
+				size_t n = len / 4;
+				if (n > BulkWords)
+					n = BulkWords;
+				uint32_t words[BulkWords];
+				keystream_words(RandomGen, words, n);
+				for (uint16_t i = 0; i < n; ++i) {
+					// little endian on the wire whatever the host is
+					uint8_t* b = (uint8_t*)&words[i];
+					uint32_t w = words[i];
+					b[0] = w;
+					b[1] = w >> 8;
+					b[2] = w >> 16;
+					b[3] = w >> 24;
+				}
+				xor_bytes(buf, (const uint8_t*)words, n * 4);
+				buf += n * 4;
+				len -= n * 4;
+				Pos += n * 4;
+				Misses += n * 4;
+			}
+		}
+		for (; len > 0; --len, ++buf)
+			*buf ^= next_byte();
+	}
+
+	// works out one more word ahead of time; false if the buffer's full
+	bool prefetch() {
+		if (Size - Count < WordBytes)
+			return false;
+		push_word(RandomGen.next_uint32(), WordBytes);
+		return true;
+	}
+
+	// how many bytes of keystream have been used
+	uint32_t position() const { return Pos; }
+
+	void seek(uint32_t to) {
+		if (to >= Pos && to - Pos <= Count) {
+			drop(to - Pos);
+			Pos = to;
+			return;
+		}
+		// the buffer ends on a word boundary, so (Pos + Count) is a whole
+		// number of words into the keystream
+		uint32_t word = to / WordBytes;
+		if (to > Pos) {
+			RandomGen.discard(word - (Pos + Count) / WordBytes);
+		} else {
+			RandomGen.seed(Key);
+			RandomGen.discard(word);
+		}
+		Head = 0;
+		Count = 0;
+		Pos = word * WordBytes;
+		// landing part way into a word keeps the rest of it
+		if (to > Pos) {
+			push_word(RandomGen.next_uint32(), WordBytes);
+			drop(to - Pos);
+			Pos = to;
+		}
+	}
+
+	uint32_t hits() const { return Hits; }
+	uint32_t misses() const { return Misses; }
+
+private:
+	uint8_t pop() {
+		uint8_t b = Buffer[Head];
+		Head = (Head + 1) % Size;
+		--Count;
+		return b;
+	}
+
+	void drop(uint8_t n) {
+		Head = (Head + n) % Size;
+		Count -= n;
+	}
+
+	// the low n bytes of word, low byte first
+	void push_word(uint32_t word, uint8_t n) {
+		for (uint8_t i = 0; i < n; ++i, word >>= 8) {
+			Buffer[(Head + Count) % Size] = word;
+			++Count;
+		}
+	}
+
+	Gen RandomGen;
+	uint32_t Key;
+	uint32_t Pos;
+	uint8_t WordBytes;
+	uint8_t Buffer[Size];
+	uint8_t Head;
+	uint8_t Count;
+	uint32_t Hits;
+	uint32_t Misses;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef LEGACYMOD_H
+#define LEGACYMOD_H
+
+#include "stdint.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The modular arithmetic each file had before ModArith.h, kept so the host
+// benchmarks can compare against (and check the mismatches of) what used to
+// run. Each one is copied as it was, overflow behaviour and all. The only
+// change is a place < 32 guard on the exponent loops: on x86 a shift by 32
+// wraps around, so the original loop conditions never end there.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The copies keep their no-op statements and unused parameters, so keep the
+// host tools warning clean under -Wall -Wextra without touching them
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-value"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+// Project1.cpp: base truncated to 16 bits, signed 64 bit squares
+namespace project1 {
+	inline uint32_t pow_mod(uint16_t base, uint32_t exponent, uint64_t modulus) {
+		uint32_t shift;
+		uint32_t result = 1;
+		for (uint8_t place = 0; place < 32 && (shift = exponent>>place); ++place) {
+			if (shift & 0x1) {
+				int64_t factor = base;
+				for (uint8_t i = 0; i < place; ++i)
+					factor = (factor*factor) % modulus;
+				result = (result*factor) % modulus;
+			}
+		}
+		return result;
+	}
+}
+
+// Project1Part1.cpp: base truncated to 16 bits, unsigned 64 bit squares
+namespace project1_part1 {
+	inline uint32_t pow_mod(uint16_t base, uint32_t exponent, uint32_t modulus) {
+		uint32_t shift;
+		uint32_t result = 1;
+		for (uint8_t place = 0; place < 32 && (shift = exponent>>place); ++place) {
+			if (shift & 0x1) {
+				uint64_t factor = base;
+				for (uint8_t i = 0; i < place; ++i)
+					factor = (factor*factor) % modulus;
+				result = (result*factor) % modulus;
+			}
+		}
+		return result;
+	}
+}
+
+// Project1Part2.cpp: 32 bit sums with the overflow branch commented out, and
+// the v << 2 no-op in mul_mod
+namespace project1_part2 {
+	inline uint32_t add_mod(uint32_t a, uint32_t b, uint32_t mod) {
+		return (a+b) % mod;
+	}
+
+	inline uint32_t mulpow2_mod(uint32_t a, uint8_t pow2, uint32_t mod) {
+		for (uint8_t i = 0; i < pow2; ++i) {
+			a = add_mod(a, a, mod);
+		}
+		return a;
+	}
+
+	inline uint32_t mul_mod(uint32_t a, uint32_t b, uint32_t mod) {
+		uint32_t sum = 0;
+		uint32_t v = b;
+		for (uint8_t j = 0; j < 31; ++j) {
+			if ((b >> j) & 1) {
+				sum = (sum + v) % mod;
+			}
+			v << 2;
+		}
+		return sum;
+	}
+
+	inline uint32_t pow_mod(uint32_t base, uint32_t exponent, uint32_t modulus) {
+		uint32_t shift;
+		uint32_t result = 1;
+		uint32_t factor = base;
+		for (uint8_t place = 0; place < 32 && (shift = exponent>>place); ++place) {
+			if (shift & 0x1)
+				result = mul_mod(result, factor, modulus);
+			factor = mul_mod(factor, factor, modulus);
+		}
+		return result;
+	}
+
+	// mod from Mark's quiz #2, still used by the sketch
+	inline int mod(int a, int b) {
+		if (b < 0) {
+			return -mod(-a, -b);
+		} else if (b == 0) {
+			return 0;
+		} else {
+			if (a >= 0) {
+				return a % b;
+			} else {
+				int c = -(-a % b);
+				if (c == 0) {
+					return 0;
+				} else {
+					return c + b;
+				}
+			}
+		}
+	}
+}
+
+// ModTest.cpp: signed 64 bit squares over all 32 places
+namespace mod_test {
+	inline uint32_t pow_mod(uint32_t base, uint32_t exponent, uint32_t modulus) {
+		int64_t result = 1;
+		for (int place = 0; place < 32; ++place) {
+			if ((exponent>>place) & 0x1) {
+				int64_t factor = base;
+				for (int i = 0; i < place; ++i)
+					factor = (factor*factor) % modulus;
+				result = (result*factor) % modulus;
+			}
+		}
+		return result;
+	}
+}
+
+// FullPrecisionMod.cpp: recursive overflow-safe add_mod, and a mul_mod that
+// builds a power of two for every pair of set bits, O(32*32) add_mods
+namespace full_precision {
+	inline uint32_t add_mod(uint32_t a, uint32_t b, uint32_t mod) {
+		a = a%mod;
+		b = b%mod;
+		if (a > 0xFFFFFFFFull-b) {
+			return add_mod(0xFFFFFFFFull % mod, (a+b+1ull) % mod, mod);
+		} else {
+			return (a+b) % mod;
+		}
+	}
+
+	inline uint32_t mulpow2_mod(uint32_t a, uint8_t pow2, uint32_t mod) {
+		for (uint8_t i = 0; i < pow2; ++i) {
+			a = add_mod(a, a, mod);
+		}
+		return a;
+	}
+
+	inline uint32_t mul_mod(uint32_t a, uint32_t b, uint32_t mod) {
+		uint32_t sum = 0;
+		for (uint8_t i = 0; i < 32; ++i) {
+			for (uint8_t j = 0; j < 32; ++j) {
+				if (((a >> i) & 1) && ((b >> j) & 1)) {
+					sum = add_mod(sum, mulpow2_mod(1u<<i, j, mod), mod);
+				}
+			}
+		}
+		return sum;
+	}
+}
+
+#pragma GCC diagnostic pop
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef MERSENNETWISTER_H
+#define MERSENNETWISTER_H
+
+#include "stdint.h"
+#include <stddef.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Mersenne Twister random number generator implemented from Wikipedia
+//
+// This is the keystream for the sketches, so the output has to stay exactly
+// what it has always been, including where it differs from the reference
+// MT19937: the twist takes the top bit of MT[i] as bit 0 and masks MT[i+1]
+// with 0x8FFFFFFF, treats the sum as signed, and the tempering shifts by 11
+// where the reference uses 7. Both sides run the same code so it doesn't
+// matter for talking to each other, but it does mean reference test vectors
+// don't apply.
+//
+// fill(out, n) gives the same words as n calls to next_uint32(), for the host
+// side tools (simulators, test vector generation). On x86 the twist and the
+// tempering run 4 words at a time with SSE2 or 8 with AVX2, picked at runtime
+// from what the CPU supports. Anywhere else, including the AVR, it's the
+// scalar loop.
+//
+// next_uint32() twists each word just before it tempers it, rather than
+// twisting all 624 at once every 624th call. The twist goes through the words
+// in the same order either way and each word is written once, so every word
+// sees exactly the inputs it did before and the output is unchanged. What
+// changes is that no one call does more than one word of the twist, so there
+// is no stall in the middle of encrypting a message. twisted marks how far
+// through the current round the twist has got, since fill() still twists a
+// whole round at a time.
+//
+// Seeding is lazy the same way. seed() only sets MT[0], and the rest of the
+// state is expanded from it as the twist first reads each word (expanded
+// marks how far it has got). The first word after a seed needs MT[0..397],
+// after that it's a word per call, so a generator that gets seeded and then
+// reseeded or never used, like the default seed in the constructor or
+// make_key's seed before start_session, never pays for the words it didn't
+// use. This replaces keeping the default state in flash: the constructor is
+// now as cheap as reading it from a table would be, without the 2.5 KB.
+//
+// The cost is in the first next_uint32() after each seed(), which does all of
+// MT[1..397] at once (about 2000 cycles on the host, against under 100 for
+// every call after it) and so is the slowest single call there is. It can't
+// be spread over later calls, since word 0 can't be twisted without
+// MT[397]. It's still less than the whole twist the incremental twist got
+// rid of, and only once per seed; in the sketches that's once per session,
+// and Keystream's prefetch() asks for that first word while loop() is idle
+// after start_session, before any message needs it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+enum MTKernel {
+	MTScalar,
+	MTSse2,
+	MTAvx2,
+};
+
+inline const char* mt_kernel_name(MTKernel kernel) {
+	switch (kernel) {
+	case MTAvx2: return "avx2";
+	case MTSse2: return "sse2";
+	default: return "scalar";
+	}
+}
+
+inline uint32_t mt_temper(uint32_t y) {
+	y ^= (y>>11);
+	y ^= ((y<<11) & 0x9D2C5680);
+	y ^= ((y<<15) & 0xEFC60000);
+	y ^= (y>>18);
+	return y;
+}
+
+// one word of the twist, reading the words after it in whatever state
+// they're in, which is what makes the in place update come out right
+inline uint32_t mt_twist_word(uint32_t cur, uint32_t next, uint32_t far) {
+	int32_t y = (cur>>31) + (0x8FFFFFFF & next);
+	uint32_t v = far ^ (y>>1);
+	if (y%2 != 0) {
+		v ^= 0x9908B0DF;
+	}
+	return v;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MT_SIMD 1
+#include <immintrin.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The twist writes MT[i] from MT[i+1] and MT[i+397], so a block of words
+// only depends on words outside the block:
+//  - i < 227 reads old MT[i+1..] and old MT[i+397..], none written yet.
+//  - 227 <= i < 623 reads MT[i-227..], written by an earlier block, since the
+//    distance (227) is bigger than a vector.
+//  - i = 623 wraps round to the new MT[0] and is done on its own.
+// Per lane the signed y>>1 is an arithmetic shift, and y%2 != 0 is just the
+// low bit, turned into an all ones mask for the 0x9908B0DF.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("sse2")))
+inline __m128i mt_twist_sse2_vec(__m128i cur, __m128i next, __m128i far) {
+	const __m128i mask = _mm_set1_epi32(0x8FFFFFFF);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i matrix = _mm_set1_epi32(0x9908B0DF);
+	__m128i y = _mm_add_epi32(_mm_srli_epi32(cur, 31), _mm_and_si128(next, mask));
+	__m128i odd = _mm_cmpeq_epi32(_mm_and_si128(y, one), one);
+	return _mm_xor_si128(_mm_xor_si128(far, _mm_srai_epi32(y, 1)), _mm_and_si128(odd, matrix));
+}
+
+__attribute__((target("sse2")))
+inline void mt_twist_sse2(uint32_t* MT) {
+	uint16_t i = 0;
+	for (; i + 4 <= 227; i += 4) {
+		__m128i v = mt_twist_sse2_vec(_mm_loadu_si128((const __m128i*)(MT + i)),
+			_mm_loadu_si128((const __m128i*)(MT + i + 1)),
+			_mm_loadu_si128((const __m128i*)(MT + i + 397)));
+		_mm_storeu_si128((__m128i*)(MT + i), v);
+	}
+	for (; i < 227; ++i)
+		MT[i] = mt_twist_word(MT[i], MT[i+1], MT[i+397]);
+	for (; i + 4 <= 623; i += 4) {
+		__m128i v = mt_twist_sse2_vec(_mm_loadu_si128((const __m128i*)(MT + i)),
+			_mm_loadu_si128((const __m128i*)(MT + i + 1)),
+			_mm_loadu_si128((const __m128i*)(MT + i - 227)));
+		_mm_storeu_si128((__m128i*)(MT + i), v);
+	}
+	for (; i < 623; ++i)
+		MT[i] = mt_twist_word(MT[i], MT[i+1], MT[i-227]);
+	MT[623] = mt_twist_word(MT[623], MT[0], MT[396]);
+}
+
+__attribute__((target("sse2")))
+inline void mt_temper_sse2(const uint32_t* in, uint32_t* out, size_t n) {
+	const __m128i b = _mm_set1_epi32(0x9D2C5680);
+	const __m128i c = _mm_set1_epi32(0xEFC60000);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i y = _mm_loadu_si128((const __m128i*)(in + i));
+		y = _mm_xor_si128(y, _mm_srli_epi32(y, 11));
+		y = _mm_xor_si128(y, _mm_and_si128(_mm_slli_epi32(y, 11), b));
+		y = _mm_xor_si128(y, _mm_and_si128(_mm_slli_epi32(y, 15), c));
+		y = _mm_xor_si128(y, _mm_srli_epi32(y, 18));
+		_mm_storeu_si128((__m128i*)(out + i), y);
+	}
+	for (; i < n; ++i)
+		out[i] = mt_temper(in[i]);
+}
+
+__attribute__((target("avx2")))
+inline __m256i mt_twist_avx2_vec(__m256i cur, __m256i next, __m256i far) {
+	const __m256i mask = _mm256_set1_epi32(0x8FFFFFFF);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i matrix = _mm256_set1_epi32(0x9908B0DF);
+	__m256i y = _mm256_add_epi32(_mm256_srli_epi32(cur, 31), _mm256_and_si256(next, mask));
+	__m256i odd = _mm256_cmpeq_epi32(_mm256_and_si256(y, one), one);
+	return _mm256_xor_si256(_mm256_xor_si256(far, _mm256_srai_epi32(y, 1)),
+		_mm256_and_si256(odd, matrix));
+}
+
+__attribute__((target("avx2")))
+inline void mt_twist_avx2(uint32_t* MT) {
+	uint16_t i = 0;
+	for (; i + 8 <= 227; i += 8) {
+		__m256i v = mt_twist_avx2_vec(_mm256_loadu_si256((const __m256i*)(MT + i)),
+			_mm256_loadu_si256((const __m256i*)(MT + i + 1)),
+			_mm256_loadu_si256((const __m256i*)(MT + i + 397)));
+		_mm256_storeu_si256((__m256i*)(MT + i), v);
+	}
+	for (; i < 227; ++i)
+		MT[i] = mt_twist_word(MT[i], MT[i+1], MT[i+397]);
+	for (; i + 8 <= 623; i += 8) {
+		__m256i v = mt_twist_avx2_vec(_mm256_loadu_si256((const __m256i*)(MT + i)),
+			_mm256_loadu_si256((const __m256i*)(MT + i + 1)),
+			_mm256_loadu_si256((const __m256i*)(MT + i - 227)));
+		_mm256_storeu_si256((__m256i*)(MT + i), v);
+	}
+	for (; i < 623; ++i)
+		MT[i] = mt_twist_word(MT[i], MT[i+1], MT[i-227]);
+	MT[623] = mt_twist_word(MT[623], MT[0], MT[396]);
+}
+
+__attribute__((target("avx2")))
+inline void mt_temper_avx2(const uint32_t* in, uint32_t* out, size_t n) {
+	const __m256i b = _mm256_set1_epi32(0x9D2C5680);
+	const __m256i c = _mm256_set1_epi32(0xEFC60000);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i y = _mm256_loadu_si256((const __m256i*)(in + i));
+		y = _mm256_xor_si256(y, _mm256_srli_epi32(y, 11));
+		y = _mm256_xor_si256(y, _mm256_and_si256(_mm256_slli_epi32(y, 11), b));
+		y = _mm256_xor_si256(y, _mm256_and_si256(_mm256_slli_epi32(y, 15), c));
+		y = _mm256_xor_si256(y, _mm256_srli_epi32(y, 18));
+		_mm256_storeu_si256((__m256i*)(out + i), y);
+	}
+	for (; i < n; ++i)
+		out[i] = mt_temper(in[i]);
+}
+
+#else
+#define MT_SIMD 0
+#endif
+
+// best kernel this CPU can run
+inline MTKernel mt_kernel() {
+#if MT_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return MTAvx2;
+	if (__builtin_cpu_supports("sse2"))
+		return MTSse2;
+#endif
+	return MTScalar;
+}
+
+class MersenneTwister {
+public:
+	MersenneTwister(): index(0), twisted(0) {
+		seed(0xDEADB08F);
+	}
+	//
+	void seed(uint32_t seed) {
+		index = 0;
+		twisted = 0;
+		MT[0] = seed;
+		expanded = 1;
+	}
+	//
+	uint32_t next_uint32() {
+		if (index == twisted)
+			twist_next();
+		//
+		uint32_t y = mt_temper(MT[index]);
+		//
+		if (++index == 624) {
+			index = 0;
+			twisted = 0;
+		}
+		return y;
+	}
+
+	//
+	// discard:
+	// Skips the next n words, the same as n calls to next_uint32(). The twist
+	// here isn't linear over GF(2) (the signed add can carry out of bit 0), so
+	// there's no jump polynomial to use; it's the twist replayed, a whole
+	// round at a time where it can be, without the tempering.
+	//
+	void discard(uint32_t n) {
+		while (n > 0) {
+			if (index == 0 && twisted == 0 && n >= 624) {
+				update();
+				n -= 624;
+				continue;
+			}
+			if (index == twisted)
+				twist_next();
+			if (++index == 624) {
+				index = 0;
+				twisted = 0;
+			}
+			--n;
+		}
+	}
+
+	//
+	// fill:
+	// The next n words, same as calling next_uint32() n times, on the fastest
+	// kernel available.
+	//
+	void fill(uint32_t* out, size_t n) {
+		static const MTKernel kernel = mt_kernel();
+		fill_with(kernel, out, n);
+	}
+
+	// fill with the kernel given explicitly (for the benchmark and tests).
+	// Asking for a kernel the CPU can't run is the caller's problem.
+	void fill_with(MTKernel kernel, uint32_t* out, size_t n) {
+		while (n > 0) {
+			if (twisted == 0) {
+				twist(kernel);
+				twisted = 624;
+			}
+			// next_uint32() left the round part way through the twist
+			while (twisted < 624)
+				twist_next();
+			size_t count = 624 - index;
+			if (count > n)
+				count = n;
+			temper(kernel, MT + index, out, count);
+			out += count;
+			n -= count;
+			index += count;
+			if (index == 624) {
+				index = 0;
+				twisted = 0;
+			}
+		}
+	}
+
+private:
+	// fills in the state from the seed up to (not including) MT[upto]
+	void expand(uint16_t upto) {
+		if (upto > 624)
+			upto = 624;
+		for (uint16_t i = expanded; i < upto; ++i) {
+			uint64_t v = MT[i-1];
+			MT[i] = (0x6C078965*(v ^ (v>>30)) + i);
+		}
+		if (upto > expanded)
+			expanded = upto;
+	}
+
+	void update() {
+		expand(624);
+		for (uint16_t i = 0; i < 624; ++i) {
+			MT[i] = mt_twist_word(MT[i], MT[(i+1)%624], MT[(i+397)%624]);
+		}
+	}
+
+	// twists the next word of the round, the same as update() does for it
+	void twist_next() {
+		uint16_t i = twisted;
+		// word i reads up to MT[i+397] in the first 227, by which point it's
+		// all there
+		if (expanded < 624)
+			expand(i + 398);
+		uint16_t next = (i == 623) ? 0 : i + 1;
+		uint16_t far = (i < 227) ? i + 397 : i - 227;
+		MT[i] = mt_twist_word(MT[i], MT[next], MT[far]);
+		++twisted;
+	}
+
+	void twist(MTKernel kernel) {
+		expand(624);
+		switch (kernel) {
+#if MT_SIMD
+		case MTAvx2:
+			mt_twist_avx2(MT);
+			break;
+		case MTSse2:
+			mt_twist_sse2(MT);
+			break;
+#endif
+		default:
+			update();
+			break;
+		}
+	}
+
+	static void temper(MTKernel kernel, const uint32_t* in, uint32_t* out, size_t n) {
+		switch (kernel) {
+#if MT_SIMD
+		case MTAvx2:
+			mt_temper_avx2(in, out, n);
+			break;
+		case MTSse2:
+			mt_temper_sse2(in, out, n);
+			break;
+#endif
+		default:
+			for (size_t i = 0; i < n; ++i)
+				out[i] = mt_temper(in[i]);
+			break;
+		}
+	}
+
+	uint32_t MT[624];
+	uint16_t index;
+	uint16_t twisted;
+	uint16_t expanded;
+};
+
+#endif
@@ -0,0 +1,599 @@
+#ifndef MODARITH_H
+#define MODARITH_H
+
+#include "stdint.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+// no separate flash address space on the host
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Modular arithmetic shared between the sketches and the host side tools.
+// Everything in here is written to run without any divisions on the hot path,
+// since a 32 bit % on the AVR is a slow software routine.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Plain modular add and multiply for any modulus up to 0xFFFFFFFF, with no
+// intermediate value ever needing more than 32 bits. mul_mod uses the native
+// 64 bit product when the target has 64 bit registers (a single multiply and
+// divide), and an O(32) double and add loop everywhere else.
+// The modulus must not be 0.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MODARITH_NATIVE_MUL
+#if defined(UINTPTR_MAX) && UINTPTR_MAX > 0xFFFFFFFF
+#define MODARITH_NATIVE_MUL 1
+#else
+#define MODARITH_NATIVE_MUL 0
+#endif
+#endif
+
+//
+// add_mod:
+// (a + b) mod n for a, b < n. a + b >= n exactly when a >= n - b, which can
+// be checked without the sum overflowing.
+//
+inline uint32_t add_mod(uint32_t a, uint32_t b, uint32_t mod) {
+	uint32_t gap = mod - b;
+	return (a >= gap) ? a - gap : a + b;
+}
+
+//
+// mul_mod_double_add:
+// a*b mod n, scanning b from the top: double the running sum, and add a in
+// for each 1 bit. 32 rounds of at most two add_mods.
+//
+inline uint32_t mul_mod_double_add(uint32_t a, uint32_t b, uint32_t mod) {
+	a %= mod;
+	uint32_t sum = 0;
+	for (int8_t i = 31; i >= 0; --i) {
+		sum = add_mod(sum, sum, mod);
+		if ((b >> i) & 0x1)
+			sum = add_mod(sum, a, mod);
+	}
+	return sum;
+}
+
+// a*b mod n with the 64 bit product, one multiply and one divide
+inline uint32_t mul_mod_native(uint32_t a, uint32_t b, uint32_t mod) {
+	return ((uint64_t)a * b) % mod;
+}
+
+//
+// mul_mod:
+// a*b mod n for any a, b and any non-zero n, using the best engine for the
+// target.
+//
+inline uint32_t mul_mod(uint32_t a, uint32_t b, uint32_t mod) {
+#if MODARITH_NATIVE_MUL
+	return mul_mod_native(a, b, mod);
+#else
+	return mul_mod_double_add(a, b, mod);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Montgomery-domain arithmetic for odd 32 bit moduli.
+// Numbers are held as a*R mod n with R = 2^32, so a multiply is a 32x32 bit
+// product followed by a reduction that only needs shifts and multiplies.
+// Building the context costs two divisions (for R and R^2 mod n), after that
+// an entire exponentiation runs division free.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+class MontgomeryMod {
+public:
+	typedef uint32_t Word;
+
+	MontgomeryMod(): Modulus(0), NPrime(0), R1(0), R2(0) {}
+	explicit MontgomeryMod(uint32_t mod) { set_modulus(mod); }
+
+	// Precompute R mod n, R^2 mod n and n' = -n^-1 mod R for a new modulus
+	void set_modulus(uint32_t mod) {
+		Modulus = mod;
+		NPrime = 0;
+		R1 = 0;
+		R2 = 0;
+		if (!valid())
+			return;
+
+		// Newton iteration for n^-1 mod 2^32. n*n = 1 mod 8 for any odd n so
+		// we start with 3 correct bits, and each step doubles them.
+		uint32_t inv = mod;
+		for (uint8_t i = 0; i < 4; ++i)
+			inv *= 2 - mod*inv;
+		NPrime = -inv;
+
+		// 2^32 mod n == (2^32 - n) mod n, which fits in 32 bits
+		R1 = ((uint32_t)-mod) % mod;
+		R2 = ((uint64_t)R1 * R1) % mod;
+	}
+
+	// Montgomery only works for odd moduli
+	bool valid() const { return Modulus & 1; }
+
+	uint32_t modulus() const { return Modulus; }
+
+	// 1 in the Montgomery domain
+	uint32_t one() const { return R1; }
+
+	// constants for code that does its own reductions (the SIMD batch kernels)
+	uint32_t n_prime() const { return NPrime; }
+	uint32_t r_squared() const { return R2; }
+
+	// Move a number into the Montgomery domain. a doesn't have to be reduced
+	// first, since a*R^2 < n*R still reduces correctly.
+	uint32_t to_domain(uint32_t a) const { return redc((uint64_t)a * R2); }
+
+	// Move a number back out of the Montgomery domain
+	uint32_t from_domain(uint32_t a) const { return redc(a); }
+
+	// Multiply two numbers that are in the Montgomery domain
+	uint32_t mul(uint32_t a, uint32_t b) const { return redc((uint64_t)a * b); }
+
+private:
+	// Montgomery reduction: t*R^-1 mod n for any t < n*R
+	uint32_t redc(uint64_t t) const {
+		uint32_t m = (uint32_t)t * NPrime;
+		uint64_t u = t + (uint64_t)m * Modulus;
+
+		// for moduli close to 2^32 the sum can carry out of 64 bits, in which
+		// case the real value is 2^32 + hi, and is always >= n.
+		bool carry = u < t;
+		uint32_t hi = u >> 32;
+		if (carry || hi >= Modulus)
+			hi -= Modulus;
+		return hi;
+	}
+
+	uint32_t Modulus;
+	uint32_t NPrime;
+	uint32_t R1;
+	uint32_t R2;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Barrett reduction for any 32 bit modulus.
+// Keeps mu = floor((2^64-1) / n) so that x mod n can be found as
+// x - floor(x*mu / 2^64)*n, which is off by at most 2n. Unlike Montgomery this
+// works for even moduli too, and numbers stay in their normal form.
+// Building the context costs one 64 bit division.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// high 64 bits of a 64x64 bit product
+inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+	return ((unsigned __int128)a * b) >> 64;
+#else
+	// schoolbook on 32 bit halves, for targets without a 128 bit type
+	uint64_t a0 = (uint32_t)a, a1 = a >> 32;
+	uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+	uint64_t lo = a0*b0;
+	uint64_t mid1 = a1*b0;
+	uint64_t mid2 = a0*b1;
+	uint64_t carry = ((lo >> 32) + (uint32_t)mid1 + (uint32_t)mid2) >> 32;
+	return a1*b1 + (mid1 >> 32) + (mid2 >> 32) + carry;
+#endif
+}
+
+class BarrettMod {
+public:
+	typedef uint32_t Word;
+
+	BarrettMod(): Modulus(0), Mu(0) {}
+	explicit BarrettMod(uint32_t mod) { set_modulus(mod); }
+
+	void set_modulus(uint32_t mod) {
+		Modulus = mod;
+		Mu = mod ? 0xFFFFFFFFFFFFFFFFull / mod : 0;
+	}
+
+	// the modulus can be anything other than 0
+	bool valid() const { return Modulus != 0; }
+
+	uint32_t modulus() const { return Modulus; }
+	uint32_t one() const { return reduce(1); }
+	uint32_t to_domain(uint32_t a) const { return reduce(a); }
+	uint32_t from_domain(uint32_t a) const { return a; }
+
+	uint32_t mul(uint32_t a, uint32_t b) const { return reduce((uint64_t)a * b); }
+
+	// x mod n for any 64 bit x
+	uint32_t reduce(uint64_t x) const {
+		uint64_t r = x - mul_hi64(x, Mu) * Modulus;
+		while (r >= Modulus)
+			r -= Modulus;
+		return r;
+	}
+
+private:
+	uint32_t Modulus;
+	uint64_t Mu;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Montgomery arithmetic for odd 64 bit moduli, R = 2^64, for the 64 bit key
+// size. The same as MontgomeryMod one size up: products are 128 bits, kept
+// as a (hi, lo) pair so that mul_hi64 can do the work on targets without a
+// 128 bit type.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+class MontgomeryMod64 {
+public:
+	typedef uint64_t Word;
+
+	MontgomeryMod64(): Modulus(0), NPrime(0), R1(0), R2(0) {}
+	explicit MontgomeryMod64(uint64_t mod) { set_modulus(mod); }
+
+	void set_modulus(uint64_t mod) {
+		Modulus = mod;
+		NPrime = 0;
+		R1 = 0;
+		R2 = 0;
+		if (!valid())
+			return;
+
+		// 3 correct bits to start with, doubling to 96 after 5 steps
+		uint64_t inv = mod;
+		for (uint8_t i = 0; i < 5; ++i)
+			inv *= 2 - mod*inv;
+		NPrime = -inv;
+
+		// R^2 mod n would need a 128 bit %, so double R mod n up 64 times instead
+		R1 = ((uint64_t)-mod) % mod;
+		R2 = R1;
+		for (uint8_t i = 0; i < 64; ++i)
+			R2 = add(R2, R2);
+	}
+
+	bool valid() const { return Modulus & 1; }
+
+	uint64_t modulus() const { return Modulus; }
+	uint64_t one() const { return R1; }
+
+	// a*R^2 < n*R for any 64 bit a, so a doesn't have to be reduced first
+	uint64_t to_domain(uint64_t a) const { return mul(a, R2); }
+	uint64_t from_domain(uint64_t a) const { return redc(0, a); }
+
+	uint64_t mul(uint64_t a, uint64_t b) const { return redc(mul_hi64(a, b), a * b); }
+
+private:
+	// a + b mod n for a, b < n
+	uint64_t add(uint64_t a, uint64_t b) const {
+		uint64_t s = a + b;
+		if (s < a || s >= Modulus)
+			s -= Modulus;
+		return s;
+	}
+
+	// (hi*2^64 + lo)*R^-1 mod n, for hi < n
+	uint64_t redc(uint64_t hi, uint64_t lo) const {
+		uint64_t m = lo * NPrime;
+
+		// lo + m*n is 0 in the low 64 bits by construction, it only carries
+		// into the high half when lo != 0
+		uint64_t r = hi + mul_hi64(m, Modulus);
+		bool carry = r < hi;
+		if (lo) {
+			++r;
+			carry |= r == 0;
+		}
+
+		// the real result is below 2n, so one subtract is enough even when
+		// the sum wrapped past 2^64
+		if (carry || r >= Modulus)
+			r -= Modulus;
+		return r;
+	}
+
+	uint64_t Modulus;
+	uint64_t NPrime;
+	uint64_t R1;
+	uint64_t R2;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// ModArith<Modulus>: arithmetic specialised on a modulus that is known at
+// compile time. The reduction is picked from the shape of the modulus:
+//  - Mersenne (2^k - 1): fold the high bits onto the low bits with a shift,
+//    a mask and an add.
+//  - Pseudo-Mersenne (2^k - c, small c): same fold, with the high bits
+//    multiplied by c.
+//  - Anything else: a % by a constant, which the compiler can strength reduce.
+// ModArith<> (Modulus == 0) is the runtime version, for parameters that came
+// in off the wire.
+//
+// All of the arithmetic types share the same interface so that pow_mod and
+// mul_mod can be templates over them:
+//  Word, one(), to_domain(a), from_domain(a), mul(a, b), modulus()
+// Word is the type of the numbers (uint32_t for all but MontgomeryMod64).
+// mul() expects both arguments to be in the domain (and so already reduced).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+enum ModReduction {
+	GenericReduction,
+	MersenneReduction,
+	PseudoMersenneReduction,
+};
+
+// number of bits needed to hold m
+constexpr uint8_t mod_bits(uint32_t m) {
+	return m ? 1 + mod_bits(m >> 1) : 0;
+}
+
+// c such that m = 2^bits(m) - c
+constexpr uint64_t mod_offset(uint32_t m) {
+	return (1ull << mod_bits(m)) - m;
+}
+
+// The fold only takes 3 rounds when c*(c+1) < 2^k, so keep c under 2^(k/2)
+constexpr ModReduction mod_reduction(uint32_t m) {
+	return (m < 3) ? GenericReduction :
+	       (mod_offset(m) == 1) ? MersenneReduction :
+	       (mod_offset(m) < (1ull << ((mod_bits(m) - 1) / 2))) ? PseudoMersenneReduction :
+	       GenericReduction;
+}
+
+// Reduction of a product x < m^2 for each shape of modulus
+template <uint32_t Modulus, ModReduction Kind = mod_reduction(Modulus)>
+struct ModReduce {
+	static uint32_t reduce(uint64_t x) {
+		// for 16 bit moduli the product fits a 32 bit %, which is a lot
+		// cheaper than the 64 bit one on the AVR
+		if (Modulus <= 0x10000)
+			return (uint32_t)x % Modulus;
+		return x % Modulus;
+	}
+};
+
+template <uint32_t Modulus>
+struct ModReduce<Modulus, MersenneReduction> {
+	static uint32_t reduce(uint64_t x) {
+		// 2^k = 1 (mod m), so the bits above k can just be added back on
+		const uint8_t Bits = mod_bits(Modulus);
+		uint64_t r = (x & Modulus) + (x >> Bits);
+		r = (r & Modulus) + (r >> Bits);
+		if (r >= Modulus)
+			r -= Modulus;
+		return r;
+	}
+};
+
+template <uint32_t Modulus>
+struct ModReduce<Modulus, PseudoMersenneReduction> {
+	static uint32_t reduce(uint64_t x) {
+		// 2^k = c (mod m), so the bits above k get multiplied by c and added
+		const uint8_t Bits = mod_bits(Modulus);
+		const uint64_t Mask = (1ull << Bits) - 1;
+		const uint64_t Offset = mod_offset(Modulus);
+		uint64_t r = (x & Mask) + (x >> Bits) * Offset;
+		r = (r & Mask) + (r >> Bits) * Offset;
+		r = (r & Mask) + (r >> Bits) * Offset;
+		if (r >= Modulus)
+			r -= Modulus;
+		return r;
+	}
+};
+
+template <uint32_t Modulus = 0>
+class ModArith {
+public:
+	typedef uint32_t Word;
+	static const ModReduction Reduction = mod_reduction(Modulus);
+
+	uint32_t modulus() const { return Modulus; }
+	uint32_t one() const { return 1 % Modulus; }
+
+	// only happens once per pow_mod, so a % by a constant is fine here
+	uint32_t to_domain(uint32_t a) const { return a % Modulus; }
+	uint32_t from_domain(uint32_t a) const { return a; }
+
+	uint32_t mul(uint32_t a, uint32_t b) const {
+		return ModReduce<Modulus>::reduce((uint64_t)a * b);
+	}
+};
+
+//
+// Runtime modulus, built once when the parameters are set and then cached.
+// Uses Montgomery for odd moduli (any prime we'd actually be sent), and
+// Barrett for the rest, so no modulus ever needs a division per multiply.
+//
+template <>
+class ModArith<0> {
+public:
+	typedef uint32_t Word;
+
+	ModArith() {}
+	explicit ModArith(uint32_t mod) { set_modulus(mod); }
+
+	void set_modulus(uint32_t mod) {
+		Mont.set_modulus(mod);
+		Barrett.set_modulus(Mont.valid() ? 0 : mod);
+	}
+
+	uint32_t modulus() const {
+		return Mont.valid() ? Mont.modulus() : Barrett.modulus();
+	}
+
+	uint32_t one() const {
+		if (Mont.valid())
+			return Mont.one();
+		return Barrett.valid() ? Barrett.one() : 0;
+	}
+
+	uint32_t to_domain(uint32_t a) const {
+		if (Mont.valid())
+			return Mont.to_domain(a);
+		return Barrett.valid() ? Barrett.to_domain(a) : 0;
+	}
+
+	uint32_t from_domain(uint32_t a) const {
+		if (Mont.valid())
+			return Mont.from_domain(a);
+		return a;
+	}
+
+	uint32_t mul(uint32_t a, uint32_t b) const {
+		if (Mont.valid())
+			return Mont.mul(a, b);
+		return Barrett.valid() ? Barrett.mul(a, b) : 0;
+	}
+
+private:
+	MontgomeryMod Mont;
+	BarrettMod Barrett;
+};
+
+//
+// mul_mod
+// a*b mod n using any of the arithmetic types above
+//
+template <class Arith>
+typename Arith::Word mul_mod(typename Arith::Word a, typename Arith::Word b, const Arith& arith) {
+	return arith.from_domain(arith.mul(arith.to_domain(a), arith.to_domain(b)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Sliding window exponentiation.
+// The exponent is scanned from the top in windows of up to k bits that start
+// and end on a 1 bit, so a 32 bit exponent costs ~32 squarings plus ~32/(k+1)
+// multiplies instead of the ~16 multiplies of plain square and multiply.
+// The window table holds the 2^(k-1) odd powers of the base on the stack,
+// one Word each. For 32 bit exponents k = 3 is the sweet spot (16 bytes of
+// SRAM, ~40 multiplies on average counting the table, instead of ~45 for
+// plain left to right binary), bigger windows only pay off for the longer
+// exponents.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef POW_MOD_WINDOW
+#define POW_MOD_WINDOW 3
+#endif
+
+template <uint8_t Window, class Arith>
+typename Arith::Word pow_mod_window(typename Arith::Word base, typename Arith::Word exponent,
+                                    const Arith& arith) {
+	typedef typename Arith::Word Word;
+	static_assert(Window >= 1 && Window <= 6, "pow_mod window must be 1 to 6 bits");
+	if (exponent == 0)
+		return arith.from_domain(arith.one());
+
+	// odd powers of the base: Table[i] = base^(2i+1)
+	Word Table[1 << (Window - 1)];
+	Table[0] = arith.to_domain(base);
+	if (Window > 1) {
+		Word square = arith.mul(Table[0], Table[0]);
+		for (uint8_t i = 1; i < (1 << (Window - 1)); ++i)
+			Table[i] = arith.mul(Table[i-1], square);
+	}
+
+	int8_t place = sizeof(Word)*8 - 1;
+	while (!((exponent >> place) & 0x1))
+		--place;
+
+	Word result = arith.one();
+	bool started = false;
+	while (place >= 0) {
+		if (!((exponent >> place) & 0x1)) {
+			// zero bits between windows are just a squaring each
+			result = arith.mul(result, result);
+			--place;
+			continue;
+		}
+
+		// take the longest window starting here that ends on a 1 bit
+		int8_t low = place - Window + 1;
+		if (low < 0)
+			low = 0;
+		while (!((exponent >> low) & 0x1))
+			++low;
+		uint8_t width = place - low + 1;
+		uint8_t value = (exponent >> low) & ((1 << width) - 1);
+
+		if (started) {
+			for (uint8_t i = 0; i < width; ++i)
+				result = arith.mul(result, result);
+			result = arith.mul(result, Table[value >> 1]);
+		} else {
+			// nothing to square yet for the first window
+			result = Table[value >> 1];
+			started = true;
+		}
+		place = low - 1;
+	}
+	return arith.from_domain(result);
+}
+
+//
+// pow_mod
+// base^exponent mod n using any of the arithmetic types above
+//
+template <class Arith>
+typename Arith::Word pow_mod(typename Arith::Word base, typename Arith::Word exponent,
+                             const Arith& arith) {
+	return pow_mod_window<POW_MOD_WINDOW>(base, exponent, arith);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Fixed base exponentiation for a known (generator, prime) pair.
+// The table holds g^(d * 16^j) mod p for every 4 bit digit d and digit
+// position j of a 32 bit exponent, so g^e is just the product of one entry
+// per non-zero digit of e: at most 7 multiplies and no squarings.
+// Tables are 120 entries (480 bytes) each, kept in flash, and are generated
+// by FixedBaseGen.cpp into FixedBaseTables.h.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const uint8_t FixedBaseDigitBits = 4;
+const uint8_t FixedBaseDigits = 32 / FixedBaseDigitBits;
+const uint8_t FixedBaseRowLen = (1 << FixedBaseDigitBits) - 1;
+const uint8_t FixedBaseTableLen = FixedBaseDigits * FixedBaseRowLen;
+
+// entry for digit d (1..15) at position j
+inline uint32_t fixed_base_entry(const uint32_t* table, uint8_t j, uint8_t d) {
+	return pgm_read_dword(&table[j*FixedBaseRowLen + d - 1]);
+}
+
+//
+// fixed_base_pow_mod
+// The table entries are plain residues, so this needs one of the compile time
+// ModArith<Modulus> types, whose domain is the numbers themselves.
+//
+template <class Arith>
+uint32_t fixed_base_pow_mod(const uint32_t* table, uint32_t exponent, const Arith& arith) {
+	uint32_t result = arith.one();
+	bool started = false;
+	for (uint8_t j = 0; exponent; ++j, exponent >>= FixedBaseDigitBits) {
+		uint8_t digit = exponent & FixedBaseRowLen;
+		if (!digit)
+			continue;
+		if (started) {
+			result = arith.mul(result, fixed_base_entry(table, j, digit));
+		} else {
+			result = fixed_base_entry(table, j, digit);
+			started = true;
+		}
+	}
+	return result;
+}
+
+#endif
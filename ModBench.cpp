@@ -0,0 +1,93 @@
+
+#include <iostream>
+#include <cstring>
+#include "stdint.h"
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Host side benchmark for the modular exponentiation used by the handshake.
+// Build with: g++ -O2 ModBench.cpp -o ModBench
+// Run as:     ./ModBench [area ...]   (all of them by default)
+//
+// The benches are split by area into ModBenchArith.h, ModBenchGroups.h and
+// ModBenchKeystream.h, each with a bench_<area>() that runs its benches in
+// order, and listed in BenchAreas below.
+// Note that x86 has a hardware divider, so the "64 bit %" rows are far
+// cheaper here than on the AVR, where every % is a software loop.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// cycle counter, falls back to nanoseconds where there's no TSC
+uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+double now_ms() {
+	return std::chrono::duration_cast<std::chrono::duration<double, std::milli> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// small deterministic generator for the inputs, so runs are comparable
+uint32_t bench_state = 0x12345678;
+uint32_t bench_rand() {
+	bench_state ^= bench_state << 13;
+	bench_state ^= bench_state >> 17;
+	bench_state ^= bench_state << 5;
+	return bench_state;
+}
+
+// p-th percentile of the latencies, sorting them in place
+uint64_t percentile(std::vector<uint64_t>& v, double p) {
+	std::sort(v.begin(), v.end());
+	return v[(size_t)(p * (v.size() - 1))];
+}
+
+#include "ModBenchArith.h"
+#include "ModBenchGroups.h"
+#include "ModBenchKeystream.h"
+
+struct BenchArea {
+	const char* Name;
+	void (*Run)();
+};
+
+const BenchArea BenchAreas[] = {
+	{ "arith", &bench_arith },
+	{ "groups", &bench_groups },
+	{ "keystream", &bench_keystream },
+};
+const int BenchAreaCount = sizeof(BenchAreas) / sizeof(BenchAreas[0]);
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		bool known = false;
+		for (int a = 0; a < BenchAreaCount; ++a)
+			known |= !strcmp(argv[i], BenchAreas[a].Name);
+		if (!known) {
+			std::cerr << "unknown area " << argv[i] << ", one of:";
+			for (int a = 0; a < BenchAreaCount; ++a)
+				std::cerr << " " << BenchAreas[a].Name;
+			std::cerr << "\n";
+			return 2;
+		}
+	}
+	for (int a = 0; a < BenchAreaCount; ++a) {
+		bool wanted = argc == 1;
+		for (int i = 1; i < argc; ++i)
+			wanted |= !strcmp(argv[i], BenchAreas[a].Name);
+		if (wanted)
+			BenchAreas[a].Run();
+	}
+}
@@ -0,0 +1,337 @@
+#ifndef MODBENCHARITH_H
+#define MODBENCHARITH_H
+
+#include "ModArith.h"
+#include "FixedBaseTables.h"
+#include "PowModBatch.h"
+#include "LegacyMod.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Benches for the 32 bit modular arithmetic: pow_mod against the legacy
+// loops for fixed and runtime moduli, window sizes, the fixed base tables,
+// full range mul_mod and the batch kernels.
+// Part of ModBench.cpp, which includes it after its timing helpers
+// (cycles(), now_ms(), bench_rand(), percentile()). Add new benches here and
+// to bench_arith() at the bottom, rather than to ModBench's main().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// what the legacy loop was meant to do: shift and add, with a % per bit
+uint32_t shift_add_mul_mod(uint32_t a, uint32_t b, uint32_t mod) {
+	uint32_t sum = 0;
+	uint32_t v = a % mod;
+	for (; b; b >>= 1) {
+		if (b & 1)
+			sum = ((uint64_t)sum + v) % mod;
+		v = ((uint64_t)v << 1) % mod;
+	}
+	return sum;
+}
+
+uint32_t shift_add_pow_mod(uint32_t base, uint32_t exponent, uint32_t modulus) {
+	uint32_t result = 1 % modulus;
+	uint32_t factor = base % modulus;
+	for (; exponent; exponent >>= 1) {
+		if (exponent & 0x1)
+			result = shift_add_mul_mod(result, factor, modulus);
+		factor = shift_add_mul_mod(factor, factor, modulus);
+	}
+	return result;
+}
+
+// reference result, native 64 bit products
+uint32_t reference_pow_mod(uint32_t base, uint32_t exponent, uint32_t modulus) {
+	uint64_t result = 1 % modulus;
+	uint64_t factor = base % modulus;
+	for (; exponent; exponent >>= 1) {
+		if (exponent & 0x1)
+			result = (result * factor) % modulus;
+		factor = (factor * factor) % modulus;
+	}
+	return result;
+}
+
+const int Samples = 2000;
+uint32_t Bases[Samples];
+uint32_t Exponents[Samples];
+uint32_t Expected[Samples];
+
+// times one pow_mod implementation over all of the samples
+template <class PowFn>
+void bench(const char* name, PowFn fn) {
+	uint32_t mismatches = 0;
+	uint64_t start = cycles();
+	for (int i = 0; i < Samples; ++i) {
+		if (fn(Bases[i], Exponents[i]) != Expected[i])
+			++mismatches;
+	}
+	uint64_t total = cycles() - start;
+	std::cout << name << ": " << (total / Samples) << " cycles/pow_mod, "
+	          << mismatches << " mismatches\n";
+}
+
+struct LegacyPow {
+	uint32_t mod;
+	uint32_t operator()(uint32_t b, uint32_t e) const { return project1_part2::pow_mod(b, e, mod); }
+};
+struct ShiftAddPow {
+	uint32_t mod;
+	uint32_t operator()(uint32_t b, uint32_t e) const { return shift_add_pow_mod(b, e, mod); }
+};
+template <class Arith>
+struct ArithPow {
+	const Arith* arith;
+	uint32_t operator()(uint32_t b, uint32_t e) const { return pow_mod(b, e, *arith); }
+};
+
+const char* reduction_name(ModReduction r) {
+	switch (r) {
+	case MersenneReduction: return "mersenne";
+	case PseudoMersenneReduction: return "pseudo-mersenne";
+	default: return "generic";
+	}
+}
+
+// runs every implementation for one (compile time known) modulus
+template <uint32_t Mod>
+void bench_modulus() {
+	for (int i = 0; i < Samples; ++i) {
+		Bases[i] = bench_rand() % Mod;
+		Exponents[i] = bench_rand();
+		Expected[i] = reference_pow_mod(Bases[i], Exponents[i], Mod);
+	}
+
+	std::cout << "modulus " << std::hex << Mod << std::dec << " ("
+	          << reduction_name(ModArith<Mod>::Reduction) << ")\n";
+	LegacyPow legacyPow = { Mod };
+	bench("  legacy loop      ", legacyPow);
+	ShiftAddPow shiftAddPow = { Mod };
+	bench("  shift and add    ", shiftAddPow);
+	MontgomeryMod mont(Mod);
+	ArithPow<MontgomeryMod> montPow = { &mont };
+	bench("  montgomery       ", montPow);
+	ModArith<> runtime(Mod);
+	ArithPow<ModArith<> > runtimePow = { &runtime };
+	bench("  ModArith<>       ", runtimePow);
+	ModArith<Mod> fixed;
+	ArithPow<ModArith<Mod> > fixedPow = { &fixed };
+	bench("  ModArith<Mod>    ", fixedPow);
+}
+
+// times one runtime engine over Samples exponentiations spread across random
+// moduli of the given width, including the cost of building each context.
+template <class Engine>
+void bench_runtime(const char* name, uint8_t bits, bool oddOnly) {
+	const int PerModulus = 20;
+	uint32_t mismatches = 0;
+	uint64_t total = 0;
+	bench_state = 0x9E3779B9 + bits;
+	for (int i = 0; i < Samples; i += PerModulus) {
+		uint32_t mod = bench_rand() | (1u << (bits - 1));
+		if (bits < 32)
+			mod &= (1u << bits) - 1;
+		if (oddOnly)
+			mod |= 1;
+		for (int j = 0; j < PerModulus; ++j) {
+			Bases[j] = bench_rand();
+			Exponents[j] = bench_rand();
+			Expected[j] = reference_pow_mod(Bases[j], Exponents[j], mod);
+		}
+
+		uint64_t start = cycles();
+		Engine engine(mod);
+		for (int j = 0; j < PerModulus; ++j) {
+			if (pow_mod(Bases[j], Exponents[j], engine) != Expected[j])
+				++mismatches;
+		}
+		total += cycles() - start;
+	}
+	std::cout << name << ": " << (total / Samples) << " cycles/pow_mod, "
+	          << mismatches << " mismatches\n";
+}
+
+// wraps the plain 64 bit % loop up as an engine for bench_runtime
+struct DivideMod {
+	uint32_t Modulus;
+	explicit DivideMod(uint32_t mod): Modulus(mod) {}
+};
+uint32_t pow_mod(uint32_t base, uint32_t exponent, const DivideMod& d) {
+	return reference_pow_mod(base, exponent, d.Modulus);
+}
+
+void bench_random_moduli(uint8_t bits) {
+	std::cout << "random " << (int)bits << " bit moduli, odd\n";
+	bench_runtime<DivideMod>("  64 bit %        ", bits, true);
+	bench_runtime<BarrettMod>("  barrett         ", bits, true);
+	bench_runtime<MontgomeryMod>("  montgomery      ", bits, true);
+	bench_runtime<ModArith<> >("  ModArith<>      ", bits, true);
+	std::cout << "random " << (int)bits << " bit moduli, any\n";
+	bench_runtime<DivideMod>("  64 bit %        ", bits, false);
+	bench_runtime<BarrettMod>("  barrett         ", bits, false);
+	bench_runtime<ModArith<> >("  ModArith<>      ", bits, false);
+}
+
+// ModArith<> that counts its multiplies
+struct CountingArith: ModArith<> {
+	explicit CountingArith(uint32_t mod): ModArith<>(mod), Count(0) {}
+	uint32_t mul(uint32_t a, uint32_t b) const { ++Count; return ModArith<>::mul(a, b); }
+	mutable uint64_t Count;
+};
+
+template <uint8_t Window>
+void bench_window() {
+	const uint32_t mod = 0x7FFFFFFF;
+	CountingArith counter(mod);
+	ModArith<mod> fixed;
+	uint32_t mismatches = 0;
+	bench_state = 0xC0FFEE;
+	for (int i = 0; i < Samples; ++i) {
+		Bases[i] = bench_rand();
+		Exponents[i] = bench_rand();
+		Expected[i] = reference_pow_mod(Bases[i], Exponents[i], mod);
+		if (pow_mod_window<Window>(Bases[i], Exponents[i], counter) != Expected[i])
+			++mismatches;
+	}
+	uint64_t start = cycles();
+	for (int i = 0; i < Samples; ++i) {
+		if (pow_mod_window<Window>(Bases[i], Exponents[i], fixed) != Expected[i])
+			++mismatches;
+	}
+	uint64_t total = cycles() - start;
+	std::cout << "  window " << (int)Window << ": " << (counter.Count / (double)Samples)
+	          << " multiplies/pow_mod, " << (total / Samples) << " cycles/pow_mod, "
+	          << (4 << (Window - 1)) << " bytes of table, "
+	          << mismatches << " mismatches\n";
+}
+
+// public key calculation: fixed base table against sliding window pow_mod
+template <uint32_t Mod>
+void bench_fixed_base(uint32_t generator, const uint32_t* table) {
+	bench_state = 0xFEEDBEEF;
+	for (int i = 0; i < Samples; ++i) {
+		Bases[i] = generator;
+		Exponents[i] = bench_rand();
+		Expected[i] = reference_pow_mod(generator, Exponents[i], Mod);
+	}
+
+	std::cout << "generator " << generator << " modulus " << std::hex << Mod
+	          << std::dec << "\n";
+	ModArith<Mod> fixed;
+	ArithPow<ModArith<Mod> > windowPow = { &fixed };
+	bench("  sliding window   ", windowPow);
+
+	uint32_t mismatches = 0;
+	uint64_t start = cycles();
+	for (int i = 0; i < Samples; ++i) {
+		if (fixed_base_pow_mod(table, Exponents[i], fixed) != Expected[i])
+			++mismatches;
+	}
+	uint64_t total = cycles() - start;
+	std::cout << "  fixed base table : " << (total / Samples) << " cycles/pow_mod, "
+	          << mismatches << " mismatches\n";
+}
+
+// times one mul_mod engine over count (a, b, mod) triples, checking against
+// the 64 bit product
+template <class MulFn>
+void bench_mul(const char* name, MulFn fn, const uint32_t* a, const uint32_t* b,
+               const uint32_t* m, int count) {
+	uint32_t mismatches = 0;
+	uint64_t start = cycles();
+	for (int i = 0; i < count; ++i) {
+		if (fn(a[i], b[i], m[i]) != ((uint64_t)a[i] * b[i]) % m[i])
+			++mismatches;
+	}
+	uint64_t total = cycles() - start;
+	std::cout << "  " << name << ": " << (total / count) << " cycles/mul_mod, "
+	          << mismatches << " mismatches\n";
+}
+
+//
+// Full range operands against moduli across the whole 32 bit range,
+// including the ones within a few of 2^32 where a + b overflows.
+//
+void bench_full_range_mul() {
+	const int Count = 2000;
+	static uint32_t a[Count], b[Count], m[Count];
+	for (int i = 0; i < Count; ++i) {
+		a[i] = bench_rand();
+		b[i] = bench_rand();
+		switch (i % 4) {
+		case 0: m[i] = 0xFFFFFFFF - (bench_rand() & 0xF); break;
+		case 1: m[i] = bench_rand() | 0x80000000; break;
+		case 2: m[i] = bench_rand() >> (bench_rand() % 31); break;
+		default: m[i] = bench_rand(); break;
+		}
+		if (m[i] == 0)
+			m[i] = 1;
+	}
+	std::cout << "full range mul_mod, native path " << (MODARITH_NATIVE_MUL ? "on" : "off") << "\n";
+	// the old engine is thousands of times slower, so only time a slice of it
+	bench_mul("FullPrecisionMod legacy", full_precision::mul_mod, a, b, m, Count / 20);
+	bench_mul("double and add", mul_mod_double_add, a, b, m, Count);
+	bench_mul("native 64 bit", mul_mod_native, a, b, m, Count);
+}
+
+//
+// pow_mod_batch on every kernel the CPU can run, against one scalar pow_mod
+// per element through ModArith<> (what Project1Part2.cpp does per handshake).
+//
+void bench_batch_kernel(PowModKernel kernel, const uint32_t* bases, const uint32_t* exps,
+                        uint32_t mod, uint32_t* out, const uint32_t* expected, size_t n) {
+	uint64_t start = cycles();
+	pow_mod_batch_with(kernel, bases, exps, mod, out, n);
+	uint64_t total = cycles() - start;
+	uint32_t mismatches = 0;
+	for (size_t i = 0; i < n; ++i)
+		if (out[i] != expected[i])
+			++mismatches;
+	std::cout << "  " << pow_mod_kernel_name(kernel) << ": " << (total / n)
+	          << " cycles/pow_mod, " << mismatches << " mismatches\n";
+}
+
+void bench_batch() {
+	const size_t Count = 4099;
+	static uint32_t bases[Count], exps[Count], out[Count], expected[Count];
+	const uint32_t moduli[] = { 0x7FFFFFFF, 0xFFFFFFFB, 0xFFFFFFFF, 19211, 0x80000001, 0xFFFFFFFE };
+	PowModKernel best = pow_mod_batch_kernel();
+	bench_state = 0xBA7C4;
+	for (size_t m = 0; m < sizeof(moduli) / sizeof(moduli[0]); ++m) {
+		uint32_t mod = moduli[m];
+		for (size_t i = 0; i < Count; ++i) {
+			bases[i] = bench_rand();
+			// mix in some short exponents so blocks end early
+			exps[i] = bench_rand() >> (i % 7 == 0 ? bench_rand() % 32 : 0);
+		}
+		ModArith<> arith(mod);
+		uint64_t start = cycles();
+		for (size_t i = 0; i < Count; ++i)
+			expected[i] = pow_mod(bases[i], exps[i], arith);
+		uint64_t total = cycles() - start;
+		std::cout << "batch pow_mod modulus " << std::hex << mod << std::dec
+		          << ", one pow_mod at a time: " << (total / Count) << " cycles/pow_mod\n";
+		for (int k = PowModScalar; k <= best; ++k)
+			bench_batch_kernel((PowModKernel)k, bases, exps, mod, out, expected, Count);
+	}
+}
+
+void bench_arith() {
+	bench_modulus<0x7FFFFFFF>();
+	bench_modulus<0xFFFFFFFB>();
+	bench_modulus<19211>();
+	bench_random_moduli(31);
+	bench_random_moduli(32);
+	std::cout << "window sizes, 32 bit exponents mod 7fffffff\n";
+	bench_window<1>();
+	bench_window<2>();
+	bench_window<3>();
+	bench_window<4>();
+	bench_window<5>();
+	bench_fixed_base<0x7FFFFFFF>(16807, FixedBase16807Mod7FFFFFFF);
+	bench_fixed_base<19211>(6, FixedBase6Mod19211);
+	bench_full_range_mul();
+	bench_batch();
+}
+
+#endif
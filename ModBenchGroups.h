@@ -0,0 +1,265 @@
+#ifndef MODBENCHGROUPS_H
+#define MODBENCHGROUPS_H
+
+#include "BigNum.h"
+#include "GroupCheck.h"
+#include "KeyTraits.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Benches for the Diffie-Hellman groups: the big MODP groups, checking a
+// peer's group, whole handshakes at each key size and x25519.
+// Part of ModBench.cpp, which includes it after its timing helpers
+// (cycles(), now_ms(), bench_rand(), percentile()). Add new benches here and
+// to bench_groups() at the bottom, rather than to ModBench's main().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template <uint16_t Bits>
+void random_big(BigNum<Bits>& n) {
+	for (uint16_t i = 0; i < BigNum<Bits>::Limbs; ++i)
+		n.Limb[i] = (BigLimb)bench_rand();
+}
+
+// one side of a big group handshake: public key and shared secret, which is
+// what the device does at connect time
+template <uint16_t Bits, uint16_t ExpBits>
+double big_handshake_ms(const BigMontgomery<Bits>& mont, int rounds) {
+	BigNum<Bits> generator(ModpGenerator);
+	BigNum<Bits> sink;
+	double start = now_ms();
+	for (int i = 0; i < rounds; ++i) {
+		BigNum<ExpBits> myKey, otherKey;
+		random_big(myKey);
+		random_big(otherKey);
+		BigNum<Bits> otherPublic = pow_mod(generator, otherKey, mont);
+		double t = now_ms();
+		BigNum<Bits> myPublic = pow_mod(generator, myKey, mont);
+		BigNum<Bits> secret = pow_mod(otherPublic, myKey, mont);
+		start += now_ms() - t;
+		sink.Limb[0] ^= myPublic.Limb[0] ^ secret.Limb[0];
+	}
+	// keep the work from being optimised out
+	if (sink.Limb[0] == 0x5A)
+		std::cout << "";
+	return (now_ms() - start) / rounds;
+}
+
+template <uint16_t Bits>
+void bench_big_group() {
+	BigNum<Bits> prime;
+	prime.from_progmem(modp_prime(Bits));
+	double t = now_ms();
+	BigMontgomery<Bits> mont(prime);
+	double setup = now_ms() - t;
+
+	// check against Fermat: 2^(p-1) = 1 for the prime
+	BigNum<Bits> pm1 = prime;
+	pm1.Limb[0] -= 1;
+	bool ok = pow_mod(BigNum<Bits>(2), pm1, mont) == BigNum<Bits>(1);
+
+	std::cout << "  " << Bits << " bit group: "
+	          << big_handshake_ms<Bits, 256>(mont, 10) << " ms/handshake (256 bit exponent), "
+	          << big_handshake_ms<Bits, Bits>(mont, 2) << " ms/handshake (full exponent), "
+	          << setup << " ms context setup, "
+	          << (ok ? "fermat ok" : "FERMAT MISMATCH") << "\n";
+}
+
+//
+// Cost of validating a KEY message's group: the full primality and generator
+// test on a cache miss, against the lookup on a repeat handshake.
+//
+void bench_group_check() {
+	const int Count = 200;
+	static uint32_t primes[Count], generators[Count];
+	bench_state = 0x600D;
+	for (int i = 0; i < Count; ++i) {
+		// safe primes, the worst case for factoring p - 1
+		uint32_t q;
+		do {
+			q = (bench_rand() >> 1) | 0x40000001;
+		} while (!is_prime_u32(q) || !is_prime_u32(2*q + 1));
+		primes[i] = 2*q + 1;
+		for (generators[i] = 2; !is_generator_u32(generators[i], primes[i]); ++generators[i]);
+	}
+
+	uint32_t accepted = 0;
+	GroupCache cache;
+	uint64_t start = cycles();
+	for (int i = 0; i < Count; ++i)
+		accepted += cache.check(primes[i], generators[i]);
+	uint64_t missTotal = cycles() - start;
+
+	// the same group over and over, as with repeat handshakes
+	start = cycles();
+	for (int i = 0; i < Count; ++i)
+		accepted += cache.check(primes[Count - 1], generators[Count - 1]);
+	uint64_t hitTotal = cycles() - start;
+
+	// volatile, or the compiler folds the well known check away entirely
+	volatile uint32_t knownPrime = 0x7FFFFFFF;
+	start = cycles();
+	for (int i = 0; i < Count; ++i)
+		accepted += cache.check(knownPrime, 16807);
+	uint64_t knownTotal = cycles() - start;
+
+	// real groups, but far too small for the keys, which have to be turned
+	// away whatever the key width
+	const uint32_t TinyPrimes[] = { 3, 5, 7, 23, 1019, 0x3FFFFA97 };
+	const uint32_t TinyGenerators[] = { 2, 2, 3, 5, 2, 7 };
+	const int TinyCount = sizeof(TinyPrimes) / sizeof(TinyPrimes[0]);
+	int tinyAccepted = 0;
+	for (int i = 0; i < TinyCount; ++i)
+		tinyAccepted += cache.check(TinyPrimes[i], TinyGenerators[i]);
+	GroupCache smallCache;
+	int tinySmallAccepted = smallCache.check(3, 2, 15) + smallCache.check(1019, 2, 15);
+	bool smallDefault = smallCache.check(19211, 6, 15) && KeyTraits<uint8_t>::check_group(smallCache, 251, 6);
+
+	std::cout << "group validation, 32 bit safe primes\n"
+	          << "  full check : " << (missTotal / Count) << " cycles\n"
+	          << "  cache hit  : " << (hitTotal / Count) << " cycles\n"
+	          << "  well known : " << (knownTotal / Count) << " cycles\n"
+	          << "  " << accepted << "/" << 3 * Count << " accepted, "
+	          << cache.full_checks() << " full checks\n"
+	          << "  too small  : " << tinyAccepted << "/" << TinyCount << " accepted for 32 bit keys, "
+	          << tinySmallAccepted << "/2 for 16 bit"
+	          << (smallDefault ? "" : ", default groups REJECTED") << "\n";
+}
+
+// bench_rand as a generator for KeyTraits::random_exponent
+struct BenchRandom {
+	uint32_t next_uint32() { return bench_rand(); }
+};
+
+//
+// bench_key_width
+// A whole handshake at one key size through KeyTraits, the way EncryptState
+// does it: both public keys and both shared secrets, which have to agree.
+// Also what the size costs on the wire (KEY + RSP, with the 3 character tags
+// and terminators) and in EncryptState's key fields.
+//
+template <class KeyT>
+void bench_key_width(const char* name, int rounds) {
+	typedef KeyTraits<KeyT> Traits;
+	typename Traits::Arith arith;
+	arith.set_modulus(Traits::default_prime());
+	typename Traits::GeneratorType g = Traits::default_generator();
+	BenchRandom rng;
+	uint32_t mismatches = 0;
+	uint32_t sink = 0;
+	bench_state = 0xD1FF1E;
+	uint64_t start = cycles();
+	for (int i = 0; i < rounds; ++i) {
+		typename Traits::Exponent a = Traits::random_exponent(rng);
+		typename Traits::Exponent b = Traits::random_exponent(rng);
+		typename Traits::Key publicA = Traits::generator_pow_mod(g, a, arith);
+		typename Traits::Key publicB = Traits::generator_pow_mod(g, b, arith);
+		typename Traits::Key secretA = Traits::group_pow_mod(publicB, a, arith);
+		typename Traits::Key secretB = Traits::group_pow_mod(publicA, b, arith);
+		if (secretA != secretB)
+			++mismatches;
+		sink ^= Traits::fold(secretA);
+	}
+	uint64_t total = cycles() - start;
+	uint32_t wire = (3 + Traits::GroupBytes + Traits::Bytes + 1) + (3 + Traits::Bytes + 1);
+	uint32_t state = sizeof(typename Traits::Arith) + 2*sizeof(typename Traits::Key) +
+	                 sizeof(typename Traits::Exponent) + sizeof(typename Traits::GeneratorType) +
+	                 sizeof(typename Traits::Cache);
+	std::cout << "  " << name << ": " << (total / (2*rounds)) << " cycles/side, "
+	          << wire << " bytes on the wire, " << state << " bytes of key state, "
+	          << mismatches << " mismatches" << (sink == 0x5A ? " " : "") << "\n";
+}
+
+// MontgomeryMod64 against a plain 128 bit square and multiply
+void check_montgomery64() {
+#ifdef __SIZEOF_INT128__
+	uint32_t mismatches = 0;
+	const int Count = 2000;
+	bench_state = 0x64;
+	for (int i = 0; i < Count; ++i) {
+		uint64_t mod = (((uint64_t)bench_rand() << 32) | bench_rand()) | 1;
+		if (i & 1)
+			mod |= 1ull << 63;
+		uint64_t base = ((uint64_t)bench_rand() << 32) | bench_rand();
+		uint64_t exponent = ((uint64_t)bench_rand() << 32) | bench_rand();
+		unsigned __int128 r = 1 % mod, b = base % mod;
+		for (uint64_t e = exponent; e; e >>= 1) {
+			if (e & 1)
+				r = r * b % mod;
+			b = b * b % mod;
+		}
+		if (pow_mod(base, exponent, MontgomeryMod64(mod)) != (uint64_t)r)
+			++mismatches;
+	}
+	std::cout << "  MontgomeryMod64 vs __int128: " << mismatches << "/" << Count << " mismatches\n";
+#endif
+}
+
+// RFC 7748 section 5.2 and 6.1 vectors against one field implementation,
+// and what a scalar multiply costs with it
+template <class Field>
+void check_x25519(const char* name) {
+	const char* Vectors[][3] = {
+		{ "a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4",
+		  "e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c",
+		  "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552" },
+		{ "4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d",
+		  "e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493",
+		  "95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957" },
+		// Alice's public key, Bob's public key, then the shared secret
+		{ "77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a",
+		  "0900000000000000000000000000000000000000000000000000000000000000",
+		  "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a" },
+		{ "5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb",
+		  "0900000000000000000000000000000000000000000000000000000000000000",
+		  "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f" },
+		{ "77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a",
+		  "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f",
+		  "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742" },
+	};
+	const uint8_t Count = sizeof(Vectors) / sizeof(Vectors[0]);
+	uint8_t passed = 0;
+	for (uint8_t v = 0; v < Count; ++v) {
+		X25519Key scalar = KeyTraits<X25519Key>::from_text(Vectors[v][0]);
+		X25519Key u = KeyTraits<X25519Key>::from_text(Vectors[v][1]);
+		X25519Key expected = KeyTraits<X25519Key>::from_text(Vectors[v][2]);
+		X25519Key out;
+		x25519_with<Field>(out.Data, scalar.Data, u.Data);
+		passed += out == expected;
+	}
+
+	const int Rounds = 200;
+	X25519Key k = KeyTraits<X25519Key>::from_text(Vectors[0][0]);
+	X25519Key u = KeyTraits<X25519Key>::from_text(Vectors[0][1]);
+	uint64_t start = cycles();
+	for (int i = 0; i < Rounds; ++i)
+		x25519_with<Field>(u.Data, k.Data, u.Data);
+	uint64_t total = cycles() - start;
+	std::cout << "  " << name << ": " << (total / Rounds) << " cycles/scalar multiply, "
+	          << (int)passed << "/" << (int)Count << " RFC 7748 vectors\n";
+}
+
+void bench_groups() {
+	std::cout << "big groups, " << (int)BigLimbBits << " bit limbs, karatsuba from "
+	          << BIGNUM_KARATSUBA_LIMBS << " limbs, window " << BIGNUM_WINDOW << "\n";
+	bench_big_group<1024>();
+	bench_big_group<1536>();
+	bench_big_group<2048>();
+	bench_group_check();
+	std::cout << "key sizes, default group for each\n";
+	check_montgomery64();
+	bench_key_width<uint8_t>("8 bit    ", 20000);
+	bench_key_width<uint16_t>("16 bit   ", 20000);
+	bench_key_width<uint32_t>("32 bit   ", 20000);
+	bench_key_width<uint64_t>("64 bit   ", 20000);
+	bench_key_width<X25519Key>("x25519   ", 200);
+	bench_key_width<BigNum<1024> >("1024 bit ", 10);
+	bench_key_width<BigNum<2048> >("2048 bit ", 4);
+	std::cout << "x25519 field implementations\n";
+#ifdef __SIZEOF_INT128__
+	check_x25519<X25519Field51>("radix 2^51");
+#endif
+	check_x25519<X25519Field8>("radix 2^8 ");
+}
+
+#endif
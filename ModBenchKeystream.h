@@ -0,0 +1,413 @@
+#ifndef MODBENCHKEYSTREAM_H
+#define MODBENCHKEYSTREAM_H
+
+#include <new>
+#include "KeystreamGen.h"
+#include "SipHash.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Benches for the keystream: the Mersenne Twister kernels, latency and
+// seeding, the other generators, prefetching, the keystream layouts, ChaCha
+// and the SipHash block tags.
+// Part of ModBench.cpp, which includes it after its timing helpers
+// (cycles(), now_ms(), bench_rand(), percentile()). Add new benches here and
+// to bench_keystream() at the bottom, rather than to ModBench's main().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// Seeding cost, old against new. The old seed() filled in all 624 words up
+// front, in the constructor and again in every seed(); EncryptState has two
+// generators, so that was twice at boot and twice in start_session. Now
+// seed() only sets MT[0] and the first few hundred words get filled in by the
+// first next_uint32(), so that's shown separately.
+//
+void eager_seed(uint32_t* MT, uint32_t seed) {
+	MT[0] = seed;
+	for (uint16_t i = 1; i < 624; ++i) {
+		uint64_t v = MT[i-1];
+		MT[i] = (0x6C078965*(v ^ (v>>30)) + i);
+	}
+}
+
+void bench_mersenne_seeding() {
+	const int Rounds = 1000;
+	static uint32_t state[624];
+	static MersenneTwister gens[Rounds];
+	uint64_t eager = 0, construct = 0, seed = 0, first = 0, rest = 0;
+	uint32_t sink = 0;
+	for (int r = 0; r < Rounds; ++r) {
+		uint64_t start = cycles();
+		eager_seed(state, r);
+		eager += cycles() - start;
+		sink ^= state[623];
+
+		start = cycles();
+		new (&gens[r]) MersenneTwister();
+		construct += cycles() - start;
+
+		start = cycles();
+		gens[r].seed(r);
+		seed += cycles() - start;
+
+		start = cycles();
+		sink ^= gens[r].next_uint32();
+		first += cycles() - start;
+
+		start = cycles();
+		for (int i = 1; i < 624; ++i)
+			sink ^= gens[r].next_uint32();
+		rest += cycles() - start;
+	}
+	std::cout << "mersenne twister seeding, cycles\n"
+	          << "  eager seed (old constructor and seed): " << (eager / Rounds) << "\n"
+	          << "  lazy: constructor " << (construct / Rounds) << ", seed " << (seed / Rounds)
+	          << ", first word " << (first / Rounds) << ", next 623 words "
+	          << (rest / Rounds / 623) << " each\n"
+	          << "  boot and start_session, two generators: " << (2 * eager / Rounds)
+	          << " before, " << (2 * seed / Rounds) << " now" << (sink == 0x5A ? " " : "") << "\n";
+}
+
+//
+// What each keystream generator costs EncryptState: SRAM for the pair of
+// them, the seed at session start, speed at one word per byte encrypted the
+// way encrypt() uses it, and seeking to another message block. Flash can
+// only be measured on the AVR build, eg. avr-size on the sketch built with
+// each -DKEYSTREAM_GEN.
+//
+template <class Gen>
+void bench_keystream_gen(const char* name) {
+	const size_t Count = 1 << 22;
+	Gen gen;
+	uint64_t start = cycles();
+	gen.seed(0x5EED);
+	uint64_t seedCycles = cycles() - start;
+	uint8_t sink = 0;
+	double ms = now_ms();
+	start = cycles();
+	for (size_t i = 0; i < Count; ++i)
+		sink ^= (uint8_t)i ^ (uint8_t)gen.next_uint32();
+	uint64_t total = cycles() - start;
+	ms = now_ms() - ms;
+
+	// what a receiver pays to resync: skipping one lost 32 word block, and
+	// going back to block 100 (a reseed and a discard)
+	start = cycles();
+	gen.discard(32);
+	uint64_t skipCycles = cycles() - start;
+	start = cycles();
+	gen.seed(0x5EED);
+	gen.discard(100 * 32);
+	uint64_t backCycles = cycles() - start;
+	sink ^= gen.next_uint32();
+
+	std::cout << "  " << name << ": " << sizeof(Gen) << " bytes, " << (2 * sizeof(Gen))
+	          << " per EncryptState, seed " << seedCycles << " cycles, "
+	          << ((double)total / Count) << " cycles/byte, "
+	          << (Count / ms / 1000) << " MB/s, skip a block " << skipCycles
+	          << " cycles, back to block 100 " << backCycles << " cycles"
+	          << (sink == 0x5A ? " " : "") << "\n";
+}
+
+//
+// Per byte latency of encrypting with the keystream, the way EncryptState
+// does it: one next_uint32() per byte. "Whole twist" is the old behaviour,
+// all 624 words twisted on every 624th call, which is what fill() of one word
+// at a time does; "incremental" is next_uint32() twisting a word per call.
+// Each byte's time is the best of a few passes over the same keystream, to
+// keep interrupts on the host out of the max. The times include the rdtsc.
+//
+void bench_mersenne_latency() {
+	const size_t Count = 624 * 100;
+	const int Passes = 5;
+	std::vector<uint64_t> whole(Count, ~0ull), incremental(Count, ~0ull);
+	uint32_t mismatches = 0;
+	for (int pass = 0; pass < Passes; ++pass) {
+		MersenneTwister a, b;
+		a.seed(0x5EED);
+		b.seed(0x5EED);
+		uint8_t data = 0x55;
+		for (size_t i = 0; i < Count; ++i) {
+			uint32_t w;
+			uint64_t start = cycles();
+			a.fill_with(MTScalar, &w, 1);
+			uint8_t x = data ^ w;
+			uint64_t mid = cycles();
+			uint8_t y = data ^ b.next_uint32();
+			uint64_t end = cycles();
+			whole[i] = std::min(whole[i], mid - start);
+			incremental[i] = std::min(incremental[i], end - mid);
+			mismatches += (x != y);
+			data = x;
+		}
+	}
+	std::cout << "mersenne twister cycles per byte encrypted, p50 / p99 / p99.9 / max\n";
+	const char* names[] = { "  whole twist: ", "  incremental: " };
+	std::vector<uint64_t>* runs[] = { &whole, &incremental };
+	for (int r = 0; r < 2; ++r) {
+		// the first word after a seed expands the state as well, which is a
+		// one off per seed, so it's shown on its own
+		std::vector<uint64_t>& v = *runs[r];
+		uint64_t first = v[0];
+		v.erase(v.begin());
+		std::cout << names[r] << percentile(v, 0.5) << " / " << percentile(v, 0.99) << " / "
+		          << percentile(v, 0.999) << " / " << v.back() << ", first word after seed " << first;
+		if (r == 1)
+			std::cout << ", " << mismatches << " mismatches";
+		std::cout << "\n";
+	}
+}
+
+//
+// Bulk keystream from MersenneTwister::fill against one next_uint32() at a
+// time, checking every kernel gives exactly the same words. The fill sizes
+// are odd so the blocks straddle the 624 word twist.
+//
+void bench_mersenne_fill() {
+	const size_t Count = 1 << 20;
+	const size_t Sizes[] = { 1, 7, 623, 1000, 4096, Count };
+	static uint32_t expected[Count], out[Count];
+	MersenneTwister ref;
+	ref.seed(0x5EED);
+	uint64_t start = cycles();
+	for (size_t i = 0; i < Count; ++i)
+		expected[i] = ref.next_uint32();
+	uint64_t total = cycles() - start;
+	std::cout << "mersenne twister keystream, next_uint32: "
+	          << ((double)total / (Count * 4)) << " cycles/byte\n";
+
+	MTKernel best = mt_kernel();
+	for (int k = MTScalar; k <= best; ++k) {
+		uint32_t mismatches = 0;
+		for (size_t s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); ++s) {
+			MersenneTwister gen;
+			gen.seed(0x5EED);
+			start = cycles();
+			for (size_t i = 0; i < Count; i += Sizes[s])
+				gen.fill_with((MTKernel)k, out + i, (Count - i < Sizes[s]) ? Count - i : Sizes[s]);
+			uint64_t taken = cycles() - start;
+			for (size_t i = 0; i < Count; ++i)
+				mismatches += (out[i] != expected[i]);
+			if (Sizes[s] == Count)
+				total = taken;
+		}
+		std::cout << "  fill " << mt_kernel_name((MTKernel)k) << ": "
+		          << ((double)total / (Count * 4)) << " cycles/byte, "
+		          << mismatches << " mismatches\n";
+	}
+}
+
+//
+// ChaCha keystream, one word at a time and through fill() on each kernel, in
+// cycles per byte and MB/s, against the Mersenne Twister's best fill. Checks
+// fill() against next_uint32() over a mix of sizes, including ones that start
+// and end part way through a block.
+//
+template <uint8_t Rounds>
+void bench_chacha() {
+	const size_t Count = 1 << 20;
+	const size_t Sizes[] = { 1, 7, 16, 100, 4096, Count };
+	static uint32_t expected[Count], out[Count];
+	uint8_t key[32];
+	for (uint8_t i = 0; i < 32; ++i)
+		key[i] = i;
+	ChaCha<Rounds> ref;
+	ref.set_key(key);
+	ref.seed(0x5EED);
+	double ms = now_ms();
+	uint64_t start = cycles();
+	for (size_t i = 0; i < Count; ++i)
+		expected[i] = ref.next_uint32();
+	uint64_t total = cycles() - start;
+	ms = now_ms() - ms;
+	std::cout << "chacha" << (int)Rounds << " keystream, next_uint32: "
+	          << ((double)total / (Count * 4)) << " cycles/byte, "
+	          << (Count * 4 / ms / 1000) << " MB/s\n";
+
+	ChaChaKernel best = chacha_kernel();
+	for (int k = ChaChaScalar; k <= best; ++k) {
+		uint32_t mismatches = 0;
+		for (size_t s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); ++s) {
+			ChaCha<Rounds> gen;
+			gen.set_key(key);
+			gen.seed(0x5EED);
+			double t = now_ms();
+			start = cycles();
+			for (size_t i = 0; i < Count; i += Sizes[s])
+				gen.fill_with((ChaChaKernel)k, out + i, (Count - i < Sizes[s]) ? Count - i : Sizes[s]);
+			uint64_t taken = cycles() - start;
+			t = now_ms() - t;
+			for (size_t i = 0; i < Count; ++i)
+				mismatches += (out[i] != expected[i]);
+			if (Sizes[s] == Count) {
+				total = taken;
+				ms = t;
+			}
+		}
+		std::cout << "  fill " << chacha_kernel_name((ChaChaKernel)k) << ": "
+		          << ((double)total / (Count * 4)) << " cycles/byte, "
+		          << (Count * 4 / ms / 1000) << " MB/s, "
+		          << mismatches << " mismatches\n";
+	}
+}
+
+void bench_chacha_vs_mersenne() {
+	const size_t Count = 1 << 20;
+	static uint32_t out[Count];
+	MersenneTwister mt;
+	mt.seed(0x5EED);
+	double ms = now_ms();
+	mt.fill(out, Count);
+	ms = now_ms() - ms;
+	std::cout << "  mersenne twister fill " << mt_kernel_name(mt_kernel()) << ": "
+	          << (Count * 4 / ms / 1000) << " MB/s" << (out[Count / 2] == 0x5A ? " " : "")
+	          << "\n";
+}
+
+//
+// Cost of decrypting a 32 byte MSG block with Keystream, with the bytes
+// prefetched in idle time (hits) against generating them as each byte
+// arrives (misses), in cycles per byte. The buffer is refilled between
+// blocks, as loop() would.
+//
+template <class Gen>
+void bench_keystream_prefetch(const char* name) {
+	const int Blocks = 5000;
+	std::vector<uint64_t> hit, miss;
+	Keystream<Gen, 32> buffered, direct;
+	buffered.seed(0x5EED);
+	direct.seed(0x5EED);
+	uint8_t x[32], y[32];
+	uint32_t mismatches = 0;
+	for (int b = 0; b < Blocks; ++b) {
+		while (buffered.prefetch())
+			;
+		uint64_t start = cycles();
+		for (int i = 0; i < 32; ++i)
+			x[i] = buffered.next_byte();
+		uint64_t mid = cycles();
+		for (int i = 0; i < 32; ++i)
+			y[i] = direct.next_byte();
+		uint64_t end = cycles();
+		hit.push_back(mid - start);
+		miss.push_back(end - mid);
+		mismatches += memcmp(x, y, 32) != 0;
+	}
+	std::cout << "  " << name << ": prefetched " << (percentile(hit, 0.5) / 32.0) << " / "
+	          << (percentile(hit, 0.99) / 32.0) << " / " << (hit.back() / 32.0) << ", inline "
+	          << (percentile(miss, 0.5) / 32.0) << " / " << (percentile(miss, 0.99) / 32.0) << " / "
+	          << (miss.back() / 32.0) << ", hit rate "
+	          << buffered.hits() * 100 / (buffered.hits() + buffered.misses()) << "%, "
+	          << mismatches << " mismatched blocks\n";
+}
+
+//
+// Encrypting a buffer with each keystream layout: one generator word per byte
+// (KeystreamBytes), or all 4 bytes of each word (KeystreamWords). "Bytewise"
+// is a next_byte() per byte; xor_into() is what EncryptState does now, in the
+// sketch's 32 byte blocks and over one big buffer, where on the host the
+// Mersenne Twister gets its SIMD fill. Checks the two give the same bytes.
+//
+template <class Gen>
+void bench_keystream_xor(const char* name) {
+	const uint32_t Len = 1 << 20;
+	std::vector<uint8_t> ref(Len), buf(Len);
+	for (uint8_t wordBytes = 1; wordBytes <= 4; wordBytes += 3) {
+		Keystream<Gen, 32> ks;
+		ks.seed(0x5EED, wordBytes);
+		uint64_t start = cycles();
+		for (uint32_t i = 0; i < Len; ++i)
+			ref[i] = ks.next_byte();
+		double bytewise = (double)(cycles() - start) / Len;
+
+		std::fill(buf.begin(), buf.end(), 0);
+		ks.seed(0x5EED, wordBytes);
+		start = cycles();
+		for (uint32_t i = 0; i < Len; i += 32)
+			ks.xor_into(&buf[i], 32);
+		double blocks = (double)(cycles() - start) / Len;
+		uint32_t mismatches = memcmp(&ref[0], &buf[0], Len) != 0;
+
+		std::fill(buf.begin(), buf.end(), 0);
+		ks.seed(0x5EED, wordBytes);
+		double ms = now_ms();
+		start = cycles();
+		ks.xor_into(&buf[0], Len);
+		double whole = (double)(cycles() - start) / Len;
+		ms = now_ms() - ms;
+		mismatches += memcmp(&ref[0], &buf[0], Len) != 0;
+
+		std::cout << "  " << name << (wordBytes == 1 ? " bytes: " : " words: ")
+		          << (1.0 / wordBytes) << " words/byte, bytewise " << bytewise
+		          << ", 32 byte blocks " << blocks << ", whole buffer " << whole
+		          << " cycles/byte (" << (Len / ms / 1000) << " MB/s), "
+		          << mismatches << " mismatches\n";
+	}
+}
+
+//
+// What tagging a MSG block costs: SipHash-2-4 fed the 33 bytes of the body a
+// byte at a time, as the receiver does while they arrive, and the
+// finalisation that checking the tag at the end comes down to. Next to it,
+// decrypting the block with ChaCha20, and the bytes it adds on the wire and
+// in SRAM.
+//
+void bench_block_tag() {
+	const int Blocks = 20000;
+	std::vector<uint64_t> update, finish, decrypt;
+	uint8_t block[33] = {0};
+	SipHash tag;
+	Keystream<ChaCha20, 32> ks;
+	ks.seed(0x5EED, 4);
+	uint64_t sink = 0;
+	for (int b = 0; b < Blocks; ++b) {
+		block[0] = b;
+		uint64_t start = cycles();
+		tag.begin(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
+		for (uint8_t i = 0; i < 33; ++i)
+			tag.update(block[i]);
+		uint64_t mid = cycles();
+		sink ^= tag.finish();
+		uint64_t end = cycles();
+		ks.seek((uint32_t)b * 32);
+		ks.xor_into(block + 1, 32);
+		decrypt.push_back(cycles() - end);
+		update.push_back(mid - start);
+		finish.push_back(end - mid);
+	}
+	std::cout << "block tags, SipHash-2-4, cycles per 32 byte block p50 / p99\n"
+	          << "  begin and 33 updates " << percentile(update, 0.5) << " / " << percentile(update, 0.99)
+	          << ", finish " << percentile(finish, 0.5) << " / " << percentile(finish, 0.99)
+	          << ", chacha20 decrypt " << percentile(decrypt, 0.5) << " / " << percentile(decrypt, 0.99)
+	          << (sink == 0x5A ? " " : "") << "\n"
+	          << "  wire " << (3 + 33 + 1) << " -> " << (3 + 33 + 8 + 1) << " bytes a block, state "
+	          << sizeof(SipHash) << " bytes a tag\n";
+}
+
+void bench_keystream() {
+	bench_mersenne_fill();
+	bench_mersenne_latency();
+	bench_mersenne_seeding();
+	std::cout << "keystream generators\n";
+	bench_keystream_gen<MersenneTwister>("MersenneTwister");
+	bench_keystream_gen<CounterGen>("CounterGen     ");
+	bench_keystream_gen<Xoshiro128>("Xoshiro128     ");
+	bench_keystream_gen<ChaCha20>("ChaCha20       ");
+	std::cout << "keystream cycles per byte decrypted, p50 / p99 / max\n";
+	bench_keystream_prefetch<MersenneTwister>("MersenneTwister");
+	bench_keystream_prefetch<CounterGen>("CounterGen     ");
+	bench_keystream_prefetch<Xoshiro128>("Xoshiro128     ");
+	std::cout << "keystream layouts, encrypting a buffer\n";
+	bench_keystream_xor<MersenneTwister>("MersenneTwister");
+	bench_keystream_xor<CounterGen>("CounterGen     ");
+	bench_keystream_xor<Xoshiro128>("Xoshiro128     ");
+	bench_keystream_xor<ChaCha20>("ChaCha20       ");
+	bench_chacha<8>();
+	bench_chacha<12>();
+	bench_chacha<20>();
+	bench_chacha_vs_mersenne();
+	bench_block_tag();
+}
+
+#endif
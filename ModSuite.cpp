@@ -0,0 +1,321 @@
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include "stdint.h"
+#include "ModArith.h"
+#include "LegacyMod.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Cross implementation benchmark for every modular arithmetic variant in the
+// repo, old and new, over a fixed set of input distributions.
+// Build with: g++ -O2 ModSuite.cpp -o ModSuite
+// Run as:     ./ModSuite [--json] [op]
+//
+// Each row is one (op, variant, distribution), with the time per op and the
+// number of results that disagree with a 128 bit reference. Output is CSV
+// (or one JSON object per line with --json), so runs can be diffed and
+// plotted. Inputs come from a fixed seed, so every run sees the same data.
+//
+// Notes on the inputs:
+//  - pow_mod moduli are odd, like any prime we'd be sent, so the Montgomery
+//    engine can run on all of them.
+//  - "full" operands are not reduced first. The new add_mod requires
+//    a, b < n, so its mismatches there are expected.
+//  - The runtime engines build their context on every call, since the
+//    modulus changes from one input to the next.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 RefUInt;
+#else
+typedef uint64_t RefUInt;
+#endif
+
+// one set of inputs: pow_mod(a, b, m), mul_mod(a, b, m), add_mod(a, b, m),
+// mulpow2_mod(a, b, m) or mod(a, b)
+struct Case {
+	uint32_t a, b, m;
+};
+
+const int CaseCount = 4096;
+Case Cases[CaseCount];
+uint32_t Reference[CaseCount];
+
+// minimum time spent on each row, the inputs are looped over until then
+double MinRowMs = 50;
+
+uint32_t suite_state;
+uint32_t suite_rand() {
+	suite_state ^= suite_state << 13;
+	suite_state ^= suite_state >> 17;
+	suite_state ^= suite_state << 5;
+	return suite_state;
+}
+
+double now_ns() {
+	return std::chrono::duration_cast<std::chrono::duration<double, std::nano> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 128 bit references
+//
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t ref_pow(const Case& c) {
+	RefUInt result = 1 % c.m;
+	RefUInt factor = c.a % c.m;
+	for (uint32_t e = c.b; e; e >>= 1) {
+		if (e & 0x1)
+			result = (result * factor) % c.m;
+		factor = (factor * factor) % c.m;
+	}
+	return result;
+}
+uint32_t ref_mul(const Case& c) { return ((RefUInt)c.a * c.b) % c.m; }
+uint32_t ref_add(const Case& c) { return ((RefUInt)c.a + c.b) % c.m; }
+uint32_t ref_mulpow2(const Case& c) { return ((RefUInt)c.a << c.b) % c.m; }
+
+// floored mod, with a % 0 defined as 0 like the sketch does
+uint32_t ref_smod(const Case& c) {
+	int64_t a = (int32_t)c.a, b = (int32_t)c.b;
+	if (b == 0)
+		return 0;
+	int64_t r = a % b;
+	if (r != 0 && ((r < 0) != (b < 0)))
+		r += b;
+	return (uint32_t)(int32_t)r;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Input distributions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t small_mod() { return 2 + suite_rand() % 0xFFFE; }
+uint32_t large_mod() { return suite_rand() | 0x80000000; }
+
+// exponent with 4 bits set, and one with ~3/4 of them set
+uint32_t sparse_exp() {
+	uint32_t e = 0;
+	for (int i = 0; i < 4; ++i)
+		e |= 1u << (suite_rand() % 32);
+	return e;
+}
+uint32_t dense_exp() { return suite_rand() | suite_rand(); }
+
+typedef void (*MakeCase)(Case& c);
+
+void pow_small_sparse(Case& c) { c.m = small_mod() | 1; c.a = suite_rand(); c.b = sparse_exp(); }
+void pow_small_dense(Case& c) { c.m = small_mod() | 1; c.a = suite_rand(); c.b = dense_exp(); }
+void pow_large_sparse(Case& c) { c.m = large_mod() | 1; c.a = suite_rand(); c.b = sparse_exp(); }
+void pow_large_dense(Case& c) { c.m = large_mod() | 1; c.a = suite_rand(); c.b = dense_exp(); }
+
+void ops_small_reduced(Case& c) { c.m = small_mod(); c.a = suite_rand() % c.m; c.b = suite_rand() % c.m; }
+void ops_small_full(Case& c) { c.m = small_mod(); c.a = suite_rand(); c.b = suite_rand(); }
+void ops_large_reduced(Case& c) { c.m = large_mod(); c.a = suite_rand() % c.m; c.b = suite_rand() % c.m; }
+void ops_large_full(Case& c) { c.m = large_mod(); c.a = suite_rand(); c.b = suite_rand(); }
+
+void pow2_small(Case& c) { c.m = small_mod(); c.a = suite_rand() % c.m; c.b = suite_rand() % 32; }
+void pow2_large(Case& c) { c.m = large_mod(); c.a = suite_rand() % c.m; c.b = suite_rand() % 32; }
+
+// signed operands of both signs, steering clear of INT_MIN (which mod()
+// can't negate), and with the occasional 0 divisor
+int32_t signed_operand(uint32_t limit) {
+	int32_t v = suite_rand() % limit;
+	return (suite_rand() & 1) ? -v : v;
+}
+void smod_small(Case& c) { c.a = signed_operand(0x7FFFFFFF); c.b = signed_operand(0x100); }
+void smod_large(Case& c) { c.a = signed_operand(0x7FFFFFFF); c.b = signed_operand(0x7FFFFFFF); }
+
+struct Distribution {
+	const char* Name;
+	MakeCase Make;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Variants under test
+//
+///////////////////////////////////////////////////////////////////////////////
+
+typedef uint32_t (*CaseFn)(const Case& c);
+
+struct Variant {
+	const char* Name;
+	CaseFn Fn;
+};
+
+uint32_t pow_project1(const Case& c) { return project1::pow_mod(c.a, c.b, c.m); }
+uint32_t pow_project1_part1(const Case& c) { return project1_part1::pow_mod(c.a, c.b, c.m); }
+uint32_t pow_project1_part2(const Case& c) { return project1_part2::pow_mod(c.a, c.b, c.m); }
+uint32_t pow_mod_test(const Case& c) { return mod_test::pow_mod(c.a, c.b, c.m); }
+uint32_t pow_modarith(const Case& c) { return pow_mod(c.a, c.b, ModArith<>(c.m)); }
+uint32_t pow_montgomery(const Case& c) { return pow_mod(c.a, c.b, MontgomeryMod(c.m)); }
+uint32_t pow_barrett(const Case& c) { return pow_mod(c.a, c.b, BarrettMod(c.m)); }
+
+uint32_t mul_project1_part2(const Case& c) { return project1_part2::mul_mod(c.a, c.b, c.m); }
+uint32_t mul_full_precision(const Case& c) { return full_precision::mul_mod(c.a, c.b, c.m); }
+uint32_t mul_double_add(const Case& c) { return mul_mod_double_add(c.a, c.b, c.m); }
+uint32_t mul_native(const Case& c) { return mul_mod_native(c.a, c.b, c.m); }
+uint32_t mul_modarith(const Case& c) { return mul_mod(c.a, c.b, ModArith<>(c.m)); }
+
+uint32_t add_project1_part2(const Case& c) { return project1_part2::add_mod(c.a, c.b, c.m); }
+uint32_t add_full_precision(const Case& c) { return full_precision::add_mod(c.a, c.b, c.m); }
+uint32_t add_modarith(const Case& c) { return add_mod(c.a, c.b, c.m); }
+
+uint32_t mulpow2_project1_part2(const Case& c) { return project1_part2::mulpow2_mod(c.a, c.b, c.m); }
+uint32_t mulpow2_full_precision(const Case& c) { return full_precision::mulpow2_mod(c.a, c.b, c.m); }
+
+uint32_t smod_project1_part2(const Case& c) { return project1_part2::mod(c.a, c.b); }
+
+struct Op {
+	const char* Name;
+	CaseFn Reference;
+	const Distribution* Distributions;
+	int DistributionCount;
+	const Variant* Variants;
+	int VariantCount;
+};
+
+const Distribution PowDistributions[] = {
+	{ "small_mod_sparse_exp", pow_small_sparse },
+	{ "small_mod_dense_exp", pow_small_dense },
+	{ "large_mod_sparse_exp", pow_large_sparse },
+	{ "large_mod_dense_exp", pow_large_dense },
+};
+const Distribution OpsDistributions[] = {
+	{ "small_mod_reduced", ops_small_reduced },
+	{ "small_mod_full", ops_small_full },
+	{ "large_mod_reduced", ops_large_reduced },
+	{ "large_mod_full", ops_large_full },
+};
+const Distribution Pow2Distributions[] = {
+	{ "small_mod", pow2_small },
+	{ "large_mod", pow2_large },
+};
+const Distribution SmodDistributions[] = {
+	{ "small_divisor", smod_small },
+	{ "large_divisor", smod_large },
+};
+
+const Variant PowVariants[] = {
+	{ "Project1", pow_project1 },
+	{ "Project1Part1", pow_project1_part1 },
+	{ "Project1Part2_legacy", pow_project1_part2 },
+	{ "ModTest_legacy", pow_mod_test },
+	{ "ModArith", pow_modarith },
+	{ "MontgomeryMod", pow_montgomery },
+	{ "BarrettMod", pow_barrett },
+};
+const Variant MulVariants[] = {
+	{ "Project1Part2_legacy", mul_project1_part2 },
+	{ "FullPrecisionMod_legacy", mul_full_precision },
+	{ "double_add", mul_double_add },
+	{ "native64", mul_native },
+	{ "ModArith", mul_modarith },
+};
+const Variant AddVariants[] = {
+	{ "Project1Part2_legacy", add_project1_part2 },
+	{ "FullPrecisionMod_legacy", add_full_precision },
+	{ "ModArith", add_modarith },
+};
+const Variant Mulpow2Variants[] = {
+	{ "Project1Part2_legacy", mulpow2_project1_part2 },
+	{ "FullPrecisionMod_legacy", mulpow2_full_precision },
+};
+const Variant SmodVariants[] = {
+	{ "Project1Part2", smod_project1_part2 },
+};
+
+#define COUNT_OF(x) (int)(sizeof(x) / sizeof((x)[0]))
+
+const Op Ops[] = {
+	{ "pow_mod", ref_pow, PowDistributions, COUNT_OF(PowDistributions), PowVariants, COUNT_OF(PowVariants) },
+	{ "mul_mod", ref_mul, OpsDistributions, COUNT_OF(OpsDistributions), MulVariants, COUNT_OF(MulVariants) },
+	{ "add_mod", ref_add, OpsDistributions, COUNT_OF(OpsDistributions), AddVariants, COUNT_OF(AddVariants) },
+	{ "mulpow2_mod", ref_mulpow2, Pow2Distributions, COUNT_OF(Pow2Distributions), Mulpow2Variants, COUNT_OF(Mulpow2Variants) },
+	{ "mod", ref_smod, SmodDistributions, COUNT_OF(SmodDistributions), SmodVariants, COUNT_OF(SmodVariants) },
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Runner
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// keeps the results live so the calls can't be optimised out
+volatile uint32_t Sink;
+
+struct Result {
+	uint64_t Ops;
+	double NsPerOp;
+	uint32_t Mismatches;
+};
+
+Result run_variant(CaseFn fn) {
+	Result res = { 0, 0, 0 };
+	for (int i = 0; i < CaseCount; ++i)
+		if (fn(Cases[i]) != Reference[i])
+			++res.Mismatches;
+
+	uint32_t sum = 0;
+	double start = now_ns(), elapsed = 0;
+	do {
+		for (int i = 0; i < CaseCount; ++i)
+			sum += fn(Cases[i]);
+		res.Ops += CaseCount;
+		elapsed = now_ns() - start;
+	} while (elapsed < MinRowMs * 1e6);
+	Sink = sum;
+	res.NsPerOp = elapsed / res.Ops;
+	return res;
+}
+
+void print_row(bool json, const char* op, const char* variant, const char* dist, const Result& r) {
+	double opsPerSec = 1e9 / r.NsPerOp;
+	if (json) {
+		std::cout << "{\"op\":\"" << op << "\",\"variant\":\"" << variant
+		          << "\",\"distribution\":\"" << dist << "\",\"ops\":" << r.Ops
+		          << ",\"ns_per_op\":" << r.NsPerOp << ",\"ops_per_s\":" << opsPerSec
+		          << ",\"mismatches\":" << r.Mismatches << ",\"cases\":" << CaseCount << "}\n";
+	} else {
+		std::cout << op << "," << variant << "," << dist << "," << r.Ops << ","
+		          << r.NsPerOp << "," << opsPerSec << "," << r.Mismatches << ","
+		          << CaseCount << "\n";
+	}
+}
+
+int main(int argc, char** argv) {
+	bool json = false;
+	const char* only = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--json"))
+			json = true;
+		else
+			only = argv[i];
+	}
+
+	if (!json)
+		std::cout << "op,variant,distribution,ops,ns_per_op,ops_per_s,mismatches,cases\n";
+	for (int o = 0; o < COUNT_OF(Ops); ++o) {
+		const Op& op = Ops[o];
+		if (only && strcmp(only, op.Name))
+			continue;
+		for (int d = 0; d < op.DistributionCount; ++d) {
+			suite_state = 0x2545F491 + 7919 * (o * 16 + d);
+			for (int i = 0; i < CaseCount; ++i) {
+				op.Distributions[d].Make(Cases[i]);
+				Reference[i] = op.Reference(Cases[i]);
+			}
+			for (int v = 0; v < op.VariantCount; ++v) {
+				Result r = run_variant(op.Variants[v].Fn);
+				print_row(json, op.Name, op.Variants[v].Name, op.Distributions[d].Name, r);
+			}
+		}
+	}
+}
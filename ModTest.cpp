@@ -1,30 +1,29 @@
-
 #include "stdint.h"
 #include <iostream>
+#include <cstring>
+#include "ModArith.h"
+#include "BatchRunner.h"
 
-uint32_t pow_mod(uint32_t base, uint32_t exponent, uint32_t modulus) {
-	int64_t result = 1;
-	for (int place = 0; place < 32; ++place) {
-		if ((exponent>>place) & 0x1) {
-			//this place should be calculated
-			int64_t factor = base;
-			for (int i = 0; i < place; ++i)
-				factor = (factor*factor) % modulus;
-			//multiply the place to the result
-			result = (result*factor) % modulus;
+// base^ex % mod for every (base, ex, mod) record, in decimal.
+// Build with: g++ -O2 -pthread ModTest.cpp -o ModTest
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		BatchOptions opts;
+		if (std::strcmp(argv[1], "--batch") || !parse_batch_options(argc, argv, opts)) {
+			batch_usage(argv[0], "base, ex, mod");
+			return 2;
 		}
+		return run_batch(opts, [](uint32_t base, uint32_t ex, uint32_t mod) {
+			return pow_mod(base, ex, ModArith<>(mod));
+		});
 	}
-	return result;
-}
 
-int main() {
 	while (true) {
 		std::cout << "> ";
-		int32_t base, ex, mod;
-		std::cin >> base;
-		std::cin >> ex;
-		std::cin >> mod;
+		uint32_t base, ex, mod;
+		if (!(std::cin >> base >> ex >> mod))
+			break;
 		std::cout << "\n";
-		std::cout << "Res: " << pow_mod(base, ex, mod) << "\n";
+		std::cout << "Res: " << pow_mod(base, ex, ModArith<>(mod)) << "\n";
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,455 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "stdint.h"
+#include "ModArith.h"
+#include "LegacyMod.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Parallel verification of the modular primitives against a 128 bit oracle.
+// Build with: g++ -O2 -pthread ModVerify.cpp -o ModVerify
+//
+// Every check is a numbered case, and the numbers are split into chunks that
+// the worker threads claim from a shared counter. A thread that finishes
+// early just claims the next chunk, so the load balances itself without any
+// per-thread queues, and it scales with the number of cores.
+//
+// Two ways of numbering the cases:
+//  exhaustive: every (a, b) with a < A and b < B against one modulus, e.g.
+//              all pairs of residues mod a 16 bit prime.
+//  sample:     stratified random cases. Case i uses a modulus of
+//              1 + i % 32 bits and one of four operand classes (random,
+//              reduced, edges near 0 and m, top bits set), all drawn from a
+//              hash of i so that any case can be rebuilt from its number.
+//
+// The chunks below a watermark are all done, and the watermark is written to
+// the checkpoint file every few seconds (and at the end), so a run that gets
+// killed can pick up where it was with --resume.
+//
+// Usage:
+//  ModVerify <target> exhaustive <mod> [A] [B] [options]
+//  ModVerify <target> sample <count> [options]
+//  ModVerify list
+// Options:
+//  --threads N       worker threads (default: all cores)
+//  --checkpoint FILE where to save progress (default: ModVerify.ckpt)
+//  --resume          carry on from the checkpoint file
+//  --seed S          seed for sample mode
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 OracleUInt;
+#else
+#error "ModVerify needs a 128 bit integer type for its oracle"
+#endif
+
+enum VerifyOp {
+	VerifyAdd,
+	VerifyMul,
+	VerifyPow,
+};
+
+// the function under test, as f(a, b, m)
+typedef uint32_t (*VerifyFn)(uint32_t a, uint32_t b, uint32_t m);
+
+struct Target {
+	const char* Name;
+	VerifyOp Op;
+	VerifyFn Fn;
+	bool Reduced;  // operands must already be < m
+	bool OddOnly;  // modulus must be odd
+};
+
+uint32_t verify_add(uint32_t a, uint32_t b, uint32_t m) { return add_mod(a, b, m); }
+uint32_t verify_mul(uint32_t a, uint32_t b, uint32_t m) { return mul_mod(a, b, m); }
+uint32_t verify_mul_double_add(uint32_t a, uint32_t b, uint32_t m) { return mul_mod_double_add(a, b, m); }
+uint32_t verify_mul_native(uint32_t a, uint32_t b, uint32_t m) { return mul_mod_native(a, b, m); }
+uint32_t verify_mul_modarith(uint32_t a, uint32_t b, uint32_t m) { return mul_mod(a, b, ModArith<>(m)); }
+uint32_t verify_pow_modarith(uint32_t a, uint32_t b, uint32_t m) { return pow_mod(a, b, ModArith<>(m)); }
+uint32_t verify_pow_montgomery(uint32_t a, uint32_t b, uint32_t m) { return pow_mod(a, b, MontgomeryMod(m)); }
+uint32_t verify_pow_barrett(uint32_t a, uint32_t b, uint32_t m) { return pow_mod(a, b, BarrettMod(m)); }
+// the modulus is fixed at 0x7FFFFFFF, so the case's m goes unused
+uint32_t verify_pow_fixed(uint32_t a, uint32_t b, uint32_t) { return pow_mod(a, b, ModArith<0x7FFFFFFF>()); }
+uint32_t verify_legacy_add(uint32_t a, uint32_t b, uint32_t m) { return project1_part2::add_mod(a, b, m); }
+uint32_t verify_legacy_mul(uint32_t a, uint32_t b, uint32_t m) { return project1_part2::mul_mod(a, b, m); }
+uint32_t verify_legacy_pow(uint32_t a, uint32_t b, uint32_t m) { return project1_part2::pow_mod(a, b, m); }
+
+const Target Targets[] = {
+	{ "add_mod", VerifyAdd, verify_add, true, false },
+	{ "mul_mod", VerifyMul, verify_mul, false, false },
+	{ "mul_mod_double_add", VerifyMul, verify_mul_double_add, false, false },
+	{ "mul_mod_native", VerifyMul, verify_mul_native, false, false },
+	{ "mul_mod_modarith", VerifyMul, verify_mul_modarith, false, false },
+	{ "pow_mod", VerifyPow, verify_pow_modarith, false, false },
+	{ "pow_mod_montgomery", VerifyPow, verify_pow_montgomery, false, true },
+	{ "pow_mod_barrett", VerifyPow, verify_pow_barrett, false, false },
+	// only meaningful with exhaustive mode and mod 7fffffff
+	{ "pow_mod_7fffffff", VerifyPow, verify_pow_fixed, false, false },
+	// the pre-ModArith Project1Part2.cpp code, to see it fail
+	{ "legacy_add_mod", VerifyAdd, verify_legacy_add, false, false },
+	{ "legacy_mul_mod", VerifyMul, verify_legacy_mul, false, false },
+	{ "legacy_pow_mod", VerifyPow, verify_legacy_pow, false, false },
+};
+const int TargetCount = sizeof(Targets) / sizeof(Targets[0]);
+
+uint32_t oracle(VerifyOp op, uint32_t a, uint32_t b, uint32_t m) {
+	switch (op) {
+	case VerifyAdd:
+		return ((OracleUInt)a + b) % m;
+	case VerifyMul:
+		return ((OracleUInt)a * b) % m;
+	default: {
+		OracleUInt result = 1 % m;
+		OracleUInt factor = a % m;
+		for (; b; b >>= 1) {
+			if (b & 0x1)
+				result = (result * factor) % m;
+			factor = (factor * factor) % m;
+		}
+		return result;
+	}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Case numbering
+//
+///////////////////////////////////////////////////////////////////////////////
+
+enum VerifyMode {
+	ExhaustiveMode,
+	SampleMode,
+};
+
+struct Space {
+	VerifyMode Mode;
+	uint64_t Total;
+	uint32_t Modulus;  // exhaustive only
+	uint64_t RangeA;
+	uint64_t RangeB;
+	uint64_t Seed;     // sample only
+};
+
+// splitmix64, so each sample case is a pure function of its number
+uint64_t mix64(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+void make_case(const Space& space, const Target& target, uint64_t index,
+               uint32_t& a, uint32_t& b, uint32_t& m) {
+	if (space.Mode == ExhaustiveMode) {
+		m = space.Modulus;
+		a = index / space.RangeB;
+		b = index % space.RangeB;
+	} else {
+		uint64_t r0 = mix64(space.Seed ^ index);
+		uint64_t r1 = mix64(r0);
+		uint8_t bits = 1 + index % 32;
+		uint32_t top = 1u << (bits - 1);
+		m = top | ((uint32_t)r0 & (top - 1));
+		if (target.OddOnly)
+			m |= 1;
+		switch ((index / 32) % 4) {
+		case 0:
+			// anything at all
+			a = r1;
+			b = r1 >> 32;
+			break;
+		case 1:
+			// already reduced
+			a = (uint32_t)r1 % m;
+			b = (uint32_t)(r1 >> 32) % m;
+			break;
+		case 2:
+			// a handful either side of 0 and m, where carries go wrong
+			a = (r1 & 1) ? m - 1 - (uint32_t)((r1 >> 1) & 3) : (uint32_t)((r1 >> 1) & 3);
+			b = (r1 & 8) ? m - 1 - (uint32_t)((r1 >> 4) & 3) : (uint32_t)((r1 >> 4) & 3);
+			if (a >= m) a = 0;
+			if (b >= m) b = 0;
+			break;
+		default:
+			// top bits set
+			a = (uint32_t)r1 | 0xC0000000;
+			b = (uint32_t)(r1 >> 32) | 0xC0000000;
+			break;
+		}
+	}
+	if (target.OddOnly && !(m & 1))
+		m |= 1;
+	if (target.Reduced) {
+		a %= m;
+		b %= m;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Checkpoints
+// The file holds a single line with everything needed to check that a
+// resume is for the same run:
+//  target mode total modulus rangeA rangeB seed watermark failures
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct Checkpoint {
+	std::string Target;
+	Space Where;
+	uint64_t Watermark;
+	uint64_t Failures;
+};
+
+bool save_checkpoint(const std::string& path, const Checkpoint& c) {
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream out(tmp.c_str());
+		if (!out)
+			return false;
+		out << c.Target << " " << (int)c.Where.Mode << " " << c.Where.Total << " "
+		    << c.Where.Modulus << " " << c.Where.RangeA << " " << c.Where.RangeB << " "
+		    << c.Where.Seed << " " << c.Watermark << " " << c.Failures << "\n";
+		if (!out)
+			return false;
+	}
+	// rename is atomic, so a crash mid-write never leaves half a checkpoint
+	return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool load_checkpoint(const std::string& path, Checkpoint& c) {
+	std::ifstream in(path.c_str());
+	int mode;
+	if (!(in >> c.Target >> mode >> c.Where.Total >> c.Where.Modulus >> c.Where.RangeA
+	         >> c.Where.RangeB >> c.Where.Seed >> c.Watermark >> c.Failures))
+		return false;
+	c.Where.Mode = (VerifyMode)mode;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The run itself
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const uint64_t ChunkSize = 1 << 20;
+const int MaxReportedFailures = 20;
+
+struct Run {
+	const Target* Test;
+	Space Where;
+	uint64_t FirstChunk;
+	uint64_t ChunkCount;
+
+	std::atomic<uint64_t> NextChunk;
+	std::atomic<uint64_t> Failures;
+
+	// chunks finish out of order, the watermark only moves over a run of
+	// finished ones
+	std::mutex Lock;
+	std::vector<bool> Finished;
+	uint64_t Watermark;
+	int Reported;
+};
+
+void check_chunk(Run& run, uint64_t chunk) {
+	const Target& target = *run.Test;
+	uint64_t begin = chunk * ChunkSize;
+	uint64_t end = begin + ChunkSize;
+	if (end > run.Where.Total)
+		end = run.Where.Total;
+
+	uint64_t failures = 0;
+	for (uint64_t i = begin; i < end; ++i) {
+		uint32_t a, b, m;
+		make_case(run.Where, target, i, a, b, m);
+		uint32_t got = target.Fn(a, b, m);
+		uint32_t want = oracle(target.Op, a, b, m);
+		if (got != want) {
+			++failures;
+			std::lock_guard<std::mutex> guard(run.Lock);
+			if (run.Reported < MaxReportedFailures) {
+				++run.Reported;
+				std::printf("FAIL case %llu: %s(%08x, %08x, %08x) = %08x, expected %08x\n",
+				            (unsigned long long)i, target.Name, a, b, m, got, want);
+			}
+		}
+	}
+	run.Failures += failures;
+
+	std::lock_guard<std::mutex> guard(run.Lock);
+	run.Finished[chunk - run.FirstChunk] = true;
+	while (run.Watermark < run.FirstChunk + run.ChunkCount &&
+	       run.Finished[run.Watermark - run.FirstChunk])
+		++run.Watermark;
+}
+
+void worker(Run* run) {
+	while (true) {
+		uint64_t chunk = run->NextChunk++;
+		if (chunk >= run->FirstChunk + run->ChunkCount)
+			return;
+		check_chunk(*run, chunk);
+	}
+}
+
+double now_s() {
+	return std::chrono::duration_cast<std::chrono::duration<double> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int usage() {
+	std::cerr << "usage: ModVerify <target> exhaustive <mod> [A] [B] [options]\n"
+	          << "       ModVerify <target> sample <count> [options]\n"
+	          << "       ModVerify list\n"
+	          << "options: --threads N  --checkpoint FILE  --resume  --seed S\n";
+	return 2;
+}
+
+int main(int argc, char** argv) {
+	if (argc >= 2 && !strcmp(argv[1], "list")) {
+		for (int i = 0; i < TargetCount; ++i)
+			std::cout << Targets[i].Name << "\n";
+		return 0;
+	}
+
+	std::vector<const char*> args;
+	unsigned threads = std::thread::hardware_concurrency();
+	std::string checkpointPath = "ModVerify.ckpt";
+	bool resume = false;
+	uint64_t seed = 0x5EED;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			threads = strtoul(argv[++i], 0, 0);
+		else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc)
+			checkpointPath = argv[++i];
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+			seed = strtoull(argv[++i], 0, 0);
+		else if (!strcmp(argv[i], "--resume"))
+			resume = true;
+		else
+			args.push_back(argv[i]);
+	}
+	if (threads == 0)
+		threads = 1;
+	if (args.size() < 3)
+		return usage();
+
+	const Target* target = 0;
+	for (int i = 0; i < TargetCount; ++i)
+		if (!strcmp(args[0], Targets[i].Name))
+			target = &Targets[i];
+	if (!target) {
+		std::cerr << "unknown target " << args[0] << ", see ModVerify list\n";
+		return 2;
+	}
+
+	Space where = { SampleMode, 0, 0, 0, 0, seed };
+	if (!strcmp(args[1], "exhaustive")) {
+		where.Mode = ExhaustiveMode;
+		where.Modulus = strtoul(args[2], 0, 0);
+		where.RangeA = args.size() > 3 ? strtoull(args[3], 0, 0) : where.Modulus;
+		where.RangeB = args.size() > 4 ? strtoull(args[4], 0, 0) : where.Modulus;
+		if (where.Modulus == 0 || where.RangeA == 0 || where.RangeB == 0 ||
+		    where.RangeA > 0x100000000ull || where.RangeB > 0x100000000ull) {
+			std::cerr << "the modulus must be non-zero and A, B at most 2^32\n";
+			return 2;
+		}
+		where.Total = where.RangeA * where.RangeB;
+	} else if (!strcmp(args[1], "sample")) {
+		where.Total = strtoull(args[2], 0, 0);
+	} else {
+		return usage();
+	}
+
+	Run run;
+	run.Test = target;
+	run.Where = where;
+	run.FirstChunk = 0;
+	run.Failures = 0;
+	if (resume) {
+		Checkpoint saved;
+		if (!load_checkpoint(checkpointPath, saved)) {
+			std::cerr << "can't read checkpoint " << checkpointPath << "\n";
+			return 2;
+		}
+		if (saved.Target != target->Name || saved.Where.Mode != where.Mode ||
+		    saved.Where.Total != where.Total || saved.Where.Modulus != where.Modulus ||
+		    saved.Where.RangeB != where.RangeB || saved.Where.Seed != where.Seed) {
+			std::cerr << "checkpoint " << checkpointPath << " is for a different run\n";
+			return 2;
+		}
+		run.FirstChunk = saved.Watermark;
+		run.Failures = saved.Failures;
+	}
+	uint64_t totalChunks = (where.Total + ChunkSize - 1) / ChunkSize;
+	run.ChunkCount = run.FirstChunk < totalChunks ? totalChunks - run.FirstChunk : 0;
+	run.NextChunk = run.FirstChunk;
+	run.Finished.assign(run.ChunkCount, false);
+	run.Watermark = run.FirstChunk;
+	run.Reported = 0;
+
+	std::cout << target->Name << ": " << where.Total << " cases, "
+	          << (run.FirstChunk * ChunkSize < where.Total ? where.Total - run.FirstChunk * ChunkSize : 0)
+	          << " to go, " << threads << " threads\n";
+
+	double start = now_s();
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < threads; ++i)
+		pool.push_back(std::thread(worker, &run));
+
+	// progress and checkpoints from the main thread while the workers run
+	Checkpoint progress = { target->Name, where, 0, 0 };
+	uint64_t startMark = run.FirstChunk;
+	double lastSave = start;
+	while (true) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		uint64_t mark;
+		{
+			std::lock_guard<std::mutex> guard(run.Lock);
+			mark = run.Watermark;
+		}
+		bool done = mark >= run.FirstChunk + run.ChunkCount;
+		if (done || now_s() - lastSave > 5) {
+			progress.Watermark = mark;
+			progress.Failures = run.Failures;
+			if (!save_checkpoint(checkpointPath, progress))
+				std::cerr << "couldn't write checkpoint " << checkpointPath << "\n";
+			lastSave = now_s();
+			double elapsed = lastSave - start;
+			uint64_t checked = (mark - startMark) * ChunkSize;
+			std::printf("  %.1f%% done, %.3g cases/s, %llu failures\n",
+			            totalChunks ? 100.0 * mark / totalChunks : 100.0,
+			            elapsed > 0 ? checked / elapsed : 0.0,
+			            (unsigned long long)run.Failures);
+			std::fflush(stdout);
+		}
+		if (done)
+			break;
+	}
+	for (unsigned i = 0; i < threads; ++i)
+		pool[i].join();
+
+	double elapsed = now_s() - start;
+	uint64_t checked = (run.FirstChunk + run.ChunkCount) * ChunkSize;
+	if (checked > where.Total)
+		checked = where.Total;
+	checked -= run.FirstChunk * ChunkSize < checked ? run.FirstChunk * ChunkSize : checked;
+	std::printf("%s: %llu cases in %.2f s (%.3g cases/s on %u threads), %llu failures\n",
+	            target->Name, (unsigned long long)checked, elapsed,
+	            elapsed > 0 ? checked / elapsed : 0.0, threads,
+	            (unsigned long long)run.Failures);
+	return run.Failures ? 1 : 0;
+}
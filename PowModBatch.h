@@ -0,0 +1,244 @@
+#ifndef POWMODBATCH_H
+#define POWMODBATCH_H
+
+#include "stdint.h"
+#include <stddef.h>
+#include "ModArith.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Batched pow_mod for the host side tools.
+// pow_mod_batch(bases, exps, mod, out, n) computes out[i] = bases[i]^exps[i]
+// mod n for a whole array at once, with one Montgomery context shared by
+// every element. On x86 the exponentiations run side by side in SIMD lanes,
+// one 32 bit value per 64 bit lane:
+//  - AVX2: 4 lanes per vector, 4 vectors in flight
+//  - SSE4.1: 2 lanes per vector, 4 vectors in flight
+// The kernel is picked at runtime from what the CPU supports. Even moduli
+// (no Montgomery form), left over elements and other targets go through the
+// scalar pow_mod, so the results are the same as pow_mod(b, e, ModArith<>(n))
+// in every case.
+//
+// Each lane runs plain left to right square and multiply over the longest
+// exponent in its block, selecting between the base and 1 for the multiply,
+// since lanes can't each take their own path through a sliding window.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+enum PowModKernel {
+	PowModScalar,
+	PowModSse4,
+	PowModAvx2,
+};
+
+inline const char* pow_mod_kernel_name(PowModKernel kernel) {
+	switch (kernel) {
+	case PowModAvx2: return "avx2";
+	case PowModSse4: return "sse4.1";
+	default: return "scalar";
+	}
+}
+
+// the scalar path, and the tail of the SIMD ones
+inline void pow_mod_batch_scalar(const uint32_t* bases, const uint32_t* exps,
+                                 const ModArith<>& arith, uint32_t* out, size_t n) {
+	for (size_t i = 0; i < n; ++i)
+		out[i] = pow_mod(bases[i], exps[i], arith);
+}
+
+// number of bits in the longest exponent of a block
+inline uint8_t pow_mod_batch_bits(const uint32_t* exps, size_t n) {
+	uint32_t all = 0;
+	for (size_t i = 0; i < n; ++i)
+		all |= exps[i];
+	return mod_bits(all);
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define POW_MOD_BATCH_SIMD 1
+#include <immintrin.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The Montgomery reduction per lane is the same as MontgomeryMod::redc, with
+// the carry handled without ever needing 65 bits:
+//   t = a*b, m = t_lo * n', u = (t + m*n) >> 32
+// The low half of t + m*n is zero by construction, so it carries into the
+// high half exactly when t_lo != 0, giving
+//   u = t_hi + (m*n)_hi + (t_lo != 0)
+// which is < 2n and fits a 64 bit lane. One conditional subtract finishes it;
+// the sign of u - n picks which one to keep.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("avx2")))
+inline __m256i pow_mod_avx2_mul(__m256i a, __m256i b, __m256i mod, __m256i nprime) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lowMask = _mm256_set1_epi64x(0xFFFFFFFF);
+	__m256i t = _mm256_mul_epu32(a, b);
+	__m256i m = _mm256_mul_epu32(t, nprime);
+	__m256i mn = _mm256_mul_epu32(m, mod);
+	__m256i carry = _mm256_andnot_si256(
+		_mm256_cmpeq_epi64(_mm256_and_si256(t, lowMask), zero), _mm256_set1_epi64x(1));
+	__m256i u = _mm256_add_epi64(_mm256_add_epi64(_mm256_srli_epi64(t, 32),
+		_mm256_srli_epi64(mn, 32)), carry);
+	__m256i d = _mm256_sub_epi64(u, mod);
+	return _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(d),
+		_mm256_castsi256_pd(u), _mm256_castsi256_pd(d)));
+}
+
+__attribute__((target("avx2")))
+inline void pow_mod_batch_avx2(const uint32_t* bases, const uint32_t* exps,
+                               const MontgomeryMod& mont, uint32_t* out, size_t n) {
+	const int Vecs = 4;
+	const size_t Block = 4 * Vecs;
+	const __m256i mod = _mm256_set1_epi64x(mont.modulus());
+	const __m256i nprime = _mm256_set1_epi64x(mont.n_prime());
+	const __m256i r2 = _mm256_set1_epi64x(mont.r_squared());
+	const __m256i one = _mm256_set1_epi64x(mont.one());
+	const __m256i plainOne = _mm256_set1_epi64x(1);
+	const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+	size_t i = 0;
+	for (; i + Block <= n; i += Block) {
+		uint8_t bits = pow_mod_batch_bits(exps + i, Block);
+		// line the top exponent bit of the block up with bit 63 of each lane,
+		// so the lane sign picks the multiplier
+		__m128i align = _mm_cvtsi32_si128(64 - bits);
+		__m256i base[Vecs], exp[Vecs], result[Vecs];
+		for (int v = 0; v < Vecs; ++v) {
+			__m256i b = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)(bases + i + 4*v)));
+			base[v] = pow_mod_avx2_mul(b, r2, mod, nprime);
+			exp[v] = _mm256_sll_epi64(_mm256_cvtepu32_epi64(
+				_mm_loadu_si128((const __m128i*)(exps + i + 4*v))), align);
+			result[v] = one;
+		}
+		for (uint8_t bit = 0; bit < bits; ++bit) {
+			for (int v = 0; v < Vecs; ++v) {
+				__m256i factor = _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(one),
+					_mm256_castsi256_pd(base[v]), _mm256_castsi256_pd(exp[v])));
+				result[v] = pow_mod_avx2_mul(result[v], result[v], mod, nprime);
+				result[v] = pow_mod_avx2_mul(result[v], factor, mod, nprime);
+				exp[v] = _mm256_slli_epi64(exp[v], 1);
+			}
+		}
+		for (int v = 0; v < Vecs; ++v) {
+			__m256i r = pow_mod_avx2_mul(result[v], plainOne, mod, nprime);
+			r = _mm256_permutevar8x32_epi32(r, pack);
+			_mm_storeu_si128((__m128i*)(out + i + 4*v), _mm256_castsi256_si128(r));
+		}
+	}
+	ModArith<> arith(mont.modulus());
+	pow_mod_batch_scalar(bases + i, exps + i, arith, out + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+inline __m128i pow_mod_sse4_mul(__m128i a, __m128i b, __m128i mod, __m128i nprime) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowMask = _mm_set1_epi64x(0xFFFFFFFF);
+	__m128i t = _mm_mul_epu32(a, b);
+	__m128i m = _mm_mul_epu32(t, nprime);
+	__m128i mn = _mm_mul_epu32(m, mod);
+	__m128i carry = _mm_andnot_si128(
+		_mm_cmpeq_epi64(_mm_and_si128(t, lowMask), zero), _mm_set1_epi64x(1));
+	__m128i u = _mm_add_epi64(_mm_add_epi64(_mm_srli_epi64(t, 32),
+		_mm_srli_epi64(mn, 32)), carry);
+	__m128i d = _mm_sub_epi64(u, mod);
+	return _mm_castpd_si128(_mm_blendv_pd(_mm_castsi128_pd(d),
+		_mm_castsi128_pd(u), _mm_castsi128_pd(d)));
+}
+
+__attribute__((target("sse4.1")))
+inline void pow_mod_batch_sse4(const uint32_t* bases, const uint32_t* exps,
+                               const MontgomeryMod& mont, uint32_t* out, size_t n) {
+	const int Vecs = 4;
+	const size_t Block = 2 * Vecs;
+	const __m128i mod = _mm_set1_epi64x(mont.modulus());
+	const __m128i nprime = _mm_set1_epi64x(mont.n_prime());
+	const __m128i r2 = _mm_set1_epi64x(mont.r_squared());
+	const __m128i one = _mm_set1_epi64x(mont.one());
+	const __m128i plainOne = _mm_set1_epi64x(1);
+
+	size_t i = 0;
+	for (; i + Block <= n; i += Block) {
+		uint8_t bits = pow_mod_batch_bits(exps + i, Block);
+		__m128i align = _mm_cvtsi32_si128(64 - bits);
+		__m128i base[Vecs], exp[Vecs], result[Vecs];
+		for (int v = 0; v < Vecs; ++v) {
+			__m128i b = _mm_cvtepu32_epi64(_mm_loadl_epi64((const __m128i*)(bases + i + 2*v)));
+			base[v] = pow_mod_sse4_mul(b, r2, mod, nprime);
+			exp[v] = _mm_sll_epi64(_mm_cvtepu32_epi64(
+				_mm_loadl_epi64((const __m128i*)(exps + i + 2*v))), align);
+			result[v] = one;
+		}
+		for (uint8_t bit = 0; bit < bits; ++bit) {
+			for (int v = 0; v < Vecs; ++v) {
+				__m128i factor = _mm_castpd_si128(_mm_blendv_pd(_mm_castsi128_pd(one),
+					_mm_castsi128_pd(base[v]), _mm_castsi128_pd(exp[v])));
+				result[v] = pow_mod_sse4_mul(result[v], result[v], mod, nprime);
+				result[v] = pow_mod_sse4_mul(result[v], factor, mod, nprime);
+				exp[v] = _mm_slli_epi64(exp[v], 1);
+			}
+		}
+		for (int v = 0; v < Vecs; ++v) {
+			__m128i r = pow_mod_sse4_mul(result[v], plainOne, mod, nprime);
+			r = _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storel_epi64((__m128i*)(out + i + 2*v), r);
+		}
+	}
+	ModArith<> arith(mont.modulus());
+	pow_mod_batch_scalar(bases + i, exps + i, arith, out + i, n - i);
+}
+
+#else
+#define POW_MOD_BATCH_SIMD 0
+#endif
+
+// best kernel this CPU can run
+inline PowModKernel pow_mod_batch_kernel() {
+#if POW_MOD_BATCH_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return PowModAvx2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return PowModSse4;
+#endif
+	return PowModScalar;
+}
+
+//
+// pow_mod_batch_with:
+// Same as pow_mod_batch, with the kernel given explicitly (for the benchmark
+// and tests). Asking for a kernel the CPU can't run is the caller's problem.
+//
+inline void pow_mod_batch_with(PowModKernel kernel, const uint32_t* bases, const uint32_t* exps,
+                               uint32_t mod, uint32_t* out, size_t n) {
+	ModArith<> arith(mod);
+	MontgomeryMod mont(mod);
+	if (!mont.valid())
+		kernel = PowModScalar;
+	switch (kernel) {
+#if POW_MOD_BATCH_SIMD
+	case PowModAvx2:
+		pow_mod_batch_avx2(bases, exps, mont, out, n);
+		break;
+	case PowModSse4:
+		pow_mod_batch_sse4(bases, exps, mont, out, n);
+		break;
+#endif
+	default:
+		pow_mod_batch_scalar(bases, exps, arith, out, n);
+		break;
+	}
+}
+
+//
+// pow_mod_batch:
+// out[i] = bases[i]^exps[i] mod mod for i < n, on the fastest kernel available
+//
+inline void pow_mod_batch(const uint32_t* bases, const uint32_t* exps, uint32_t mod,
+                          uint32_t* out, size_t n) {
+	static const PowModKernel kernel = pow_mod_batch_kernel();
+	pow_mod_batch_with(kernel, bases, exps, mod, out, n);
+}
+
+#endif
@@ -1,5 +1,20 @@
 
 //#include "stdint.h"
+#include "ModArith.h"
+#include "FixedBaseTables.h"
+#include "GroupCheck.h"
+#include "KeystreamGen.h"
+
+// Keystream generator, from KeystreamGen.h. Both sides have to agree.
+#ifndef KEYSTREAM_GEN
+#define KEYSTREAM_GEN MersenneTwister
+#endif
+
+// This is the original protocol: KEY, RSP and MSG each end with a ';' that
+// is checked as the message's integrity byte, every MSG is one character,
+// and nothing is tagged. The keystream versions and the MAC tags are only in
+// Project1Part2.cpp, whose messages end with '\0', so the two sketches don't
+// talk to each other.
 
 // int16_t analogRead(int p);
 // class SerialH {
@@ -14,58 +29,6 @@
 // SerialH Serial1;
 // SerialH Serial;
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// Mersenne Twister random number generator implementation
-//
-///////////////////////////////////////////////////////////////////////////////
-
-class MersenneTwister {
-public:
-	MersenneTwister(): index(0) {
-		seed(0xDEADB08F);
-	}
-	//
-	void seed(uint32_t seed) {
-		index = 0;
-		MT[0] = seed;
-		for (int i = 1; i < 624; ++i) {
-			uint64_t v = MT[i-1];
-			MT[i] = (0x6C078965*(v ^ (v>>30)) + i);
-		}
-	}
-	//
-	uint32_t next_uint32() {
-		if (index == 0)
-			update();
-		//
-		uint64_t y = MT[index];
-		y ^= (y>>11);
-		y ^= ((y<<11) & 0x9D2C5680);
-		y ^= ((y<<15) & 0xEFC60000);
-		y ^= (y>>18);
-		//
-		index = (index+1)%624;
-		return y;
-	}
-	
-private:
-	void update() {
-		for (int i = 0; i < 624; ++i) {
-			int32_t y = (MT[i]>>31) + (0x8FFFFFFF & MT[(i+1)%624]);
-			MT[i] = MT[(i+397)%624] ^ (y>>1);
-			if (y%2 != 0) {
-				MT[i] ^= 0x9908B0DF;
-			}
-		}
-	}
-
-	uint32_t MT[624];
-	uint32_t index;
-};
-
-
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Utility to read random noise off of serial ports.
@@ -83,38 +46,6 @@ uint16_t analog_noise() {
 
 
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// Utility to calculate the power of large numbers, mod a modulus.
-//
-///////////////////////////////////////////////////////////////////////////////
-
-uint32_t pow_mod(uint16_t base, uint32_t exponent, uint64_t modulus) {
-	//
-	// Idea: 
-	// Outer loop: b^e %c => Product[i: 0->32]( b^(Bit[e,i] * 2^i) %c ) %c
-	// For the bits which have Bit[e,i] = 1 :
-	//   Inner loop: b^(2^i) => b^2 iteratively for i times 
-	// 
-	uint32_t shift;
-	uint32_t result = 1;
-	for (uint8_t place = 0; shift = exponent>>place; ++place) {
-		// if we have a 1 bit, we need to calculate b^(2^place) and multiply
-		// it to the product
-		if (shift & 0x1) {
-			int64_t factor = base;
-			// square base iteratively to get the factor
-			for (uint8_t i = 0; i < place; ++i)
-				factor = (factor*factor) % modulus;
-			// multiply the place to the result
-			result = (result*factor) % modulus;
-		}
-	}
-	return result;
-}
-
-
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Main state tracking for the encrypted communications
@@ -127,18 +58,30 @@ enum EncryptStatus {
 	Ready,
 	Failed,
 };
+template <class RandomGen = MersenneTwister>
 class EncryptState {
 public:
-	EncryptState(): PrimeMod(0x7FFFFFFF), Generator(16807),
+	static const uint32_t DefaultPrimeMod = 0x7FFFFFFF;
+	static const uint32_t DefaultGenerator = 16807;
+
+	EncryptState(): PrimeMod(DefaultPrimeMod), Generator(DefaultGenerator),
 	                MyPublicKey(0), OtherPublicKey(0),
 	                SecretKey(0), MyKey(0),
 	                Status(NeedInit), 
 	                MyMessageIndex(0), OtherMessageIndex(0) {
-
+		Arith.set_modulus(PrimeMod);
 	}
 
 	uint32_t PrimeMod;
 	uint32_t Generator;
+
+	//Runtime arithmetic context for PrimeMod, rebuilt by set_group whenever
+	//we are sent new parameters.
+	ModArith<> Arith;
+
+	//Groups the other side has sent us that we've already checked, so that
+	//validating a repeat handshake is just a lookup.
+	GroupCache Groups;
 	
 	//Diffie Helman key exchange info
 	uint32_t MyPublicKey;
@@ -147,8 +90,8 @@ public:
 	uint32_t MyKey; //my secret key
 	
 	//Pseudo-random number generator 
-	MersenneTwister MyRandomGen;
-	MersenneTwister OtherRandomGen; 
+	RandomGen MyRandomGen;
+	RandomGen OtherRandomGen; 
 	
 	//what is my status? Shows whether we still need to initialize a key
 	//exchange or are ready to communicate.
@@ -158,6 +101,32 @@ public:
 	uint8_t MyMessageIndex;
 	uint8_t OtherMessageIndex;
 
+	//sets the group parameters to use for the key exchange
+	void set_group(uint32_t prime, uint32_t generator) {
+		PrimeMod = prime;
+		Generator = generator;
+		Arith.set_modulus(PrimeMod);
+	}
+
+	//base^exponent in the current group. The default prime is a Mersenne prime,
+	//so it gets the compile time specialised reduction.
+	uint32_t group_pow_mod(uint32_t base, uint32_t exponent) const {
+		if (PrimeMod == DefaultPrimeMod)
+			return pow_mod(base, exponent, ModArith<DefaultPrimeMod>());
+		return pow_mod(base, exponent, Arith);
+	}
+
+	//Generator^exponent in the current group, the public key calculation.
+	//The default group has a precomputed table in flash, so this is a few
+	//multiplies rather than a full exponentiation.
+	uint32_t generator_pow_mod(uint32_t exponent) const {
+		if (PrimeMod == DefaultPrimeMod && Generator == DefaultGenerator) {
+			return fixed_base_pow_mod(FixedBase16807Mod7FFFFFFF, exponent,
+			                          ModArith<DefaultPrimeMod>());
+		}
+		return group_pow_mod(Generator, exponent);
+	}
+
 	//sets us up for communications with the current private key that is set.
 	void start_session() {
 		//seed out both generators with the secret key
@@ -172,7 +141,7 @@ public:
 		OtherMessageIndex = 0;
 	}
 };
-EncryptState Encrypt;
+EncryptState<KEYSTREAM_GEN> Encrypt;
 
 
 
@@ -246,9 +215,9 @@ void rec_key() {
 	// calculate my public key, and the shared secret, since
 	// we do have the other's info to work with at this point.
 	Encrypt.MyPublicKey = 
-		pow_mod(Encrypt.Generator, Encrypt.MyKey, Encrypt.PrimeMod);
+		Encrypt.generator_pow_mod(Encrypt.MyKey);
 	Encrypt.SecretKey = 
-		pow_mod(Encrypt.OtherPublicKey, Encrypt.MyKey, Encrypt.PrimeMod);
+		Encrypt.group_pow_mod(Encrypt.OtherPublicKey, Encrypt.MyKey);
 
 	// send. This will send my public key
 	send_key_response();
@@ -260,7 +229,7 @@ void rec_key() {
 void rec_key_response() {
 	// find out the shared secret key
 	Encrypt.SecretKey =
-		pow_mod(Encrypt.OtherPublicKey, Encrypt.MyKey, Encrypt.PrimeMod);
+		Encrypt.group_pow_mod(Encrypt.OtherPublicKey, Encrypt.MyKey);
 
 	// and start the session
 	Encrypt.start_session();
@@ -327,15 +296,19 @@ void process_incomming_messages() {
 			// a valid message if we've gotten this far, or at least all
 			// of the bytes of the message are here or on their way even
 			// if they got corrupted.
-			Encrypt.PrimeMod = rec_int32_blocking();
-			Encrypt.Generator = rec_int32_blocking();
+			uint32_t prime = rec_int32_blocking();
+			uint32_t generator = rec_int32_blocking();
 			Encrypt.OtherPublicKey = rec_int32_blocking();
 			Encrypt.Status = SentKey;
 			//
 			if (rec_byte_blocking() != ';') {
 				//failed message integrity check
 				Encrypt.Status = Failed;
+			} else if (!Encrypt.Groups.check(prime, generator)) {
+				//not a prime and generator we're willing to use
+				Encrypt.Status = Failed;
 			} else {
+				Encrypt.set_group(prime, generator);
 				rec_key();
 			}
 
@@ -405,7 +378,7 @@ void set_session_key() {
 	Encrypt.MyRandomGen.seed(seed);
 	Encrypt.MyKey = Encrypt.MyRandomGen.next_uint32();
 	Encrypt.MyPublicKey =
-		pow_mod(Encrypt.Generator, Encrypt.MyKey, Encrypt.PrimeMod);
+		Encrypt.generator_pow_mod(Encrypt.MyKey);
 
 	Serial.print("|| Sent Public key: ");
 	Serial.println(Encrypt.MyPublicKey, HEX);
@@ -8,6 +8,17 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+#include "KeyTraits.h"
+
+// Size of the Diffie-Hellman keys: 8, 16, 32 or 64 bits, or 1024, 1536 or
+// 2048 for the MODP groups (typed in as hex). The default group for each size
+// is in KeyTraits.h, 16 bits is the original 19211 group.
+#ifndef DH_GROUP_BITS
+#define DH_GROUP_BITS 16
+#endif
+
+typedef KeyTypeFor<DH_GROUP_BITS>::Type KeyType;
+
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -24,48 +35,26 @@ uint16_t analog_noise() {
 	return total;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// Utility to calculate the power of large numbers, mod a modulus.
-//
-///////////////////////////////////////////////////////////////////////////////
-
-uint32_t pow_mod(uint16_t base, uint32_t exponent, uint32_t modulus) {
-	//
-	// Idea: 
-	// Outer loop: b^e %c => Product[i: 0->32]( b^(Bit[e,i] * 2^i) %c ) %c
-	// For the bits which have Bit[e,i] = 1 :
-	//   Inner loop: b^(2^i) => b^2 iteratively for i times 
-	// 
-	uint32_t shift;
-	uint32_t result = 1;
-	for (uint8_t place = 0; shift = exponent>>place; ++place) {
-		// if we have a 1 bit, we need to calculate b^(2^place) and multiply
-		// it to the product
-		if (shift & 0x1) {
-			uint64_t factor = base;
-			// square base iteratively to get the factor
-			for (uint8_t i = 0; i < place; ++i)
-				factor = (factor*factor) % modulus;
-			// multiply the place to the result
-			result = (result*factor) % modulus;
-		}
-	}
-	return result;
-}
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Utilities to read fixed amounts of data off of the Serial port
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-/* Read a long off of the serial port and return. Does not distinguish between failing to parse an int and reading 0 */
-int32_t readlong(uint8_t len) {
+/* Read a key off of the serial port and return. Does not distinguish between failing to parse a key and reading 0 */
+KeyType readkey() {
+  const uint16_t len = KeyTraits<KeyType>::TextLen;
   char s[len+1];
   readline(s, len);
   s[len] = '\0';
-  return atol(s);
+  return KeyTraits<KeyType>::from_text(s);
+}
+
+/* Print a key to the serial monitor */
+void printkey(const KeyType& key) {
+  char s[KeyTraits<KeyType>::TextLen + 1];
+  KeyTraits<KeyType>::to_text(key, s);
+  Serial.println(s);
 }
 
 /* Read a line (up to maxlen characters) off of the serial port. */
@@ -91,40 +80,66 @@ enum EncryptStatus {
 	Ready,
 	Failed,
 };
+// Arduino's random() as a generator for KeyTraits::random_exponent. random()
+// only goes up to 2^31 - 1, so the top bit comes from a second call, since
+// every byte of the word ends up in the key.
+struct ArduinoRandom {
+	uint32_t next_uint32() { return random() ^ ((uint32_t)random() << 16); }
+};
+
+template <class KeyT>
 class EncryptState {
 public:
-	EncryptState(): PrimeMod(19211), Generator(6),
-					InitialSeed(0xDEADB08F), MyPublicKey(0), 
-					OtherPublicKey(0), SecretKey(0), MyKey(0),
-	                Status(NeedInit), MaxKeySize(3) {}
-
-	// The prime to use as a modulus
-	uint32_t PrimeMod;
+	typedef KeyTraits<KeyT> Traits;
+	typedef typename Traits::Key Key;
+	typedef typename Traits::Exponent Exponent;
+	typedef typename Traits::GeneratorType GeneratorType;
+
+	EncryptState(): Generator(Traits::default_generator()),
+					InitialSeed(0xDEADB08F), MyPublicKey(), 
+					OtherPublicKey(), SecretKey(), MyKey(),
+	                Status(NeedInit), SecretMask(0) {
+		Arith.set_modulus(Traits::default_prime());
+	}
 
 	// The Diffie-Hellman generator for the prime
-	uint32_t Generator;
+	GeneratorType Generator;
+
+	// Arithmetic context for the prime (which is its modulus), built once
+	// here or in set_group rather than dividing on every multiply
+	typename Traits::Arith Arith;
 
 	// An initial seed to use on for random number generation
 	uint32_t InitialSeed;
-
-	// The max length (in chars) for keys. Change if the key variable types change
-	uint8_t MaxKeySize;
 	
 	// Diffie Hellman key exchange info
-	// Note: The below keys may be changed as low as 8 bits unsigned or as high as 
-	// 		 32 bits unsigned and everything will work fine. Although you may need to change the MaxKeySize
-	uint8_t MyPublicKey;
-	uint8_t OtherPublicKey;
-	uint8_t SecretKey; //shared secret key
-	uint8_t MyKey; //my secret key
+	// Note: The key size is picked with DH_GROUP_BITS, and the types, the
+	//       arithmetic and the max length (in chars) of a typed in key all follow
+	//       from it. See KeyTraits.h.
+	Key MyPublicKey;
+	Key OtherPublicKey;
+	Key SecretKey; //shared secret key
+	Exponent MyKey; //my secret key
 
 	//what is my status? Shows whether we still need to initialize a key
 	//exchange or are ready to communicate.
 	EncryptStatus Status;
 
+	// Sets the group parameters to use for the key exchange
+	void set_group(const Key& prime, GeneratorType generator) {
+		Generator = generator;
+		Arith.set_modulus(prime);
+	}
+
+	// Generator^exponent, the public key calculation. The default group has a
+	// precomputed table in flash so this only takes a couple of multiplies.
+	Key generator_pow_mod(const Exponent& exponent) const {
+		return Traits::generator_pow_mod(Generator, exponent, Arith);
+	}
+
 	// Encrypts or decrypts the character
 	uint8_t encrypt_decrypt(uint8_t ch) {
-		return ch ^ SecretKey;
+		return ch ^ SecretMask;
 	}
 
 	// Generates a random private key and then sets us up for communication
@@ -133,15 +148,16 @@ public:
 		randomSeed(InitialSeed ^ (analog_noise()<<16 | analog_noise()));
 
 		// Calculate the private key
-		MyKey = random();
+		ArduinoRandom rng;
+		MyKey = Traits::random_exponent(rng);
 
 		// Calculate the public key to share
-		MyPublicKey = pow_mod(Generator, MyKey, PrimeMod);
+		MyPublicKey = generator_pow_mod(MyKey);
 
 		// Show the user our shared index
 		Serial.println("===========================");
 		Serial.print("|| My Key: ");
-		Serial.println(MyPublicKey);
+		printkey(MyPublicKey);
 		Serial.println("===========================");
 
 		// Ask the user for the other's public key
@@ -151,9 +167,11 @@ public:
 		while ( !Serial.available() ) {};
 
 		// We have data in the serial monitor
-		if ( OtherPublicKey = readlong(MaxKeySize) ) {
+		OtherPublicKey = readkey();
+		if ( !Traits::is_zero(OtherPublicKey) ) {
 			// Compute the shared secret
-			SecretKey = pow_mod(OtherPublicKey, MyKey, PrimeMod);
+			SecretKey = Traits::group_pow_mod(OtherPublicKey, MyKey, Arith);
+			SecretMask = Traits::fold(SecretKey);
 
 			//and then set our status to ready
 			Status = Ready;
@@ -162,9 +180,9 @@ public:
 			Serial.println("===========================");
 			Serial.println("|| Encryption configuration successful");
 			Serial.print("|| My key: ");
-			Serial.println(MyPublicKey);
+			printkey(MyPublicKey);
 			Serial.print("|| Other's Key: ");
-			Serial.println(OtherPublicKey);
+			printkey(OtherPublicKey);
 			Serial.println("===========================");
 		} else {
 			// Something funny happened with the serial.
@@ -182,8 +200,12 @@ public:
 			start_session();
 		}
 	}
+
+private:
+	// the low byte of the shared secret, which is what gets xor'd in
+	uint8_t SecretMask;
 };
-EncryptState Encrypt;
+EncryptState<KeyType> Encrypt;
 
 ///////////////////////////////////////////////////////////////////////////////
 //
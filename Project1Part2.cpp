@@ -1,5 +1,76 @@
 
 //#include "stdint.h"
+#include "KeyTraits.h"
+#include "KeystreamGen.h"
+#include "SipHash.h"
+
+// Size of the Diffie-Hellman keys and group. 8, 16, 32 or 64 are sent as
+// machine integers, with the prime and generator sent in the KEY message.
+// 1024, 1536 or 2048 use the well known MODP group of that size from BigNum.h,
+// and 25519 uses X25519 with 32 byte keys. Both sides have to agree.
+// DH_EXPONENT_BITS in KeyTraits.h sets the private key size for the big
+// groups.
+#ifndef DH_GROUP_BITS
+#define DH_GROUP_BITS 32
+#endif
+
+typedef KeyTypeFor<DH_GROUP_BITS>::Type KeyType;
+typedef KeyTraits<KeyType> KeyTypeTraits;
+
+// Keystream generator for the versions below KeystreamChaCha, from
+// KeystreamGen.h. MersenneTwister is what it has always been, at 2.5 KB of
+// SRAM a direction; CounterGen and Xoshiro128 are a few bytes. It's only
+// compiled in when KEYSTREAM_MIN_VERSION lets one of those versions through,
+// which the default doesn't. Both sides have to agree.
+#ifndef KEYSTREAM_GEN
+#define KEYSTREAM_GEN MersenneTwister
+#endif
+
+// Bytes of keystream each direction works out ahead of time while loop() is
+// idle (at least 1). A whole MSG block's worth means a block that arrives
+// after a quiet spell is decrypted without generating anything.
+#ifndef KEYSTREAM_PREFETCH
+#define KEYSTREAM_PREFETCH 32
+#endif
+
+// Keystream layouts, sent in the handshake so both sides use the same one.
+// KeystreamBytes is the original, the low byte of each generator word, and
+// KeystreamWords uses all 4 bytes of each word, low byte first. KeystreamChaCha
+// is ChaCha instead of KEYSTREAM_GEN, keyed with the whole shared secret
+// rather than 32 bits of it. KeystreamAuthenticated is ChaCha with every block
+// sent as a MAC message, tagged so that a corrupted or forged one is dropped
+// rather than decrypted. KEY offers the highest this side can do and RSP
+// answers with the one both can.
+enum KeystreamVersion {
+	KeystreamBytes = 1,
+	KeystreamWords = 2,
+	KeystreamChaCha = 3,
+	KeystreamAuthenticated = 4,
+};
+
+#ifndef KEYSTREAM_VERSION
+#define KEYSTREAM_VERSION KeystreamAuthenticated
+#endif
+
+// The oldest layout this side will settle for. The version byte in KEY and
+// RSP isn't covered by any tag, so one flipped byte could otherwise drop both
+// sides to an untagged Mersenne Twister without a word. Defaults to
+// KEYSTREAM_VERSION, so nothing below the newest is taken unless asked for.
+#ifndef KEYSTREAM_MIN_VERSION
+#define KEYSTREAM_MIN_VERSION KEYSTREAM_VERSION
+#endif
+
+// as bytes, which is how they go on the wire and in EncryptState
+const uint8_t MaxKeystreamVersion = KEYSTREAM_VERSION;
+const uint8_t MinKeystreamVersion = KEYSTREAM_MIN_VERSION;
+static_assert(MinKeystreamVersion >= KeystreamBytes && MinKeystreamVersion <= MaxKeystreamVersion,
+              "KEYSTREAM_MIN_VERSION must be between 1 and KEYSTREAM_VERSION");
+
+// ChaCha rounds for KeystreamChaCha: 20, or 12 or 8 for less work a byte.
+// Both sides have to agree.
+#ifndef CHACHA_ROUNDS
+#define CHACHA_ROUNDS 20
+#endif
 
 // int16_t analogRead(int p);
 // class SerialH {
@@ -16,69 +87,69 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// Mersenne Twister random number generator implemented from Wikipedia
+// Utility to read random noise off of the analog pins.
+//
+// A private key is never any harder to guess than the noise it was made
+// from, whatever its size. Each analogRead of a floating pin only has a bit
+// or so of real noise in it, in the low bits, so it takes a lot of reads to
+// be worth a 256 bit exponent or an X25519 scalar. They all get mixed into a
+// 32 byte pool by four SipHashes with different keys, 8 bytes each, along
+// with the low byte of micros() after each read for the timing jitter.
+// EntropyReads of 2048 is about a quarter of a second on a 16 MHz AVR, so
+// it's only done once, in setup(), into EntropyPool.
+//
+// Each private key after that gets its noise from next_key_entropy(), which
+// runs one ChaCha20 block keyed with the pool: half of it replaces the pool
+// and half goes to the key, so the pool never gives away a key it made. A
+// few fresh reads go in as the nonce too. That's a few ms, rather than the
+// quarter second, on the way to answering a KEY.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-class MersenneTwister {
-public:
-	MersenneTwister(): index(0) {
-		seed(0xDEADB08F);
-	}
-	//
-	void seed(uint32_t seed) {
-		index = 0;
-		MT[0] = seed;
-		for (uint16_t i = 1; i < 624; ++i) {
-			uint64_t v = MT[i-1];
-			MT[i] = (0x6C078965*(v ^ (v>>30)) + i);
+const uint16_t EntropyReads = 2048;
+const uint8_t FreshEntropyReads = 16;
+
+uint8_t EntropyPool[32];
+
+void gather_entropy(uint8_t pool[32]) {
+	SipHash mix[4];
+	for (uint8_t i = 0; i < 4; ++i)
+		mix[i].begin(i, 0x6E6F697365ULL);
+	for (uint16_t r = 0; r < EntropyReads; ++r) {
+		uint16_t v = analogRead(r % 16);
+		uint8_t t = micros();
+		for (uint8_t i = 0; i < 4; ++i) {
+			mix[i].update(v);
+			mix[i].update(v >> 8);
+			mix[i].update(t);
 		}
 	}
-	//
-	uint32_t next_uint32() {
-		if (index == 0)
-			update();
-		//
-		uint64_t y = MT[index];
-		y ^= (y>>11);
-		y ^= ((y<<11) & 0x9D2C5680);
-		y ^= ((y<<15) & 0xEFC60000);
-		y ^= (y>>18);
-		//
-		index = (index+1)%624;
-		return y;
+	for (uint8_t i = 0; i < 4; ++i) {
+		uint64_t h = mix[i].finish();
+		for (uint8_t j = 0; j < 8; ++j)
+			pool[8 * i + j] = h >> (8 * j);
 	}
-	
-private:
-	void update() {
-		for (uint16_t i = 0; i < 624; ++i) {
-			int32_t y = (MT[i]>>31) + (0x8FFFFFFF & MT[(i+1)%624]);
-			MT[i] = MT[(i+397)%624] ^ (y>>1);
-			if (y%2 != 0) {
-				MT[i] ^= 0x9908B0DF;
-			}
-		}
-	}
-
-	uint32_t MT[624];
-	uint32_t index;
-};
-
-
+}
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// Utility to read random noise off of serial ports.
-//
-///////////////////////////////////////////////////////////////////////////////
+void next_key_entropy(uint8_t out[32]) {
+	SipHash fresh;
+	fresh.begin(4, 0x6E6F697365ULL);
+	for (uint8_t r = 0; r < FreshEntropyReads; ++r) {
+		uint16_t v = analogRead(r);
+		fresh.update(v);
+		fresh.update(v >> 8);
+		fresh.update(micros());
+	}
 
-uint16_t analog_noise() {
-	//won't overflow, 16 values * 1024 => 14 bits needed
-	uint16_t total = 0;
-	for (uint8_t i = 0; i < 16; ++i) {
-		total += analogRead(i);
+	ChaCha20 ratchet;
+	ratchet.set_key(EntropyPool);
+	ratchet.seed(fresh.finish());
+	for (uint8_t i = 0; i < 64; i += 4) {
+		uint32_t w = ratchet.next_uint32();
+		uint8_t *dest = i < 32 ? &EntropyPool[i] : &out[i - 32];
+		for (uint8_t j = 0; j < 4; ++j)
+			dest[j] = w >> (8 * j);
 	}
-	return total;
 }
 
 
@@ -89,95 +160,6 @@ uint16_t analog_noise() {
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-////////////////////////////////////////////////////////////////////////////////////
-//
-// Code for calculating the keys safely for any values up to and including INT_MAX
-// as the generator, prime modulus and private key.
-//
-////////////////////////////////////////////////////////////////////////////////////
-
-//
-// add_mod:
-// Safe add (non-overflowing) for 32bit numbers in a modular space
-//
-uint32_t add_mod(uint32_t a, uint32_t b, uint32_t mod) {
-	// a = a%mod; 
-	// b = b%mod;
-	// if (a > 0xFFFFFFFFull-b) {
-	// 	int32_t dividend = 0xFFFFFFFF / mod;
-	// 	return dividend + add_mod(0xFFFFFFFF - dividend*mod, (a+b+1) % mod, mod);
-	// } else {
-	// 	return (a+b) % mod;
-	// }
-	int64_t aa = a, bb = b;
-	return (a+b) % mod;
-}
-
-//
-// mulpow2_mod:
-// Safe multiply (non-overflowing) by a power of two in a modular space
-//
-int tp = 0;
-uint32_t mulpow2_mod(uint32_t a, uint8_t pow2, uint32_t mod) {
-	for (uint8_t i = 0; i < pow2; ++i) {
-		// int t = micros();
-		a = add_mod(a, a, mod);
-		// int t2 = micros();
-		// if ((t2 - t) > tp) {
-		// 	tp = t2-t;
-		// }
-	}
-	return a;
-}
-
-//
-// mul_mod
-// Safe multiply (non-overflowing) for 32bit numbers in a modular space
-//
-uint32_t mul_mod(uint32_t a, uint32_t b, uint32_t mod) {
-	uint32_t sum = 0;
-	uint32_t v = b;
-
-	for (uint8_t j = 0; j < 31; ++j) {
-		if ((b >> j) & 1) {
-			sum = (sum + v) % mod;
-		}
-
-		v << 2;
-	}
-
-	return sum;
-}
-
-//
-// pow_mod
-// Safe power (non-overflowing) for 32bit numbers in a modular space
-//
-uint32_t pow_mod(uint32_t base, uint32_t exponent, uint32_t modulus) {
-	//
-	// Idea: 
-	// Outer loop: b^e %c => Product[i: 0->32]( b^(Bit[e,i] * 2^i) %c ) %c
-	// For the bits which have Bit[e,i] = 1 :
-	//   Inner loop: b^(2^i) => b^2 iteratively for i times 
-	// 
-	uint32_t shift;
-	uint32_t result = 1;
-	uint32_t factor = base;
-
-	for (uint8_t place = 0; shift = exponent>>place; ++place) {
-		// if we have a 1 bit, we need to calculate b^(2^place) and multiply
-		// it to the product
-		if (shift & 0x1) {
-			// multiply the place to the result
-			result = mul_mod(result, factor, modulus);
-		}
-
-		factor = mul_mod(factor, factor, modulus);
-	}
-	
-	return result;
-}
-
 // mod from Mark's quiz #2
 int mod(int a, int b) {
 	if (b < 0) {
@@ -209,21 +191,6 @@ int mod(int a, int b) {
 
 
 
-///////////////////////////////////////////////////////////////////////////////
-//
-// Utility for creating a 32 bit number from the first 8 bits of 4 numbers
-//
-///////////////////////////////////////////////////////////////////////////////
-
-uint32_t to_uint32( uint8_t b[4] ) {
-	return ( (((uint32_t) b[0]) << 24) | 
-			 (((uint32_t) b[1]) << 16) |
-			 (((uint32_t) b[2]) <<  8) |
-			 (((uint32_t) b[3])      ) );
-}
-
-
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Struct for keeping track of all packet tags and associated packet body 
@@ -239,18 +206,36 @@ struct KeyAndHandler {
 	const char *Key;
 
 	// The number of bytes the function expects
-	uint8_t DataLen;
+	uint16_t DataLen;
+
+	// How many bytes at the start of the body the tag at the end of it
+	// covers, 0 for messages without one
+	uint16_t MacLen;
 
 	// The handler function
 	void (*Handler)( uint8_t * );
 };
 
+// KEY: the group (prime modulus and generator, or a group id for the big
+// groups), public key, highest keystream version. RSP: public key, keystream
+// version to use. MSG: the low byte of the block's index, 32 bytes of
+// ciphertext. MAC: a MSG body and the SipHash-2-4 tag of it, low byte first.
+const uint16_t MacTagLen = 8;
+const uint16_t KeyMessageLen = KeyTypeTraits::GroupBytes + KeyTypeTraits::Bytes + 1;
+const uint16_t RspMessageLen = KeyTypeTraits::Bytes + 1;
+const uint16_t MsgMessageLen = 1 + 32;
+const uint16_t MacMessageLen = MsgMessageLen + MacTagLen;
+
 KeyAndHandler MessageHandlers[] = {
-	{ "KEY", 12, &key_handler },
-	{ "MSG", 32, &msg_handler },
-	{ "RSP",  4, &rsp_handler },
+	{ "KEY", KeyMessageLen, 0, &key_handler },
+	{ "MAC", MacMessageLen, MsgMessageLen, &mac_handler },
+	{ "MSG", MsgMessageLen, 0, &msg_handler },
+	{ "RSP", RspMessageLen, 0, &rsp_handler },
 };
 
+// Room for the 3 character key, the longest body and the terminator
+const uint16_t RingBufferLen = 3 + (KeyMessageLen > MacMessageLen ? KeyMessageLen : MacMessageLen) + 1;
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -261,7 +246,7 @@ KeyAndHandler MessageHandlers[] = {
 
 class RingBuffer {
 	public: 
-		RingBuffer(): BufferLen(36), BufferPosition(-1) {
+		RingBuffer(): BufferLen(RingBufferLen), BufferPosition(-1) {
 			Buffer = (uint8_t*) malloc(BufferLen * sizeof(uint8_t));
 			if ( Buffer == 0 ) Serial.println("Memory exception allocating ring buffer!");
 		};
@@ -271,11 +256,11 @@ class RingBuffer {
 		}
 
 		// The length of the buffer
-		const uint8_t BufferLen;
+		const uint16_t BufferLen;
 
 		// @debug check if the uint8_t conflicts with pointers
-		uint8_t peek( int8_t offset = 0 ) {
-			int8_t index = mod(BufferPosition + offset, BufferLen);
+		uint8_t peek( int16_t offset = 0 ) {
+			int16_t index = mod(BufferPosition + offset, BufferLen);
 			return Buffer[index];
 		}
 
@@ -308,54 +293,239 @@ enum EncryptStatus {
 	Ready,
 	Failed,
 };
+template <class KeyT, class RandomGen = MersenneTwister>
 class EncryptState {
 public:
-	EncryptState(): PrimeMod(0x7FFFFFFF), Generator(16807),
-	                MyPublicKey(0), OtherPublicKey(0),
-	                SecretKey(0), MyKey(0),
-	                Status(NeedInit), 
+	typedef KeyTraits<KeyT> Traits;
+	typedef typename Traits::Key Key;
+	typedef typename Traits::Exponent Exponent;
+	typedef typename Traits::GeneratorType GeneratorType;
+
+	EncryptState(): Generator(Traits::default_generator()),
+	                SecretKey(0),
+	                Status(NeedInit), Version(MaxKeystreamVersion),
 	                MyMessageIndex(0), OtherMessageIndex(0) {
-
+		Arith.set_modulus(Traits::default_prime());
 	}
 
-	uint32_t PrimeMod;
-	uint32_t Generator;
+	//The generator. The prime is the modulus of Arith, rather than keeping
+	//a second copy of it around for the big groups.
+	GeneratorType Generator;
+
+	//Arithmetic context for the prime, so that the key calculations don't
+	//need any divisions. Rebuilt by set_group when the prime changes.
+	typename Traits::Arith Arith;
+
+	//Groups the other side has sent us that we've already checked, so that
+	//validating a repeat handshake is just a lookup.
+	typename Traits::Cache Groups;
 	
 	//Diffie Helman key exchange info
-	uint32_t MyPublicKey;
-	uint32_t OtherPublicKey;
-	uint32_t SecretKey; //shared secret key
-	uint32_t MyKey; //my secret key
+	Key MyPublicKey;
+	Key OtherPublicKey;
+	Exponent MyKey; //my secret key
+	uint32_t SecretKey; //shared secret key, folded down to the 32 bits the generators use
 	
-	//Pseudo-random number generator 
-	MersenneTwister MyRandomGen;
-	MersenneTwister OtherRandomGen; 
+	//Pseudo-random number generator, or ChaCha if that's what the handshake
+	//settled on, with a few bytes of keystream worked out ahead of time
+	Keystream<ChaChaOr<RandomGen, CHACHA_ROUNDS>, KEYSTREAM_PREFETCH> MyRandomGen;
+	Keystream<ChaChaOr<RandomGen, CHACHA_ROUNDS>, KEYSTREAM_PREFETCH> OtherRandomGen; 
 	
 	//what is my status? Shows whether we still need to initialize a key
 	//exchange or are ready to communicate.
 	EncryptStatus Status;
+
+	//the KeystreamVersion agreed in the handshake
+	uint8_t Version;
+
+	//SipHash keys for the tags of the blocks I send and the ones the other
+	//sends, and the tags of the block being sent and the one arriving,
+	//worked out a byte at a time as they go
+	uint64_t MyMacKey[2];
+	uint64_t OtherMacKey[2];
+	SipHash MyTag;
+	SipHash OtherTag;
 	
-	//message indicies, for future use.
-	uint8_t MyMessageIndex;
-	uint8_t OtherMessageIndex;
+	//Each MSG block gets its own BlockKeystreamLen bytes of keystream, starting
+	//at its index * BlockKeystreamLen, whether it uses them all or not. So a
+	//block can be decrypted from its index alone, even if the ones before it
+	//never arrived.
+	static const uint8_t BlockKeystreamLen = 32;
+
+	//message indicies: the next MSG block I'll send, and the next one I expect
+	//from the other side. Only the low byte goes in the message.
+	uint16_t MyMessageIndex;
+	uint16_t OtherMessageIndex;
+
+	// Encrypts the buffer in place with my random generator
+	void encrypt( uint8_t *buf, size_t len ) {
+		MyRandomGen.xor_into(buf, len);
+	}
+
+	// Decrypts the buffer in place with the others' random generator
+	void decrypt( uint8_t *buf, size_t len ) {
+		OtherRandomGen.xor_into(buf, len);
+	}
+
+	//whether blocks go as MAC messages
+	bool authenticated() const {
+		return Version >= KeystreamAuthenticated;
+	}
+
+	//starts the tag of a new block, going out or coming in. Each direction
+	//has its own key, so a block can't be sent back to the side it came from
+	//and pass as the other's. The tag starts with the block's whole 16 bit
+	//index, not just the low byte that goes on the wire, so an old block
+	//with the same low byte doesn't pass as a new one.
+	void start_my_tag() {
+		MyTag.begin(MyMacKey[0], MyMacKey[1]);
+		MyTag.update(MyMessageIndex);
+		MyTag.update(MyMessageIndex >> 8);
+	}
+	void start_other_tag(uint8_t index) {
+		uint16_t block = other_block(index);
+		OtherTag.begin(OtherMacKey[0], OtherMacKey[1]);
+		OtherTag.update(block);
+		OtherTag.update(block >> 8);
+	}
+
+	//works out a little more keystream in each direction, for when there's
+	//nothing else to do. The other's first, since decrypting is what holds up
+	//receiving.
+	void prefetch() {
+		if (Status != Ready)
+			return;
+		if (!OtherRandomGen.prefetch())
+			MyRandomGen.prefetch();
+	}
+
+	//moves my keystream to the start of block, ready to encrypt it
+	void start_my_block(uint16_t block) {
+		MyRandomGen.seek((uint32_t)block * BlockKeystreamLen);
+	}
 
-	// Encrypts the character with my random generator
-	uint8_t encrypt( uint8_t ch ) {
-		uint8_t mask = MyRandomGen.next_uint32();
-		return ch ^ mask;
+	//the whole index of the block the other side sent with the low byte
+	//index: the nearest one to the next we expect, but never one from before
+	//the session started
+	uint16_t other_block(uint8_t index) const {
+		uint8_t ahead = index - (uint8_t)OtherMessageIndex;
+		if (ahead >= 128 && OtherMessageIndex >= 256 - ahead)
+			return OtherMessageIndex + ahead - 256;
+		return OtherMessageIndex + ahead;
 	}
 
-	// Encrypts the character with the others' random generator
-	uint8_t decrypt( uint8_t ch ) {
-		uint8_t mask = OtherRandomGen.next_uint32();
-		return ch ^ mask;
+	//moves the other's keystream to the start of the block the other side
+	//sent with index, ready to decrypt it. Blocks lost on the way are skipped
+	//over rather than needing a new handshake. A block from before the next
+	//one expected has been seen already, or is a replay, so it's left alone.
+	//Returns how many blocks were skipped, negative for an old one.
+	int16_t start_other_block(uint8_t index) {
+		uint16_t block = other_block(index);
+		int16_t skipped = block - OtherMessageIndex;
+		if (skipped < 0)
+			return skipped;
+		OtherRandomGen.seek((uint32_t)block * BlockKeystreamLen);
+		OtherMessageIndex = block + 1;
+		return skipped;
+	}
+
+	//skips what's left of the keystream of the blocks just sent or received,
+	//so what gets prefetched is the start of the next block's
+	void finish_my_block() {
+		MyRandomGen.seek((uint32_t)MyMessageIndex * BlockKeystreamLen);
+	}
+	void finish_other_block() {
+		OtherRandomGen.seek((uint32_t)OtherMessageIndex * BlockKeystreamLen);
+	}
+
+	Key prime_mod() const { return Arith.modulus(); }
+
+	//whether the group the other side sent is one we're willing to use
+	bool check_group(const Key& prime, GeneratorType generator) {
+		return Traits::check_group(Groups, prime, generator);
+	}
+
+	//sets the group parameters to use for the key exchange. Building the
+	//arithmetic is expensive for the big groups, so only do it on a change.
+	void set_group(const Key& prime, GeneratorType generator) {
+		Generator = generator;
+		if (prime != prime_mod())
+			Arith.set_modulus(prime);
+	}
+
+	//picks a new private key from the noise in pool (see next_key_entropy),
+	//and works out our public key. ChaCha20 keyed with the pool stretches it
+	//to however many bytes the key needs. The default groups have a
+	//precomputed table in flash, so that's a few multiplies rather than a
+	//full exponentiation.
+	void make_key(const uint8_t *pool) {
+		ChaCha20 keygen;
+		keygen.set_key(pool);
+		MyKey = Traits::random_exponent(keygen);
+		MyPublicKey = Traits::generator_pow_mod(Generator, MyKey, Arith);
+	}
+
+	//works out the shared secret from the other's public key, and the ChaCha
+	//key from all of it, xored down to 32 bytes for the big groups
+	void make_secret_key() {
+		Key shared = Traits::group_pow_mod(OtherPublicKey, MyKey, Arith);
+		SecretKey = Traits::fold(shared);
+		uint8_t key[32] = {0};
+		for (uint16_t i = 0; i < Traits::Bytes; ++i)
+			key[i % 32] ^= Traits::byte(shared, i);
+		MyRandomGen.generator().set_key(key);
+		OtherRandomGen.generator().set_key(key);
+		make_mac_key(key, my_stream_seed(), MyMacKey);
+		make_mac_key(key, other_stream_seed(), OtherMacKey);
+	}
+
+	//a direction's tag key is the last ChaCha block of its keystream, which
+	//the messages never get to, since positions are a 32 bit count of bytes
+	static void make_mac_key(const uint8_t *key, uint32_t seed, uint64_t mac[2]) {
+		ChaCha<CHACHA_ROUNDS> cipher;
+		cipher.set_key(key);
+		cipher.seed(seed);
+		cipher.discard(0xFFFFFFF0);
+		for (uint8_t i = 0; i < 2; ++i) {
+			mac[i] = cipher.next_uint32();
+			mac[i] |= (uint64_t)cipher.next_uint32() << 32;
+		}
+	}
+
+	//Each direction has its own keystream, or the xor of two blocks sent
+	//the same way would give away the xor of what's in them. Whichever side
+	//has the lower public key sends on the one seeded with SecretKey, and
+	//the other on SecretKey ^ OtherStreamMask. It goes by the keys rather
+	//than by who sent KEY, since both sides can send one at the same time.
+	static const uint32_t OtherStreamMask = 0x5A5A5A5A;
+
+	//whether my public key is the lower of the two, big endian
+	bool lower_public_key() const {
+		for (uint16_t i = 0; i < Traits::Bytes; ++i) {
+			uint8_t mine = Traits::byte(MyPublicKey, i);
+			uint8_t other = Traits::byte(OtherPublicKey, i);
+			if (mine != other)
+				return mine < other;
+		}
+		return false;
+	}
+
+	//the seeds of the streams I send and the other sends on
+	uint32_t my_stream_seed() const {
+		return lower_public_key() ? SecretKey : SecretKey ^ OtherStreamMask;
+	}
+	uint32_t other_stream_seed() const {
+		return lower_public_key() ? SecretKey ^ OtherStreamMask : SecretKey;
 	}
 
 	//sets us up for communications with the current private key that is set.
 	void start_session() {
-		//seed out both generators with the secret key
-		MyRandomGen.seed(SecretKey);
-		OtherRandomGen.seed(SecretKey);
+		//seed out both generators with the secret key, in the layout agreed
+		uint8_t wordBytes = Version >= KeystreamWords ? 4 : 1;
+		MyRandomGen.generator().use_chacha(Version >= KeystreamChaCha);
+		OtherRandomGen.generator().use_chacha(Version >= KeystreamChaCha);
+		MyRandomGen.seed(my_stream_seed(), wordBytes);
+		OtherRandomGen.seed(other_stream_seed(), wordBytes);
 
 		//and then set our status to ready
 		Status = Ready;
@@ -365,29 +535,53 @@ public:
 		OtherMessageIndex = 0;
 	}
 
+	// prints a key or exponent as big endian hex
+	template <class Num>
+	static void print_hex(const Num& num) {
+		for (uint16_t i = 0; i < KeyTraits<Num>::Bytes; ++i) {
+			uint8_t b = KeyTraits<Num>::byte(num, i);
+			if (b < 0x10)
+				Serial.print('0');
+			Serial.print(b, HEX);
+		}
+		Serial.println();
+	}
+
 	// Initiate a new secure session for this any any connected client.
 	void set_session_key() {
 		Serial.println("===========================\n|| Start Session");
-		// get a seed as analog noise
-		uint16_t noise = analog_noise();
+		// noise for a whole private key, from the pool setup() filled
+		uint8_t pool[32];
+		next_key_entropy(pool);
 
-		// Mersenne works best when the bits in the seed are close to random to
-		// start with, so fill all 32 bits with something, rather than just 16
-		uint32_t seed = noise | (((uint32_t) noise) << 16);
-		uint32_t t = micros();
 		// generate the key / public key for me
-		MyRandomGen.seed(seed);
-		MyKey = MyRandomGen.next_uint32();
-		MyPublicKey = pow_mod(Generator, MyKey, PrimeMod);
-
-		Serial.print("|| Sent Public key: ");
-		Serial.println(MyPublicKey, HEX);
-		Serial.print("|| My private key: ");
-		Serial.println(MyKey, HEX);
+		make_key(pool);
+
+		if (Traits::Bytes > 32) {
+			// too long to be worth printing
+			Serial.print("|| Using MODP group: ");
+			Serial.println(DH_GROUP_BITS);
+		} else {
+			Serial.print("|| Sent Public key: ");
+			print_hex(MyPublicKey);
+			Serial.print("|| My private key: ");
+			print_hex(MyKey);
+		}
 		Serial.println("===========================");
 	}
+
+	// how often the keystream came out of the prefetch buffer
+	void print_keystream_stats() {
+		Serial.print("|| Keystream hits/misses: ");
+		Serial.print(OtherRandomGen.hits() + MyRandomGen.hits());
+		Serial.print("/");
+		Serial.println(OtherRandomGen.misses() + MyRandomGen.misses());
+	}
 };
-EncryptState Encrypt;
+// KEYSTREAM_GEN, if any version we'd take needs it
+typedef FallbackGen<(MinKeystreamVersion < KeystreamChaCha), KEYSTREAM_GEN>::Type KeystreamFallback;
+
+EncryptState<KeyType, KeystreamFallback> Encrypt;
 
 
 
@@ -427,14 +621,17 @@ public:
 		Encrypt.Status = SentKey;
 
 		Serial1.print("KEY");
-		// send prime modulus
-		send_32bit(Encrypt.PrimeMod);
 
-		// send generator
-		send_32bit(Encrypt.Generator);
+		// send the group: the prime modulus and generator, or just a group id
+		// for the big groups, which the other side has built in already
+		for (uint16_t i = 0; i < KeyTypeTraits::GroupBytes; ++i)
+			Serial1.write(KeyTypeTraits::group_byte(Encrypt.Arith, Encrypt.Generator, i));
 
 		// send public key
-		send_32bit(Encrypt.MyPublicKey);
+		send_key_bytes(Encrypt.MyPublicKey);
+
+		// and the newest keystream layout we can do
+		Serial1.write(MaxKeystreamVersion);
 
 		// The termination character
 		Serial1.print('\0');
@@ -444,16 +641,36 @@ public:
 		Serial1.print("RSP");
 
 		// Output my public key
-		send_32bit(Encrypt.MyPublicKey);
+		send_key_bytes(Encrypt.MyPublicKey);
+
+		// and the keystream layout we picked
+		Serial1.write(Encrypt.Version);
 
 		Serial1.print('\0');
 	}
 
 	void send_block(char block[32]) {
-		Serial1.print("MSG");
+		// tagged as it's written, if the session wants tags
+		bool tagged = Encrypt.authenticated();
+		if (tagged) {
+			Serial1.print("MAC");
+			Encrypt.start_my_tag();
+		} else {
+			Serial1.print("MSG");
+		}
+
+		// which block this is, so the other side can find its keystream
+		write_tagged(Encrypt.MyMessageIndex & 0xFF, tagged);
+		++Encrypt.MyMessageIndex;
 
 		for (int8_t i = 0; i < 32; ++i)
-			Serial1.write(block[i]);
+			write_tagged(block[i], tagged);
+
+		if (tagged) {
+			uint64_t tag = Encrypt.MyTag.finish();
+			for (uint8_t i = 0; i < MacTagLen; ++i)
+				Serial1.write((uint8_t)(tag >> (8 * i)));
+		}
 
 		Serial1.print('\0');
 	}
@@ -498,21 +715,21 @@ public:
 	///////////////////////////////////////////////////////////////////////////////
 
 	void rec_key() {
-		Serial.println("===========================");
-		Serial.print("|| Other's Key: ");
-		Serial.println(Encrypt.OtherPublicKey, HEX);
-		Serial.println("===========================");
+		if (KeyTypeTraits::Bytes <= 32) {
+			Serial.println("===========================");
+			Serial.print("|| Other's Key: ");
+			Encrypt.print_hex(Encrypt.OtherPublicKey);
+			Serial.println("===========================");
+		}
 		// generate and send our own response secret key
 		// generate
-		int32_t val = analog_noise();
-		int32_t seed = val | (((uint32_t)val)<<16);
-		Encrypt.MyRandomGen.seed(seed);
-		Encrypt.MyKey = Encrypt.MyRandomGen.next_uint32();
+		uint8_t pool[32];
+		next_key_entropy(pool);
 
 		// calculate my public key, and the shared secret, since
 		// we do have the other's info to work with at this point.
-		Encrypt.MyPublicKey = pow_mod(Encrypt.Generator, Encrypt.MyKey, Encrypt.PrimeMod);
-		Encrypt.SecretKey = pow_mod(Encrypt.OtherPublicKey, Encrypt.MyKey, Encrypt.PrimeMod);
+		Encrypt.make_key(pool);
+		Encrypt.make_secret_key();
 
 		// send. This will send my public key
 		send_key_response();
@@ -523,7 +740,7 @@ public:
 
 	void rec_key_response() {
 		// find out the shared secret key
-		Encrypt.SecretKey = pow_mod(Encrypt.OtherPublicKey, Encrypt.MyKey, Encrypt.PrimeMod);
+		Encrypt.make_secret_key();
 
 		// and start the session
 		Encrypt.start_session();
@@ -549,8 +766,11 @@ public:
 					if ( !strcmp(MessageHandlers[i].Key, CurrentKey) ) {
 						// This is the last char in a key,
 						// If this message is not KEY and we haven't setup encryption, 
-						// we need to tell the other to reinit
-						if ( Encrypt.Status != Ready && strcmp(CurrentKey, "KEY") ) {
+						// we need to tell the other to reinit. The exception is the RSP
+						// to the KEY we sent, which is what finishes setting it up.
+						bool expected = !strcmp(CurrentKey, "KEY") ||
+						                (Encrypt.Status == SentKey && !strcmp(CurrentKey, "RSP"));
+						if ( Encrypt.Status != Ready && !expected ) {
 							// We are receiving something other than a KEY, but encryption has not been initialized
 							Serial.print("Resetting encryption");
 							Encrypt.set_session_key();
@@ -574,15 +794,28 @@ public:
 				// we're currently waiting for is.
 				ReceivedDataLen++;
 
+				// The tag is worked out as the body arrives, so checking it at the end
+				// is only SipHash's finalisation, with no second pass over the body.
+				// It starts from the block index, the first byte.
+				if ( ReceivedDataLen == 1 && CurrentMessageHandler.MacLen )
+					Encrypt.start_other_tag(DataBuffer.peek());
+				if ( ReceivedDataLen <= CurrentMessageHandler.MacLen )
+					Encrypt.OtherTag.update(DataBuffer.peek());
+
 				// Check if the message should be done, apply sanity check and call the handler
-				if ( ReceivedDataLen > CurrentMessageHandler.DataLen && DataBuffer.peek() == '\0' ) {
+				if ( ReceivedDataLen > CurrentMessageHandler.DataLen && DataBuffer.peek() == '\0' && !tag_matches() ) {
+					// Corrupted or forged, drop it before it gets anywhere near the keystream
+					Serial.println("Bad message tag");
+					CurrentReadState = SerialReady;
+
+				} else if ( ReceivedDataLen > CurrentMessageHandler.DataLen && DataBuffer.peek() == '\0' ) {
 					//note, we have to allocate memery here because the message may not be in contiguous
 					//memory in the actual ring buffer, but the message handler needs a contiguous
 					//string.
 					uint8_t *data = (uint8_t*) malloc(CurrentMessageHandler.DataLen * sizeof(uint8_t));
 					if ( data == 0 ) Serial.println("Error allocating data array");
 
-					for ( uint8_t i = 0; i < CurrentMessageHandler.DataLen; i++ )
+					for ( uint16_t i = 0; i < CurrentMessageHandler.DataLen; i++ )
 						data[i] = DataBuffer.peek( i - CurrentMessageHandler.DataLen );
 
 					CurrentMessageHandler.Handler( data );
@@ -607,14 +840,31 @@ public:
 
 private: 
 	char CurrentKey[4];
-	uint8_t ReceivedDataLen;
+	uint16_t ReceivedDataLen;
 	KeyAndHandler CurrentMessageHandler;
 
-	void send_32bit(uint32_t num) {
-		Serial1.write((num>>24) & 0xFF);
-		Serial1.write((num>>16) & 0xFF);
-		Serial1.write((num>>8 ) & 0xFF);
-		Serial1.write((num    ) & 0xFF);
+	// writes a byte of a message body, adding it to the tag if it has one
+	void write_tagged(uint8_t b, bool tagged) {
+		Serial1.write(b);
+		if (tagged)
+			Encrypt.MyTag.update(b);
+	}
+
+	// whether the tag at the end of the body just received matches the rest
+	// of it, for the messages with one
+	bool tag_matches() {
+		if (!CurrentMessageHandler.MacLen)
+			return true;
+		uint64_t tag = 0;
+		for (uint8_t i = 0; i < MacTagLen; ++i)
+			tag |= (uint64_t)DataBuffer.peek(i - MacTagLen) << (8 * i);
+		return Encrypt.OtherTag.finish() == tag;
+	}
+
+	// big endian, KeyTypeTraits::Bytes bytes
+	void send_key_bytes(const KeyType& num) {
+		for (uint16_t i = 0; i < KeyTypeTraits::Bytes; ++i)
+			Serial1.write(KeyTypeTraits::byte(num, i));
 	}
 };
 Communication Comms;
@@ -628,12 +878,40 @@ Communication Comms;
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+// Says so when the session is on an older layout than this side can do,
+// which only happens when KEYSTREAM_MIN_VERSION allows it
+void warn_old_version() {
+	if (Encrypt.Version < MaxKeystreamVersion) {
+		Serial.print("|| Older keystream version: ");
+		Serial.println(Encrypt.Version);
+	}
+}
+
 // Sets up the EncryptStatus class with all the numbers we need
-void key_handler( uint8_t data[12] ) {
+void key_handler( uint8_t *data ) {
 	// Give Encrypt the base data that it needs
-	Encrypt.PrimeMod = to_uint32(&data[0]);
-	Encrypt.Generator = to_uint32(&data[4]);
-	Encrypt.OtherPublicKey = to_uint32(&data[8]);
+	KeyType prime;
+	KeyTypeTraits::GeneratorType generator;
+	if (!KeyTypeTraits::read_group(&data[0], prime, generator) ||
+	    !Encrypt.check_group(prime, generator)) {
+		// a different size of group, or not a prime and generator we're
+		// willing to use
+		Serial.println("Rejected DH group");
+		Encrypt.Status = Failed;
+		return;
+	}
+	// the newest keystream layout both of us can do, as long as it's one
+	// we'll settle for
+	uint8_t version = data[KeyMessageLen - 1];
+	if (version < MinKeystreamVersion) {
+		Serial.println("Rejected keystream version");
+		Encrypt.Status = Failed;
+		return;
+	}
+	Encrypt.Version = version < MaxKeystreamVersion ? version : MaxKeystreamVersion;
+	warn_old_version();
+	Encrypt.set_group(prime, generator);
+	Encrypt.OtherPublicKey = KeyTypeTraits::read(&data[KeyTypeTraits::GroupBytes]);
 	Encrypt.Status = SentKey;
 
 	// Let Encrypt handle the rest of the key setup
@@ -641,26 +919,69 @@ void key_handler( uint8_t data[12] ) {
 }
 
 // Decrypts all characters and prints them in the users' serial monitor
-void msg_handler( uint8_t data[32] ) {
-	//we got input data, give it to the user
-	for ( uint8_t i = 0; i < 32; i++ ) {
-		char ch = Encrypt.decrypt(data[i]);
-		if (ch) {
-			Serial.write(ch);
-		} else {
-			//done with usefull message characters
-			break;
-		}
+void read_block( uint8_t *data ) {
+	//find the block's place in the keystream from its index
+	int16_t skipped = Encrypt.start_other_block(data[0]);
+	if (skipped < 0) {
+		Serial.println("Dropped old message block");
+		return;
+	}
+	if (skipped > 0) {
+		Serial.print("|| Lost message blocks: ");
+		Serial.println(skipped);
+	}
+
+	//decrypt the whole block in place, then give the user everything up to
+	//the terminator
+	uint8_t *text = &data[1];
+#ifdef KEYSTREAM_STATS
+	unsigned long start = micros();
+#endif
+	Encrypt.decrypt(text, 32);
+#ifdef KEYSTREAM_STATS
+	unsigned long spent = micros() - start;
+#endif
+	Encrypt.finish_other_block();
+	for ( uint8_t i = 0; i < 32 && text[i]; i++ )
+		Serial.write(text[i]);
+
+#ifdef KEYSTREAM_STATS
+	Serial.print("|| Decrypted block in (us): ");
+	Serial.println(spent);
+	Encrypt.print_keystream_stats();
+#endif
+}
+
+// An untagged block, which an authenticated session won't take
+void msg_handler( uint8_t *data ) {
+	if (Encrypt.authenticated()) {
+		Serial.println("Dropped untagged message");
+		return;
 	}
+	read_block(data);
+}
+
+// A tagged block, whose tag has already been checked as it came in
+void mac_handler( uint8_t *data ) {
+	read_block(data);
 }
 
 // RSP message is receieved after we send a KEY message. It will contain the other
 // devices' public key
-void rsp_handler( uint8_t data[4] ) {
-	Encrypt.OtherPublicKey = to_uint32(&data[0]);
+void rsp_handler( uint8_t *data ) {
+	// the keystream layout the other side picked out of the ones we offered
+	uint8_t version = data[RspMessageLen - 1];
+	if (version < MinKeystreamVersion || version > MaxKeystreamVersion) {
+		Serial.println("Rejected keystream version");
+		Encrypt.Status = Failed;
+		return;
+	}
+	Encrypt.Version = version;
+	warn_old_version();
+	Encrypt.OtherPublicKey = KeyTypeTraits::read(&data[0]);
 
 	// find out the shared secret key
-	Encrypt.SecretKey = pow_mod(Encrypt.OtherPublicKey, Encrypt.MyKey, Encrypt.PrimeMod);
+	Encrypt.make_secret_key();
 
 	// and start the session
 	Encrypt.start_session();
@@ -677,15 +998,18 @@ void rsp_handler( uint8_t data[4] ) {
 ///////////////////////////////////////////////////////////////////////////////
 
 void output_message(char* msg, uint16_t len) {
-	//encrypt the buffer
-	for (uint16_t i = 0; i < len; ++i) {
+	//encrypt the buffer, each 32 byte block from the start of its own stretch
+	//of the keystream, with the same index send_message will give it
+	for (uint16_t i = 0; i < len; i += 32) {
+		Encrypt.start_my_block(Encrypt.MyMessageIndex + i / 32);
 		//note, msg is non-const, we are allowed to mess with the
 		//buffer if we want to.
-		msg[i] = Encrypt.encrypt(msg[i]);
+		Encrypt.encrypt((uint8_t *)&msg[i], len - i < 32 ? len - i : 32);
 	}
 
 	//send off the message
 	Comms.send_message(msg, len);
+	Encrypt.finish_my_block();
 }
 
 
@@ -759,6 +1083,9 @@ void setup() {
 	// open the serial communications that I need
 	Serial.begin(9600);
 	Serial1.begin(9600);
+
+	// the slow part of making keys, done before anyone's waiting on one
+	gather_entropy(EntropyPool);
 }
 
 void loop() {
@@ -806,4 +1133,9 @@ void loop() {
 			while (Serial.available()) Serial.read();
 		}
 	}
-}
\ No newline at end of file
+
+	// nothing came in, so use the time to get keystream ready for the next
+	// message, rather than generating it while it's being received
+	if (!Serial1.available() && !Serial.available())
+		Encrypt.prefetch();
+}
@@ -0,0 +1,267 @@
+#include <iostream>
+#include <string>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include "stdint.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Host side check of the sessions Project1Part2.cpp sets up. Two copies of
+// the sketch, side_a and side_b, run their own setup() and loop() with their
+// Serial1s joined back to back, so the KEY/RSP handshake and every block go
+// over the wire format and through process_incomming_messages, tag checks
+// and all. The test types lines into a's Serial and reads what comes out of
+// b's, and flips or replays bytes on the way over.
+// Build with: g++ -O2 SessionCheck.cpp -o SessionCheck
+// (-DDH_GROUP_BITS=..., -DKEYSTREAM_VERSION=... and the sketch's other
+// options work here too, and both sides get them)
+//
+// The analog pins and the clock are stubbed out below. Exits non zero if any
+// check fails.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define HEX 16
+
+// one end of a serial port: reads come off In, writes go on Out
+struct StubSerial {
+	std::deque<uint8_t>& In;
+	std::deque<uint8_t>& Out;
+
+	StubSerial(std::deque<uint8_t>& in, std::deque<uint8_t>& out): In(in), Out(out) {}
+
+	void begin(long) {}
+	int available() { return In.size(); }
+	int read() {
+		if (In.empty())
+			return -1;
+		uint8_t b = In.front();
+		In.pop_front();
+		return b;
+	}
+	size_t write(uint8_t b) { Out.push_back(b); return 1; }
+
+	void print(const char* s) { while (*s) write(*s++); }
+	void print(char c) { write(c); }
+	template <class T> void print(T v, int base = 10) {
+		char text[24];
+		snprintf(text, sizeof(text), base == HEX ? "%lX" : "%ld", (long)v);
+		print((const char*)text);
+	}
+	void println() { print('\n'); }
+	template <class T> void println(T v) { print(v); println(); }
+};
+
+uint32_t stub_clock = 0;
+int analogRead(int) { return (++stub_clock * 2654435761u) >> 22; }
+unsigned long micros() { return stub_clock; }
+void delay(unsigned long) {}
+
+// everything the sketch includes, so that neither copy gets it inside its
+// namespace
+#include "KeyTraits.h"
+#include "KeystreamGen.h"
+#include "SipHash.h"
+
+std::deque<uint8_t> AToB, BToA;
+std::deque<uint8_t> AConsoleIn, AConsoleOut, BConsoleIn, BConsoleOut;
+
+namespace side_a {
+StubSerial Serial(AConsoleIn, AConsoleOut), Serial1(BToA, AToB);
+void key_handler(uint8_t*);
+void mac_handler(uint8_t*);
+void msg_handler(uint8_t*);
+void rsp_handler(uint8_t*);
+#include "Project1Part2.cpp"
+}
+
+namespace side_b {
+StubSerial Serial(BConsoleIn, BConsoleOut), Serial1(AToB, BToA);
+void key_handler(uint8_t*);
+void mac_handler(uint8_t*);
+void msg_handler(uint8_t*);
+void rsp_handler(uint8_t*);
+#include "Project1Part2.cpp"
+}
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+	if (!ok) {
+		std::cout << "FAIL: " << what << "\n";
+		++failures;
+	}
+}
+
+// runs both loops until nothing is left to type or go over the wire
+void pump() {
+	for (int i = 0; i < 100000; ++i) {
+		if (AToB.empty() && BToA.empty() && AConsoleIn.empty())
+			return;
+		side_a::loop();
+		side_b::loop();
+	}
+}
+
+// runs a's loop until it has written at least len bytes, without b seeing them
+void run_a_until(size_t len) {
+	for (int i = 0; i < 1000 && AToB.size() < len; ++i)
+		side_a::loop();
+}
+
+// what b has printed since last time
+std::string b_console() {
+	std::string text(BConsoleOut.begin(), BConsoleOut.end());
+	BConsoleOut.clear();
+	return text;
+}
+
+bool contains(const std::string& text, const char* what) {
+	return text.find(what) != std::string::npos;
+}
+
+// types a line into a, which sends it once the session's up
+void type_line(const char* line) {
+	while (*line)
+		AConsoleIn.push_back(*line++);
+	AConsoleIn.push_back('\n');
+}
+
+// the first len bytes of keystream each way, as xored into zeros
+template <class State>
+void my_keystream(State& s, uint8_t* out, size_t len) {
+	memset(out, 0, len);
+	s.start_my_block(0);
+	s.encrypt(out, len);
+	s.finish_my_block();
+}
+
+template <class State>
+void other_keystream(State& s, uint8_t* out, size_t len) {
+	memset(out, 0, len);
+	s.OtherRandomGen.seek(0);
+	s.decrypt(out, len);
+	s.finish_other_block();
+}
+
+// the first len bytes of a plain ChaCha stream with the given nonce: the key
+// is the shared secret xored down to 32 bytes, 4 bytes a word, low byte first
+template <class State>
+void chacha_keystream(State& s, uint32_t nonce, uint8_t* out, size_t len) {
+	typedef typename State::Traits Traits;
+	typename Traits::Key shared = Traits::group_pow_mod(s.OtherPublicKey, s.MyKey, s.Arith);
+	uint8_t key[32] = {0};
+	for (uint16_t i = 0; i < Traits::Bytes; ++i)
+		key[i % 32] ^= Traits::byte(shared, i);
+	ChaCha<CHACHA_ROUNDS> cipher;
+	cipher.set_key(key);
+	cipher.seed(nonce);
+	for (size_t i = 0; i < len; i += 4) {
+		uint32_t word = cipher.next_uint32();
+		for (size_t j = 0; j < 4 && i + j < len; ++j)
+			out[i + j] = word >> (8 * j);
+	}
+}
+
+// what each side's keystreams came out as after the handshake
+void check_keystreams() {
+	const size_t len = 64;
+	uint8_t aMine[len], aOther[len], bMine[len], bOther[len];
+	my_keystream(side_a::Encrypt, aMine, len);
+	other_keystream(side_a::Encrypt, aOther, len);
+	my_keystream(side_b::Encrypt, bMine, len);
+	other_keystream(side_b::Encrypt, bOther, len);
+	check(!memcmp(aMine, bOther, len), "what a sends, b can read");
+	check(!memcmp(bMine, aOther, len), "what b sends, a can read");
+	check(memcmp(aMine, aOther, len) != 0, "the two directions differ");
+
+	// 3 and up are ChaCha, on nonces of the secret and the secret ^
+	// 0x5A5A5A5A, one for each direction
+	if (side_a::Encrypt.Version < side_a::KeystreamChaCha)
+		return;
+	check(side_a::Encrypt.MyRandomGen.generator().chacha() &&
+	      side_a::Encrypt.OtherRandomGen.generator().chacha(), "uses ChaCha from version 3");
+	uint32_t secret = side_a::Encrypt.SecretKey;
+	uint8_t plain[len], masked[len];
+	chacha_keystream(side_a::Encrypt, secret, plain, len);
+	chacha_keystream(side_a::Encrypt, secret ^ 0x5A5A5A5A, masked, len);
+	bool aPlain = !memcmp(aMine, plain, len);
+	check(aPlain || !memcmp(aMine, masked, len), "a sends on one of the two ChaCha streams");
+	check(!memcmp(bMine, aPlain ? masked : plain, len), "b sends on the other one");
+}
+
+int main() {
+	side_a::setup();
+	side_b::setup();
+
+	// the handshake, set off by the first line typed
+	type_line("first line");
+	pump();
+	check(side_a::Encrypt.Status == side_a::Ready && side_b::Encrypt.Status == side_b::Ready,
+	      "both sides finish the handshake");
+	check(side_a::Encrypt.SecretKey == side_b::Encrypt.SecretKey, "both sides agree on the secret");
+	check(side_a::Encrypt.Version == side_a::MaxKeystreamVersion &&
+	      side_b::Encrypt.Version == side_b::MaxKeystreamVersion,
+	      "the session is on the newest version");
+	check(contains(b_console(), "first line"), "the first line arrives");
+	bool tagged = side_a::Encrypt.authenticated();
+	const size_t frameLen = 3 + (tagged ? side_a::MacMessageLen : side_a::MsgMessageLen) + 1;
+
+	// a block with a bit flipped on the way, which the tag has to catch
+	type_line("flipped");
+	run_a_until(frameLen);
+	check(AToB.size() == frameLen, "one block for a short line");
+	AToB[10] ^= 0x04;
+	pump();
+	std::string out = b_console();
+	if (tagged) {
+		check(out == "Bad message tag\n", "a flipped bit fails the tag, unread");
+	}
+
+	// a block sent again straight away
+	type_line("replay me");
+	run_a_until(frameLen);
+	std::deque<uint8_t> replay(AToB);
+	pump();
+	check(contains(b_console(), "replay me"), "the block arrives the first time");
+	AToB = replay;
+	pump();
+	out = b_console();
+	check(out == "Dropped old message block\n", "a block sent again straight away is dropped, unread");
+
+	// and again once the low byte of the next index has come round to it
+	if (tagged) {
+		for (int i = 0; i < 255; ++i)
+			type_line("x");
+		pump();
+		b_console();
+		check((uint8_t)side_b::Encrypt.OtherMessageIndex == replay[3],
+		      "the next index has the replayed block's low byte");
+		AToB = replay;
+		pump();
+		out = b_console();
+		check(out == "Bad message tag\n", "a block from 256 back fails the tag, unread");
+	}
+
+	// and the session still works after all that
+	type_line("last line");
+	pump();
+	check(contains(b_console(), "last line"), "the last line arrives");
+	check_keystreams();
+
+	// a KEY whose version byte was turned down on the way is rejected, rather
+	// than settled for
+	if (side_a::MinKeystreamVersion > side_a::KeystreamBytes) {
+		side_a::Encrypt.Status = side_a::NeedInit;
+		type_line("again");
+		run_a_until(3 + side_a::KeyMessageLen + 1);
+		AToB[3 + side_a::KeyMessageLen - 1] = side_a::KeystreamBytes;
+		pump();
+		check(contains(b_console(), "Rejected keystream version"), "a downgraded KEY is rejected");
+		check(side_b::Encrypt.Status == side_b::Failed, "and fails the handshake");
+	}
+
+	std::cout << (failures ? "FAILED" : "ok") << "\n";
+	return failures != 0;
+}
@@ -0,0 +1,80 @@
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include "stdint.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// SipHash-2-4, a keyed 64 bit MAC, fed a byte at a time so it can run as the
+// bytes come off the serial port: begin() with the 128 bit key, update() for
+// each byte, and finish() for the tag. Bytes are collected into 8 byte words
+// and each word is compressed as soon as it's complete, so the message
+// itself is never buffered and finish() only has the last partial word and
+// the finalisation to do.
+//
+// State is 41 bytes. Matches the reference implementation's test vectors.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+class SipHash {
+public:
+	SipHash() {
+		begin(0, 0);
+	}
+	//
+	void begin(uint64_t k0, uint64_t k1) {
+		V0 = k0 ^ 0x736F6D6570736575ULL;
+		V1 = k1 ^ 0x646F72616E646F6DULL;
+		V2 = k0 ^ 0x6C7967656E657261ULL;
+		V3 = k1 ^ 0x7465646279746573ULL;
+		Len = 0;
+	}
+	//
+	void update(uint8_t b) {
+		Tail[Len & 7] = b;
+		if ((++Len & 7) == 0)
+			compress(word(8));
+	}
+	//
+	uint64_t finish() {
+		// what's left, and the length mod 256 in the top byte
+		compress(word(Len & 7) | ((uint64_t)Len << 56));
+		V2 ^= 0xFF;
+		for (uint8_t i = 0; i < 4; ++i)
+			round();
+		return V0 ^ V1 ^ V2 ^ V3;
+	}
+
+private:
+	// the first n bytes of Tail, little endian
+	uint64_t word(uint8_t n) const {
+		uint64_t m = 0;
+		for (uint8_t i = n; i > 0; --i)
+			m = (m << 8) | Tail[i-1];
+		return m;
+	}
+
+	void compress(uint64_t m) {
+		V3 ^= m;
+		round();
+		round();
+		V0 ^= m;
+	}
+
+	void round() {
+		V0 += V1; V1 = rotl(V1, 13); V1 ^= V0; V0 = rotl(V0, 32);
+		V2 += V3; V3 = rotl(V3, 16); V3 ^= V2;
+		V0 += V3; V3 = rotl(V3, 21); V3 ^= V0;
+		V2 += V1; V1 = rotl(V1, 17); V1 ^= V2; V2 = rotl(V2, 32);
+	}
+
+	static uint64_t rotl(uint64_t x, uint8_t k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t V0, V1, V2, V3;
+	uint8_t Tail[8];
+	uint8_t Len; // bytes so far, mod 256, which is all the finalisation needs
+};
+
+#endif
@@ -0,0 +1,445 @@
+#ifndef X25519_H
+#define X25519_H
+
+#include "stdint.h"
+#include "string.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// X25519 (RFC 7748) Diffie-Hellman on Curve25519, as an alternative to the
+// finite field groups. Keys are 32 bytes, the curve is fixed so there are no
+// parameters to send or check, and a scalar multiply is a fixed 255 step
+// Montgomery ladder with no secret dependent branches.
+//
+// The field (integers mod p = 2^255 - 19) comes in two sizes:
+//  - X25519Field51: 5 limbs of 51 bits in uint64_t, with 128 bit products.
+//    For 64 bit hosts.
+//  - X25519Field8: 32 limbs of 8 bits, multiplied a column at a time into 32
+//    bit accumulators with the top half folded straight back in (2^256 = 38
+//    mod p). The AVR has an 8x8 bit multiplier and nothing bigger, so this
+//    keeps every product in hardware and needs no 64 bit arithmetic at all.
+// X25519_RADIX picks the one x25519() uses, both can be used directly.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef X25519_RADIX
+#ifdef __SIZEOF_INT128__
+#define X25519_RADIX 51
+#else
+#define X25519_RADIX 8
+#endif
+#endif
+
+// A key or scalar the way RFC 7748 has it, and the way it goes over the wire:
+// 32 bytes, little endian
+struct X25519Key {
+	uint8_t Data[32];
+
+	bool operator==(const X25519Key& o) const { return memcmp(Data, o.Data, 32) == 0; }
+	bool operator!=(const X25519Key& o) const { return !(*this == o); }
+};
+
+// (A + 2) / 4 for Curve25519, the constant in the ladder's doubling step
+const uint32_t X25519A24 = 121665;
+
+#ifdef __SIZEOF_INT128__
+class X25519Field51 {
+public:
+	struct Fe {
+		uint64_t v[5];
+	};
+
+	static void set(Fe& r, uint32_t a) {
+		r.v[0] = a;
+		r.v[1] = r.v[2] = r.v[3] = r.v[4] = 0;
+	}
+
+	// little endian, the top bit is ignored as RFC 7748 asks
+	static void from_bytes(Fe& r, const uint8_t* s) {
+		uint64_t w[4];
+		for (uint8_t i = 0; i < 4; ++i) {
+			w[i] = 0;
+			for (uint8_t j = 0; j < 8; ++j)
+				w[i] |= (uint64_t)s[8*i + j] << (8*j);
+		}
+		r.v[0] = w[0] & Mask;
+		r.v[1] = ((w[0] >> 51) | (w[1] << 13)) & Mask;
+		r.v[2] = ((w[1] >> 38) | (w[2] << 26)) & Mask;
+		r.v[3] = ((w[2] >> 25) | (w[3] << 39)) & Mask;
+		r.v[4] = (w[3] >> 12) & Mask;
+	}
+
+	// fully reduced, little endian
+	static void to_bytes(uint8_t* s, const Fe& a) {
+		Fe t = a;
+		carry(t);
+		carry(t);
+		carry(t);
+
+		// t < 2^255 now, so t >= p exactly when t + 19 carries out of bit 255
+		uint64_t q = (t.v[0] + 19) >> 51;
+		for (uint8_t i = 1; i < 5; ++i)
+			q = (t.v[i] + q) >> 51;
+		t.v[0] += 19*q;
+		for (uint8_t i = 0; i < 4; ++i) {
+			t.v[i+1] += t.v[i] >> 51;
+			t.v[i] &= Mask;
+		}
+		t.v[4] &= Mask;
+
+		uint64_t w[4];
+		w[0] = t.v[0] | (t.v[1] << 51);
+		w[1] = (t.v[1] >> 13) | (t.v[2] << 38);
+		w[2] = (t.v[2] >> 26) | (t.v[3] << 25);
+		w[3] = (t.v[3] >> 39) | (t.v[4] << 12);
+		for (uint8_t i = 0; i < 4; ++i) {
+			for (uint8_t j = 0; j < 8; ++j)
+				s[8*i + j] = w[i] >> (8*j);
+		}
+	}
+
+	// limbs grow by a bit, mul copes with that
+	static void add(Fe& r, const Fe& a, const Fe& b) {
+		for (uint8_t i = 0; i < 5; ++i)
+			r.v[i] = a.v[i] + b.v[i];
+	}
+
+	// a + 2p - b, b has to have come out of a mul
+	static void sub(Fe& r, const Fe& a, const Fe& b) {
+		r.v[0] = a.v[0] + 0xFFFFFFFFFFFDAull - b.v[0];
+		for (uint8_t i = 1; i < 5; ++i)
+			r.v[i] = a.v[i] + 0xFFFFFFFFFFFFEull - b.v[i];
+	}
+
+	static void mul(Fe& r, const Fe& a, const Fe& b) {
+		typedef unsigned __int128 u128;
+		const uint64_t* x = a.v;
+		const uint64_t* y = b.v;
+
+		// limbs that wrap past 2^255 come back multiplied by 19
+		uint64_t y1 = 19*y[1], y2 = 19*y[2], y3 = 19*y[3], y4 = 19*y[4];
+		u128 t0 = (u128)x[0]*y[0] + (u128)x[1]*y4 + (u128)x[2]*y3 + (u128)x[3]*y2 + (u128)x[4]*y1;
+		u128 t1 = (u128)x[0]*y[1] + (u128)x[1]*y[0] + (u128)x[2]*y4 + (u128)x[3]*y3 + (u128)x[4]*y2;
+		u128 t2 = (u128)x[0]*y[2] + (u128)x[1]*y[1] + (u128)x[2]*y[0] + (u128)x[3]*y4 + (u128)x[4]*y3;
+		u128 t3 = (u128)x[0]*y[3] + (u128)x[1]*y[2] + (u128)x[2]*y[1] + (u128)x[3]*y[0] + (u128)x[4]*y4;
+		u128 t4 = (u128)x[0]*y[4] + (u128)x[1]*y[3] + (u128)x[2]*y[2] + (u128)x[3]*y[1] + (u128)x[4]*y[0];
+
+		t1 += (uint64_t)(t0 >> 51);
+		t2 += (uint64_t)(t1 >> 51);
+		t3 += (uint64_t)(t2 >> 51);
+		t4 += (uint64_t)(t3 >> 51);
+		r.v[0] = ((uint64_t)t0 & Mask) + 19*(uint64_t)(t4 >> 51);
+		r.v[1] = ((uint64_t)t1 & Mask) + (r.v[0] >> 51);
+		r.v[0] &= Mask;
+		r.v[2] = (uint64_t)t2 & Mask;
+		r.v[3] = (uint64_t)t3 & Mask;
+		r.v[4] = (uint64_t)t4 & Mask;
+	}
+
+	static void sqr(Fe& r, const Fe& a) { mul(r, a, a); }
+
+	static void mul_small(Fe& r, const Fe& a, uint32_t k) {
+		typedef unsigned __int128 u128;
+		u128 c = 0;
+		for (uint8_t i = 0; i < 5; ++i) {
+			c += (u128)a.v[i] * k;
+			r.v[i] = (uint64_t)c & Mask;
+			c >>= 51;
+		}
+		r.v[0] += 19*(uint64_t)c;
+	}
+
+	// swaps a and b when swap is 1, without branching on it
+	static void cswap(Fe& a, Fe& b, uint8_t swap) {
+		uint64_t mask = 0 - (uint64_t)swap;
+		for (uint8_t i = 0; i < 5; ++i) {
+			uint64_t t = mask & (a.v[i] ^ b.v[i]);
+			a.v[i] ^= t;
+			b.v[i] ^= t;
+		}
+	}
+
+private:
+	static const uint64_t Mask = (1ull << 51) - 1;
+
+	static void carry(Fe& a) {
+		for (uint8_t i = 0; i < 4; ++i) {
+			a.v[i+1] += a.v[i] >> 51;
+			a.v[i] &= Mask;
+		}
+		a.v[0] += 19*(a.v[4] >> 51);
+		a.v[4] &= Mask;
+	}
+};
+#endif
+
+class X25519Field8 {
+public:
+	// any value below 2^256, only to_bytes reduces all the way
+	struct Fe {
+		uint8_t v[32];
+	};
+
+	static void set(Fe& r, uint32_t a) {
+		memset(r.v, 0, sizeof(r.v));
+		for (uint8_t i = 0; i < 4; ++i)
+			r.v[i] = a >> (8*i);
+	}
+
+	static void from_bytes(Fe& r, const uint8_t* s) {
+		memcpy(r.v, s, 32);
+		r.v[31] &= 0x7F;
+	}
+
+	static void to_bytes(uint8_t* s, const Fe& a) {
+		Fe t = a;
+
+		// fold bit 255 back in as 19, twice gets below 2^255
+		for (uint8_t round = 0; round < 2; ++round) {
+			uint16_t c = 19 * (t.v[31] >> 7);
+			t.v[31] &= 0x7F;
+			for (uint8_t i = 0; i < 32; ++i) {
+				c += t.v[i];
+				t.v[i] = c;
+				c >>= 8;
+			}
+		}
+
+		// t >= p exactly when t + 19 reaches bit 255, pick without branching
+		Fe u;
+		uint16_t c = 19;
+		for (uint8_t i = 0; i < 32; ++i) {
+			c += t.v[i];
+			u.v[i] = c;
+			c >>= 8;
+		}
+		uint8_t mask = 0 - (u.v[31] >> 7);
+		u.v[31] &= 0x7F;
+		for (uint8_t i = 0; i < 32; ++i)
+			s[i] = (u.v[i] & mask) | (t.v[i] & ~mask);
+	}
+
+	static void add(Fe& r, const Fe& a, const Fe& b) {
+		uint16_t c = 0;
+		for (uint8_t i = 0; i < 32; ++i) {
+			c += a.v[i] + b.v[i];
+			r.v[i] = c;
+			c >>= 8;
+		}
+		fold(r, c);
+	}
+
+	static void sub(Fe& r, const Fe& a, const Fe& b) {
+		int16_t c = 0;
+		for (uint8_t i = 0; i < 32; ++i) {
+			c += a.v[i] - b.v[i];
+			r.v[i] = c;
+			c >>= 8;
+		}
+
+		// a borrow left r = a - b + 2^256, which is 38 too many mod p. Taking
+		// the 38 off can only borrow again if r was tiny, and then once more
+		// leaves it well clear.
+		for (uint8_t round = 0; round < 2; ++round) {
+			int16_t d = c & -38;
+			for (uint8_t i = 0; i < 32; ++i) {
+				d += r.v[i];
+				r.v[i] = d;
+				d >>= 8;
+			}
+			c = d;
+		}
+	}
+
+	//
+	// mul
+	// Column k of the product collects a[i]*b[j] for i + j = k, plus 38 times
+	// the column k + 32 that would sit above 2^256. 32 products of 16 bits
+	// each (times 38 for the top) stays well inside 32 bits.
+	//
+	static void mul(Fe& r, const Fe& a, const Fe& b) {
+		Fe t;
+		uint32_t c = 0;
+		for (uint8_t k = 0; k < 32; ++k) {
+			uint32_t low = 0;
+			for (uint8_t i = 0; i <= k; ++i)
+				low += (uint16_t)a.v[i] * b.v[k - i];
+			uint32_t high = 0;
+			for (uint8_t i = k + 1; i < 32; ++i)
+				high += (uint16_t)a.v[i] * b.v[32 + k - i];
+			c += low + 38*high;
+			t.v[k] = c;
+			c >>= 8;
+		}
+		r = t;
+		fold(r, c);
+	}
+
+	static void sqr(Fe& r, const Fe& a) { mul(r, a, a); }
+
+	static void mul_small(Fe& r, const Fe& a, uint32_t k) {
+		uint32_t c = 0;
+		for (uint8_t i = 0; i < 32; ++i) {
+			c += a.v[i] * k;
+			r.v[i] = c;
+			c >>= 8;
+		}
+		fold(r, c);
+	}
+
+	static void cswap(Fe& a, Fe& b, uint8_t swap) {
+		uint8_t mask = 0 - swap;
+		for (uint8_t i = 0; i < 32; ++i) {
+			uint8_t t = mask & (a.v[i] ^ b.v[i]);
+			a.v[i] ^= t;
+			b.v[i] ^= t;
+		}
+	}
+
+private:
+	// adds carry * 2^256 back in as carry * 38. The first pass carries out
+	// at most 1, and only when it leaves r tiny, so the second can't carry
+	static void fold(Fe& r, uint32_t carry) {
+		for (uint8_t round = 0; round < 2; ++round) {
+			uint32_t c = carry * 38;
+			for (uint8_t i = 0; i < 32; ++i) {
+				c += r.v[i];
+				r.v[i] = c;
+				c >>= 8;
+			}
+			carry = c;
+		}
+	}
+};
+
+//
+// x25519_invert
+// a^(p - 2) = a^-1, with the usual addition chain: 254 squarings and 11
+// multiplies.
+//
+template <class Field>
+void x25519_invert(typename Field::Fe& r, const typename Field::Fe& a) {
+	typedef typename Field::Fe Fe;
+	Fe z2, z9, z11, z5, z10, z20, z50, z100, t;
+
+	Field::sqr(z2, a);                              // 2
+	Field::sqr(t, z2);
+	Field::sqr(t, t);                               // 8
+	Field::mul(z9, t, a);                           // 9
+	Field::mul(z11, z9, z2);                        // 11
+	Field::sqr(t, z11);                             // 22
+	Field::mul(z5, t, z9);                          // 2^5 - 1
+
+	Field::sqr(t, z5);
+	for (uint8_t i = 1; i < 5; ++i)
+		Field::sqr(t, t);
+	Field::mul(z10, t, z5);                         // 2^10 - 1
+
+	Field::sqr(t, z10);
+	for (uint8_t i = 1; i < 10; ++i)
+		Field::sqr(t, t);
+	Field::mul(z20, t, z10);                        // 2^20 - 1
+
+	Field::sqr(t, z20);
+	for (uint8_t i = 1; i < 20; ++i)
+		Field::sqr(t, t);
+	Field::mul(t, t, z20);                          // 2^40 - 1
+
+	for (uint8_t i = 0; i < 10; ++i)
+		Field::sqr(t, t);
+	Field::mul(z50, t, z10);                        // 2^50 - 1
+
+	Field::sqr(t, z50);
+	for (uint8_t i = 1; i < 50; ++i)
+		Field::sqr(t, t);
+	Field::mul(z100, t, z50);                       // 2^100 - 1
+
+	Field::sqr(t, z100);
+	for (uint8_t i = 1; i < 100; ++i)
+		Field::sqr(t, t);
+	Field::mul(t, t, z100);                         // 2^200 - 1
+
+	for (uint8_t i = 0; i < 50; ++i)
+		Field::sqr(t, t);
+	Field::mul(t, t, z50);                          // 2^250 - 1
+
+	for (uint8_t i = 0; i < 5; ++i)
+		Field::sqr(t, t);                           // 2^255 - 32
+	Field::mul(r, t, z11);                          // 2^255 - 21 = p - 2
+}
+
+//
+// x25519_with
+// out = X25519(scalar, u) from RFC 7748 over the given field. The scalar is
+// clamped here, so any 32 random bytes make a private key.
+//
+template <class Field>
+void x25519_with(uint8_t* out, const uint8_t* scalar, const uint8_t* u) {
+	typedef typename Field::Fe Fe;
+	uint8_t k[32];
+	memcpy(k, scalar, 32);
+	k[0] &= 248;
+	k[31] &= 127;
+	k[31] |= 64;
+
+	Fe x1, x2, z2, x3, z3;
+	Field::from_bytes(x1, u);
+	Field::set(x2, 1);
+	Field::set(z2, 0);
+	x3 = x1;
+	Field::set(z3, 1);
+
+	uint8_t swap = 0;
+	for (int16_t t = 254; t >= 0; --t) {
+		uint8_t bit = (k[t >> 3] >> (t & 7)) & 1;
+		swap ^= bit;
+		Field::cswap(x2, x3, swap);
+		Field::cswap(z2, z3, swap);
+		swap = bit;
+
+		Fe a, aa, b, bb, e, c, d, da, cb;
+		Field::add(a, x2, z2);
+		Field::sqr(aa, a);
+		Field::sub(b, x2, z2);
+		Field::sqr(bb, b);
+		Field::sub(e, aa, bb);
+		Field::add(c, x3, z3);
+		Field::sub(d, x3, z3);
+		Field::mul(da, d, a);
+		Field::mul(cb, c, b);
+
+		Field::add(x3, da, cb);
+		Field::sqr(x3, x3);
+		Field::sub(z3, da, cb);
+		Field::sqr(z3, z3);
+		Field::mul(z3, z3, x1);
+		Field::mul(x2, aa, bb);
+		Field::mul_small(z2, e, X25519A24);
+		Field::add(z2, z2, aa);
+		Field::mul(z2, z2, e);
+	}
+	Field::cswap(x2, x3, swap);
+	Field::cswap(z2, z3, swap);
+
+	x25519_invert<Field>(z2, z2);
+	Field::mul(x2, x2, z2);
+	Field::to_bytes(out, x2);
+}
+
+#if X25519_RADIX == 51
+typedef X25519Field51 X25519Field;
+#else
+typedef X25519Field8 X25519Field;
+#endif
+
+inline void x25519(uint8_t* out, const uint8_t* scalar, const uint8_t* u) {
+	x25519_with<X25519Field>(out, scalar, u);
+}
+
+// scalar times the base point u = 9, the public key for a private scalar
+inline void x25519_base(uint8_t* out, const uint8_t* scalar) {
+	uint8_t nine[32] = { 9 };
+	x25519(out, scalar, nine);
+}
+
+#endif